@@ -13,6 +13,8 @@
  */
 #include "arena.h"
 
+#include <errno.h>
+#include <inttypes.h>
 #include <linux/mempolicy.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -24,6 +26,7 @@
 #include <unistd.h>
 
 #include "permutation.h"
+#include "topology.h"
 
 extern int verbosity;
 extern int is_weighted_mbind;
@@ -82,44 +85,292 @@ static inline int mbind(void *addr, unsigned long len, int mode,
   return syscall(__NR_mbind, addr, len, mode, nodemask, maxnode, flags);
 }
 
-static void arena_weighted_mbind(size_t page_size, void *arena,
-                                 size_t arena_size, uint16_t *weights,
-                                 size_t nr_weights) {
-  /* compute cumulative sum for weights
-   * cumulative sum starts at -1
-   * the method for determining a hit on a weight i is when the generated
-   * random number (modulo sum of weights) <= weights_cumsum[i]
-   */
-  int64_t *weights_cumsum = malloc(nr_weights * sizeof(int64_t));
-  if (!weights_cumsum) {
-    fprintf(stderr, "Couldn't allocate memory for weights.\n");
+static inline long get_mempolicy(int *mode, unsigned long *nodemask,
+                                 unsigned long maxnode, void *addr,
+                                 unsigned long flags) {
+  return syscall(__NR_get_mempolicy, mode, nodemask, maxnode, addr, flags);
+}
+
+int parse_mem_policy(const char *str, struct mem_policy *policy) {
+  bool nodes[MAX_CPUS];
+  const char *list;
+  char *p;
+
+  if (strcmp(str, "local") == 0) {
+    policy->mode = MPOL_LOCAL;
+    policy->nodes = 0;
+    return 0;
+  }
+  if (strncmp(str, "bind:", 5) == 0) {
+    policy->mode = MPOL_BIND;
+    list = str + 5;
+  } else if (strncmp(str, "interleave:", 11) == 0) {
+    policy->mode = MPOL_INTERLEAVE;
+    list = str + 11;
+  } else {
+    unsigned long node = strtoul(str, &p, 10);
+    if (p == str || *p || node >= MAX_MEM_NODES) return -1;
+    policy->mode = MPOL_BIND;
+    policy->nodes = (uint64_t)1 << node;
+    return 0;
+  }
+
+  // node lists look just like cpu lists
+  if (parse_cpu_list(list, nodes)) return -1;
+  policy->nodes = 0;
+  for (size_t node = 0; node < MAX_CPUS; ++node) {
+    if (!nodes[node]) continue;
+    if (node >= MAX_MEM_NODES) return -1;
+    policy->nodes |= (uint64_t)1 << node;
+  }
+  return policy->nodes ? 0 : -1;
+}
+
+void print_mem_policy(const struct mem_policy *policy) {
+  if (policy->mode == MPOL_LOCAL) {
+    printf("local");
+    return;
+  }
+  printf("%s:", policy->mode == MPOL_BIND ? "bind" : "interleave");
+  const char *sep = "";
+  for (size_t node = 0; node < MAX_MEM_NODES; ++node) {
+    if (!(policy->nodes & ((uint64_t)1 << node))) continue;
+    printf("%s%zu", sep, node);
+    sep = ",";
+  }
+}
+
+void arena_mbind_policy(void *arena, size_t arena_size,
+                        const struct mem_policy *policy) {
+  uint64_t mask = policy->nodes;
+
+  // maxnode counts one past the last bit the kernel looks at
+  if (mbind(arena, arena_size, policy->mode,
+            policy->mode == MPOL_LOCAL ? NULL : (unsigned long *)&mask,
+            MAX_MEM_NODES + 1,
+            MPOL_MF_MOVE)) {
+    perror("mbind");
     exit(1);
   }
-  weights_cumsum[0] = weights[0] - 1;
-  for (unsigned int i = 1; i < nr_weights; i++) {
-    weights_cumsum[i] = weights_cumsum[i - 1] + weights[i];
+}
+
+int arena_page_node(void *addr) {
+  int node;
+
+  if (get_mempolicy(&node, NULL, 0, addr, MPOL_F_NODE | MPOL_F_ADDR)) {
+    return -1;
   }
-  const int32_t weight_sum = weights_cumsum[nr_weights - 1] + 1;
+  return node;
+}
 
-  uint64_t mask = 0;
-  char *q = (char *)arena + arena_size;
-  rng_init(1);
-  for (char *p = arena; p < q; p += page_size) {
-    uint32_t r = rng_int(1 << 31) % weight_sum;
-    unsigned int node;
-    for (node = 0; node < nr_weights; node++) {
-      if (weights_cumsum[node] >= r) {
-        break;
+// -W: the pages of an arena go to the nodes in proportion to their weights.
+// where the kernel has MPOL_WEIGHTED_INTERLEAVE (linux 6.9) and its node
+// weights already have our ratio, it places the pages at fault time.  the
+// weights are system wide, so we never write them.  otherwise the arena
+// is cut into rounds of weight[node] * unit pages for every node in turn, so
+// one mbind covers whole runs.  either way the chase workers prefault their
+// share of the arena and count the pages of every node.
+
+#define MPOL_WEIGHTED_INTERLEAVE_MODE 6  // newer than our headers
+#define WEIGHTED_INTERLEAVE_SYSFS "/sys/kernel/mm/mempolicy/weighted_interleave"
+#define WEIGHTED_MBIND_RUN (2 << 20)  // the smallest run of one node
+#define WEIGHTED_MBIND_ROUNDS 64      // rounds an arena has at least
+#define MOVE_PAGES_BATCH 1024
+
+struct weighted_mbind {
+  char *arena;
+  size_t page_size;
+  size_t nr_pages;
+  const uint16_t *weights;
+  size_t nr_weights;
+  uint64_t weight_sum;
+  size_t unit;  // pages of each weight in a round, 0 with weighted interleave
+  uint64_t node_pages[MAX_MEM_NODES];  // counted after placement
+};
+
+static inline long move_pages(int pid, unsigned long count, void **pages,
+                              const int *nodes, int *status, int flags) {
+  return syscall(__NR_move_pages, pid, count, pages, nodes, status, flags);
+}
+
+static long read_long_file(const char *path) {
+  FILE *f = fopen(path, "r");
+  long value = -1;
+
+  if (f == NULL) return -1;
+  if (fscanf(f, "%ld", &value) != 1) value = -1;
+  fclose(f);
+  return value;
+}
+
+// true if the kernel's weighted interleave weights of our nodes are in the
+// ratio of ours
+static bool interleave_weights_match(const struct weighted_mbind *wm) {
+  uint64_t ref_weight = 0, ref_kernel = 0;
+  char path[128];
+
+  for (size_t node = 0; node < wm->nr_weights; ++node) {
+    if (!wm->weights[node]) continue;
+    snprintf(path, sizeof(path), WEIGHTED_INTERLEAVE_SYSFS "/node%zu", node);
+    long kernel = read_long_file(path);
+    if (kernel <= 0) return false;
+    if (!ref_weight) {
+      ref_weight = wm->weights[node];
+      ref_kernel = kernel;
+    } else if ((uint64_t)kernel * ref_weight !=
+               wm->weights[node] * ref_kernel) {
+      if (verbosity > 0) {
+        printf("weighted mbind: node %zu has interleave weight %ld, not in "
+               "the ratio of -W\n",
+               node, kernel);
+      }
+      return false;
+    }
+  }
+  return true;
+}
+
+static void *page_addr(const struct weighted_mbind *wm, size_t page) {
+  return wm->arena + page * wm->page_size;
+}
+
+// bind the runs of the rounds [begin, end) to their nodes
+static void bind_rounds(const struct weighted_mbind *wm, size_t begin,
+                        size_t end) {
+  size_t page = begin * wm->weight_sum * wm->unit;
+
+  for (size_t round = begin; round < end; ++round) {
+    for (size_t node = 0; node < wm->nr_weights && page < wm->nr_pages;
+         ++node) {
+      size_t nr = wm->weights[node] * wm->unit;
+      uint64_t mask = (uint64_t)1 << node;
+      if (!nr) continue;
+      if (nr > wm->nr_pages - page) nr = wm->nr_pages - page;
+      if (mbind(page_addr(wm, page), nr * wm->page_size, MPOL_BIND,
+                (unsigned long *)&mask, MAX_MEM_NODES + 1, MPOL_MF_STRICT)) {
+        perror("mbind");
+        exit(1);
+      }
+      page += nr;
+    }
+  }
+}
+
+// fault in the pages [begin, end) and count where they went
+static void fault_pages(void *ctx, size_t begin, size_t end) {
+  struct weighted_mbind *wm = ctx;
+  void *pages[MOVE_PAGES_BATCH];
+  int status[MOVE_PAGES_BATCH];
+  uint64_t node_pages[MAX_MEM_NODES] = {0};
+
+  for (size_t page = begin; page < end; page += MOVE_PAGES_BATCH) {
+    size_t nr = end - page < MOVE_PAGES_BATCH ? end - page : MOVE_PAGES_BATCH;
+    for (size_t i = 0; i < nr; ++i) {
+      pages[i] = page_addr(wm, page + i);
+      *(volatile char *)pages[i] = 0;
+    }
+    // with no nodes move_pages() only reports where the pages are
+    if (move_pages(0, nr, pages, NULL, status, 0)) continue;
+    for (size_t i = 0; i < nr; ++i) {
+      if (status[i] >= 0 && (size_t)status[i] < MAX_MEM_NODES) {
+        ++node_pages[status[i]];
       }
     }
-    mask = 1 << node;
-    if (mbind(p, page_size, MPOL_BIND, &mask, nr_weights, MPOL_MF_STRICT)) {
-      perror("mbind");
-      exit(1);
+  }
+  for (size_t node = 0; node < MAX_MEM_NODES; ++node) {
+    if (node_pages[node]) {
+      __sync_fetch_and_add(&wm->node_pages[node], node_pages[node]);
+    }
+  }
+}
+
+// bind and fault in the rounds [begin, end)
+static void place_rounds(void *ctx, size_t begin, size_t end) {
+  struct weighted_mbind *wm = ctx;
+  size_t round_pages = wm->weight_sum * wm->unit;
+  size_t last = end * round_pages;
+
+  bind_rounds(wm, begin, end);
+  fault_pages(wm, begin * round_pages,
+              last < wm->nr_pages ? last : wm->nr_pages);
+}
+
+static void check_node_pages(const struct weighted_mbind *wm) {
+  uint64_t counted = 0;
+  size_t node;
+
+  for (node = 0; node < MAX_MEM_NODES; ++node) counted += wm->node_pages[node];
+  if (counted == 0) {
+    fprintf(stderr, "weighted mbind: could not count the pages per node\n");
+    return;
+  }
+  // a partial round at the end, plus 1% of the arena
+  uint64_t slack = counted / 100 + wm->weight_sum * (wm->unit ? wm->unit : 1);
+  for (node = 0; node < MAX_MEM_NODES; ++node) {
+    uint64_t weight = node < wm->nr_weights ? wm->weights[node] : 0;
+    uint64_t expected = counted * weight / wm->weight_sum;
+    uint64_t got = wm->node_pages[node];
+    if (verbosity > 0 && (weight || got)) {
+      printf("weighted mbind: node %zu has %" PRIu64 " pages (%.1f%%, weight "
+             "%.1f%%)\n",
+             node, got, 100. * got / counted, 100. * weight / wm->weight_sum);
+    }
+    if (got > expected + slack || got + slack < expected) {
+      fprintf(stderr,
+              "weighted mbind: node %zu has %" PRIu64 " pages, expected %" PRIu64
+              "\n",
+              node, got, expected);
     }
-    *p = 0;
   }
-  free(weights_cumsum);
+}
+
+static void arena_weighted_mbind(size_t page_size, void *arena,
+                                 size_t arena_size, uint16_t *weights,
+                                 size_t nr_weights) {
+  struct weighted_mbind wm = {
+      .arena = arena,
+      .page_size = page_size,
+      .nr_pages = arena_size / page_size,
+      .weights = weights,
+      .nr_weights = nr_weights,
+  };
+  uint16_t min_weight = 0;
+  uint64_t mask = 0;
+
+  for (size_t node = 0; node < nr_weights; ++node) {
+    if (!weights[node]) continue;
+    wm.weight_sum += weights[node];
+    mask |= (uint64_t)1 << node;
+    if (!min_weight || weights[node] < min_weight) min_weight = weights[node];
+  }
+  if (wm.weight_sum == 0) {
+    fprintf(stderr, "-W needs at least one node with a positive weight\n");
+    exit(1);
+  }
+
+  if (interleave_weights_match(&wm) &&
+      mbind(arena, arena_size, MPOL_WEIGHTED_INTERLEAVE_MODE,
+            (unsigned long *)&mask, MAX_MEM_NODES + 1, 0) == 0) {
+    if (verbosity > 0) printf("weighted mbind: weighted interleave\n");
+    chase_parallel_for(wm.nr_pages, fault_pages, &wm);
+    check_node_pages(&wm);
+    return;
+  }
+
+  // runs of at least WEIGHTED_MBIND_RUN bytes, unless that leaves fewer
+  // than WEIGHTED_MBIND_ROUNDS rounds
+  wm.unit = (WEIGHTED_MBIND_RUN / page_size + min_weight - 1) / min_weight;
+  if (wm.unit * wm.weight_sum * WEIGHTED_MBIND_ROUNDS > wm.nr_pages) {
+    wm.unit = wm.nr_pages / (wm.weight_sum * WEIGHTED_MBIND_ROUNDS);
+  }
+  if (wm.unit == 0) wm.unit = 1;
+  if (verbosity > 0) {
+    printf("weighted mbind: runs of %zu pages per unit of weight\n", wm.unit);
+  }
+  size_t round_pages = wm.weight_sum * wm.unit;
+  chase_parallel_for((wm.nr_pages + round_pages - 1) / round_pages,
+                     place_rounds, &wm);
+  check_node_pages(&wm);
 }
 
 static int get_page_size_flags(size_t page_size) {
@@ -232,25 +483,29 @@ static void check_thp_state(void) {
 void *alloc_arena_mmap(size_t page_size, bool use_thp, size_t arena_size, int fd) {
   void *arena;
   size_t pagemask = page_size - 1;
+  bool anonymous = fd == -1 || fd == ARENA_SHARED;
   int flags;
 
   if (fd == -1)
     flags = MAP_PRIVATE | MAP_ANONYMOUS | get_page_size_flags(page_size);
+  else if (fd == ARENA_SHARED)
+    flags = MAP_SHARED | MAP_ANONYMOUS | get_page_size_flags(page_size);
   else
     flags = MAP_SHARED;
 
   arena_size = (arena_size + pagemask) & ~pagemask;
-  arena = mmap(0, arena_size, PROT_READ | PROT_WRITE, flags, fd, 0);
+  arena = mmap(0, arena_size, PROT_READ | PROT_WRITE, flags,
+               anonymous ? -1 : fd, 0);
   if (arena == MAP_FAILED) {
     perror("mmap");
     exit(1);
   }
 
-  if (use_thp && fd == -1)
+  if (use_thp && anonymous)
     check_thp_state();
 
   /* Explicitly disable THP for small pages. */
-  if (!page_size_is_huge(page_size) && fd == -1) {
+  if (!page_size_is_huge(page_size) && anonymous) {
     if (madvise(arena, arena_size, use_thp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE)) {
       perror("madvise");
     }
@@ -267,6 +522,49 @@ void *alloc_arena_mmap(size_t page_size, bool use_thp, size_t arena_size, int fd
   return arena;
 }
 
+#define PREFAULT_CHUNK (2 << 20)  // of the ranges split over the workers
+
+struct prefault {
+  char *arena;
+  size_t arena_size;
+  size_t page_size;
+  size_t chunk;
+};
+
+static void prefault_range(void *ctx, size_t begin, size_t end) {
+  const struct prefault *pf = ctx;
+  char *p = pf->arena + begin * pf->chunk;
+  char *q = pf->arena + end * pf->chunk;
+
+  if (q > pf->arena + pf->arena_size) q = pf->arena + pf->arena_size;
+  if (madvise(p, q - p, MADV_POPULATE_WRITE) == 0) return;
+  // ENOMEM (e.g. out of huge pages) or EFAULT would only fault again, or
+  // SIGBUS, when the pages are written
+  if (errno != EINVAL) {
+    perror("madvise(MADV_POPULATE_WRITE)");
+    exit(1);
+  }
+  // before linux 5.14: write every page
+  for (; p < q; p += pf->page_size) *(volatile char *)p = 0;
+}
+
+void arena_prefault(void *arena, size_t arena_size, size_t page_size,
+                    bool parallel) {
+  struct prefault pf = {
+      .arena = arena,
+      .arena_size = (arena_size + page_size - 1) & ~(page_size - 1),
+      .page_size = page_size,
+      .chunk = page_size > PREFAULT_CHUNK ? page_size : PREFAULT_CHUNK,
+  };
+  size_t nr_chunks = (pf.arena_size + pf.chunk - 1) / pf.chunk;
+
+  if (parallel) {
+    chase_parallel_for(nr_chunks, prefault_range, &pf);
+  } else {
+    prefault_range(&pf, 0, nr_chunks);
+  }
+}
+
 void make_buffer_executable(void *buf, size_t len) {
   if (mprotect(buf, len, PROT_EXEC)) {
     perror("mprotect(PROT_EXEC)");
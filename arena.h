@@ -24,7 +24,34 @@ size_t get_native_page_size(void);
 bool page_size_is_huge(size_t page_size);
 void print_page_size(size_t page_size, bool use_thp);
 
+// fd is a file to map shared, -1 for a private anonymous arena or
+// ARENA_SHARED for an anonymous arena shared with forked processes
+#define ARENA_SHARED (-2)
+
 void *alloc_arena_mmap(size_t page_size, bool use_thp, size_t arena_size, int fd);
 
+// a memory policy for an arena, see mbind(2)
+struct mem_policy {
+  int mode;        // MPOL_LOCAL, MPOL_BIND or MPOL_INTERLEAVE
+  uint64_t nodes;  // nodemask for bind and interleave
+};
+
+// parse "local", "N", "bind:LIST" or "interleave:LIST" (LIST like 0-1,3)
+int parse_mem_policy(const char *str, struct mem_policy *policy);
+void print_mem_policy(const struct mem_policy *policy);
+
+// apply the policy to an arena, moving any pages which are already mapped
+void arena_mbind_policy(void *arena, size_t arena_size,
+                        const struct mem_policy *policy);
+
+// the node the page containing addr is on, -1 if unknown or not mapped
+int arena_page_node(void *addr);
+
+// fault in an anonymous arena (MADV_POPULATE_WRITE, or by writing a byte of
+// every page), split over the chase workers (see set_chase_workers) if
+// parallel, otherwise from the calling thread and so on its node.
+void arena_prefault(void *arena, size_t arena_size, size_t page_size,
+                    bool parallel);
+
 void make_buffer_executable(void *buf, size_t len);
 #endif
@@ -0,0 +1,210 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "chase_image.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "permutation.h"
+
+extern int verbosity;
+
+#define CHASE_IMAGE_MAGIC "MCHASEIM"
+#define CHASE_IMAGE_VERSION 1
+#define CHASE_IMAGE_ALIGN 4096
+#define CHASE_IMAGE_CHUNK (1024 * 1024)
+
+// the file starts with this header, followed by nr_heads encoded heads (64
+// bits each), then the encoded arena words at the next CHASE_IMAGE_ALIGN
+// boundary.  a word is encoded as 0 for NULL and offset + 1 for a pointer into
+// the arena.
+struct chase_image_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t word_size;
+  uint64_t arena_size;
+  uint64_t nr_heads;
+  uint64_t data_offset;
+  char config[CHASE_IMAGE_CONFIG_LEN];
+};
+
+static size_t data_offset(size_t nr_heads) {
+  size_t len = sizeof(struct chase_image_header) + nr_heads * sizeof(uint64_t);
+
+  return (len + CHASE_IMAGE_ALIGN - 1) & ~(size_t)(CHASE_IMAGE_ALIGN - 1);
+}
+
+static uint64_t encode(const char *arena, size_t arena_size, uintptr_t p) {
+  if (p == 0) return 0;
+  if (p < (uintptr_t)arena || p >= (uintptr_t)arena + arena_size) {
+    fprintf(stderr, "chase image: arena contains a foreign pointer %p\n",
+            (void *)p);
+    exit(1);
+  }
+  return p - (uintptr_t)arena + 1;
+}
+
+static uintptr_t decode(char *arena, uintptr_t v) {
+  return v ? (uintptr_t)arena + v - 1 : 0;
+}
+
+struct relocate_ctx {
+  const uintptr_t *src;
+  uintptr_t *dst;
+  char *arena;
+};
+
+static void relocate_range(void *data, size_t begin, size_t end) {
+  const struct relocate_ctx *r = data;
+  size_t i;
+
+  for (i = begin; i < end; ++i) {
+    r->dst[i] = decode(r->arena, r->src[i]);
+  }
+}
+
+bool chase_image_load(const char *path, const char *config, char *arena,
+                      size_t arena_size, void **heads, size_t nr_heads) {
+  struct chase_image_header h;
+  struct stat st;
+  size_t i;
+  int fd = open(path, O_RDONLY);
+
+  if (fd == -1) return false;
+  if (fstat(fd, &st) || pread(fd, &h, sizeof(h), 0) != sizeof(h) ||
+      memcmp(h.magic, CHASE_IMAGE_MAGIC, sizeof(h.magic)) ||
+      h.version != CHASE_IMAGE_VERSION || h.word_size != sizeof(void *) ||
+      h.arena_size != arena_size || h.nr_heads != nr_heads ||
+      h.data_offset != data_offset(nr_heads) ||
+      (uint64_t)st.st_size != h.data_offset + arena_size ||
+      strncmp(h.config, config, sizeof(h.config))) {
+    if (verbosity > 0) printf("chase image %s does not match\n", path);
+    close(fd);
+    return false;
+  }
+
+  const char *image = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (image == MAP_FAILED) {
+    perror("mmap chase image");
+    exit(1);
+  }
+  madvise((void *)image, st.st_size, MADV_SEQUENTIAL);
+
+  const uint64_t *encoded_heads =
+      (const uint64_t *)(image + sizeof(struct chase_image_header));
+  for (i = 0; i < nr_heads; ++i) {
+    heads[i] = (void *)decode(arena, encoded_heads[i]);
+  }
+  struct relocate_ctx r = {
+      .src = (const uintptr_t *)(image + h.data_offset),
+      .dst = (uintptr_t *)arena,
+      .arena = arena,
+  };
+  chase_parallel_for(arena_size / sizeof(uintptr_t), relocate_range, &r);
+
+  if (munmap((void *)image, st.st_size)) {
+    perror("munmap chase image");
+    exit(1);
+  }
+  if (verbosity > 0) printf("loaded chase image %s\n", path);
+  return true;
+}
+
+static void write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+
+  while (len) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      perror("write chase image");
+      exit(1);
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+void chase_image_save(const char *path, const char *config, const char *arena,
+                      size_t arena_size, void *const *heads, size_t nr_heads) {
+  size_t len = strlen(path) + sizeof(".tmp");
+  char *tmp_path = malloc(len);
+  size_t header_len = data_offset(nr_heads);
+  char *buf = calloc(1, header_len > CHASE_IMAGE_CHUNK ? header_len
+                                                       : CHASE_IMAGE_CHUNK);
+  struct chase_image_header *h = (struct chase_image_header *)buf;
+  size_t i;
+  size_t done;
+
+  if (tmp_path == NULL || buf == NULL) {
+    fprintf(stderr, "Could not allocate memory for the chase image\n");
+    exit(1);
+  }
+  if (arena_size % sizeof(uintptr_t)) {
+    fprintf(stderr, "chase image: arena size must be a multiple of %zu\n",
+            sizeof(uintptr_t));
+    exit(1);
+  }
+  snprintf(tmp_path, len, "%s.tmp", path);
+  int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    perror("open chase image");
+    exit(1);
+  }
+
+  // write to a temporary file and rename it, so concurrent runs never see a
+  // partial image
+  memcpy(h->magic, CHASE_IMAGE_MAGIC, sizeof(h->magic));
+  h->version = CHASE_IMAGE_VERSION;
+  h->word_size = sizeof(void *);
+  h->arena_size = arena_size;
+  h->nr_heads = nr_heads;
+  h->data_offset = header_len;
+  strncpy(h->config, config, sizeof(h->config) - 1);
+  uint64_t *encoded_heads = (uint64_t *)(buf + sizeof(*h));
+  for (i = 0; i < nr_heads; ++i) {
+    encoded_heads[i] = encode(arena, arena_size, (uintptr_t)heads[i]);
+  }
+  write_all(fd, buf, header_len);
+
+  const uintptr_t *words = (const uintptr_t *)arena;
+  uintptr_t *encoded = (uintptr_t *)buf;
+  for (done = 0; done < arena_size; done += CHASE_IMAGE_CHUNK) {
+    size_t chunk = arena_size - done < CHASE_IMAGE_CHUNK ? arena_size - done
+                                                         : CHASE_IMAGE_CHUNK;
+    const uintptr_t *w = words + done / sizeof(uintptr_t);
+    for (i = 0; i < chunk / sizeof(uintptr_t); ++i) {
+      encoded[i] = encode(arena, arena_size, w[i]);
+    }
+    write_all(fd, buf, chunk);
+  }
+
+  if (fsync(fd) || close(fd)) {
+    perror("close chase image");
+    exit(1);
+  }
+  if (rename(tmp_path, path)) {
+    perror("rename chase image");
+    exit(1);
+  }
+  if (verbosity > 0) printf("saved chase image %s\n", path);
+  free(tmp_path);
+  free(buf);
+}
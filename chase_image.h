@@ -0,0 +1,38 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CHASE_IMAGE_H_INCLUDED
+#define CHASE_IMAGE_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A chase image is a saved copy of a fully built arena.  Every pointer in the
+// arena is stored as an offset from the start of the arena, so the image can
+// be loaded into an arena at any address.  The config string describes
+// everything the chase was built from; an image is only used when the config
+// matches exactly.
+
+#define CHASE_IMAGE_CONFIG_LEN 256
+
+// Load the image at path into arena, relocating it to the arena's address,
+// and set heads[] to the first pointer of each chase.  Returns false (and
+// leaves the arena untouched) if there is no image or it doesn't match.
+bool chase_image_load(const char *path, const char *config, char *arena,
+                      size_t arena_size, void **heads, size_t nr_heads);
+
+// Save arena and heads[] to path.
+void chase_image_save(const char *path, const char *config, const char *arena,
+                      size_t arena_size, void *const *heads, size_t nr_heads);
+
+#endif
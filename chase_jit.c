@@ -0,0 +1,395 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "chase_jit.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_DEREF_BYTES 96   // upper bound on the code of one deref
+#define JIT_FIXED_BYTES 256  // prologue, loop control and epilogue
+#define JIT_CHAIN_BYTES 16   // loading and storing one chain
+
+int parse_jit_chase_args(const char *str, unsigned max_par,
+                         struct jit_chase_args *args) {
+  static const char *const hints[] = {"", "t0", "t1", "t2", "nta"};
+  char *copy = strdup(str);
+  char *tok, *save = NULL, *val, *end;
+  unsigned long n;
+  int rc = 0;
+  size_t i;
+
+  args->par = 1;
+  args->unroll = 0;
+  args->work = 0;
+  args->width = sizeof(void *);
+  args->prefetch = JIT_PREFETCH_NONE;
+  for (tok = strtok_r(copy, ",", &save); tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    val = strchr(tok, '=');
+    if (val == NULL || val[1] == 0) {
+      rc = -1;
+      break;
+    }
+    *val++ = 0;
+    if (strcmp(tok, "prefetch") == 0) {
+      for (i = 1; i < sizeof(hints) / sizeof(hints[0]); ++i) {
+        if (strcmp(val, hints[i]) == 0) break;
+      }
+      if (i == sizeof(hints) / sizeof(hints[0])) rc = -1;
+      args->prefetch = i;
+      continue;
+    }
+    n = strtoul(val, &end, 0);
+    if (*end || n > JIT_MAX_LOADS) {
+      rc = -1;
+    } else if (strcmp(tok, "par") == 0) {
+      args->par = n;
+    } else if (strcmp(tok, "unroll") == 0) {
+      args->unroll = n;
+    } else if (strcmp(tok, "work") == 0) {
+      args->work = n;
+    } else if (strcmp(tok, "width") == 0) {
+      args->width = n;
+    } else {
+      rc = -1;
+    }
+  }
+  free(copy);
+  if (rc || args->par == 0 || args->par > max_par) return -1;
+  if (args->unroll == 0) args->unroll = (200 + args->par - 1) / args->par;
+  if ((size_t)args->par * args->unroll > JIT_MAX_LOADS) return -1;
+  if (args->width != 8 && args->width != 16 && args->width != 32 &&
+      args->width != 64) {
+    return -1;
+  }
+  return 0;
+}
+
+#if defined(__aarch64__) || defined(__x86_64__)
+static size_t jit_code_size(const struct jit_chase_args *args) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t size = JIT_FIXED_BYTES + args->par * JIT_CHAIN_BYTES +
+                (size_t)args->par * args->unroll * JIT_DEREF_BYTES;
+  return (size + page - 1) & ~(page - 1);
+}
+
+static char *jit_alloc(size_t size) {
+  char *code = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (code == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  return code;
+}
+
+// make the emitted code executable (and no longer writable).
+static jit_chase_fn jit_finish(char *code, size_t size, char *end) {
+  if ((size_t)(end - code) > size) {
+    fprintf(stderr, "jit chase overflowed its code buffer\n");
+    exit(1);
+  }
+  __builtin___clear_cache(code, end);
+  if (mprotect(code, size, PROT_READ | PROT_EXEC)) {
+    perror("mprotect");
+    exit(1);
+  }
+  return (jit_chase_fn)code;
+}
+#endif
+
+#if defined(__aarch64__)
+
+// x0 = cycle, x1 = count.  the chains live in the caller saved registers,
+// any more are kept in cycle[] and go through x9.  x10 holds the loads per
+// pass, x11 accumulates the work, x12 counts the work loop and is the
+// exclusive store status.
+static const int chain_regs[] = {2, 3, 4, 5, 6, 7, 8, 13, 14, 15, 16, 17};
+#define NR_CHAIN_REGS (sizeof(chain_regs) / sizeof(chain_regs[0]))
+enum { R_CYCLE = 0, R_COUNT = 1, R_TMP = 9, R_LOADS = 10, R_WORK = 11,
+       R_CTR = 12 };
+
+static char *arm_emit(char *p, uint32_t insn) {
+  memcpy(p, &insn, sizeof(insn));
+  return p + sizeof(insn);
+}
+
+static uint32_t arm_branch19(const char *from, const char *to) {
+  return ((uint32_t)((to - from) / 4) & 0x7ffff) << 5;
+}
+
+// ldr / str xt, [xn, #off]
+static char *arm_ldr(char *p, int rt, int rn, unsigned off) {
+  return arm_emit(p, 0xf9400000 | (off / 8) << 10 | rn << 5 | rt);
+}
+
+static char *arm_str(char *p, int rt, int rn, unsigned off) {
+  return arm_emit(p, 0xf9000000 | (off / 8) << 10 | rn << 5 | rt);
+}
+
+// ldr qt, [xn, #off]
+static char *arm_ldr_q(char *p, int qt, int rn, unsigned off) {
+  return arm_emit(p, 0x3dc00000 | (off / 16) << 10 | rn << 5 | qt);
+}
+
+// movz / movk wd, #imm16, lsl #shift16 * 16
+static char *arm_mov32(char *p, int rd, uint32_t imm) {
+  p = arm_emit(p, 0x52800000 | (imm & 0xffff) << 5 | rd);
+  return arm_emit(p, 0x72a00000 | (imm >> 16) << 5 | rd);
+}
+
+static char *arm_deref(char *p, const struct jit_chase_args *args, int r) {
+  static const uint32_t prfops[] = {0, 0, 2, 4, 1};  // pld{l1,l2,l3}keep
+  unsigned off;
+
+  if (args->prefetch != JIT_PREFETCH_NONE) {
+    p = arm_emit(p, 0xf9800000 | r << 5 | prfops[args->prefetch]);
+  }
+  // add x11, x11, xr
+  if (args->work) p = arm_emit(p, 0x8b000000 | r << 16 | R_WORK << 5 | R_WORK);
+  if (args->width == 8) return arm_ldr(p, r, r, 0);
+  // fold the whole width into the pointer, the rest of the line is zero
+  p = arm_ldr_q(p, 0, r, 0);
+  for (off = 16; off < args->width; off += 16) {
+    p = arm_ldr_q(p, 1, r, off);
+    p = arm_emit(p, 0x4ee18400);  // add v0.2d, v0.2d, v1.2d
+  }
+  return arm_emit(p, 0x9e660000 | r);  // fmov xr, d0
+}
+
+static char *arm_work(char *p, const struct jit_chase_args *args) {
+  char *loop;
+
+  p = arm_mov32(p, R_CTR, args->work);
+  loop = p;
+  p = arm_emit(p, 0xca000000 | R_CTR << 16 | R_WORK << 5 | R_WORK);  // eor
+  p = arm_emit(p, 0x71000400 | R_CTR << 5 | R_CTR);  // subs w12, w12, #1
+  return arm_emit(p, 0x54000001 | arm_branch19(p, loop));  // b.ne
+}
+
+jit_chase_fn jit_chase_build(const struct jit_chase_args *args) {
+  size_t size = jit_code_size(args);
+  char *code = jit_alloc(size);
+  char *p = code, *loop, *retry;
+  unsigned i, j;
+
+  for (j = 0; j < args->par && j < NR_CHAIN_REGS; ++j) {
+    p = arm_ldr(p, chain_regs[j], R_CYCLE, j * 8);
+  }
+  p = arm_mov32(p, R_LOADS, args->par * args->unroll);
+  p = arm_emit(p, 0xd2800000 | R_WORK);  // mov x11, #0
+  loop = p;
+  for (i = 0; i < args->unroll; ++i) {
+    for (j = 0; j < args->par; ++j) {
+      if (j < NR_CHAIN_REGS) {
+        p = arm_deref(p, args, chain_regs[j]);
+      } else {
+        p = arm_ldr(p, R_TMP, R_CYCLE, j * 8);
+        p = arm_deref(p, args, R_TMP);
+        p = arm_str(p, R_TMP, R_CYCLE, j * 8);
+      }
+      if (args->work) p = arm_work(p, args);
+    }
+  }
+  // __sync_add_and_fetch(count, loads) and loop unless it is 0
+  retry = p;
+  p = arm_emit(p, 0x885f7c00 | R_COUNT << 5 | R_TMP);  // ldxr w9, [x1]
+  p = arm_emit(p, 0x0b000000 | R_LOADS << 16 | R_TMP << 5 | R_TMP);
+  // stlxr w12, w9, [x1]
+  p = arm_emit(p, 0x8800fc00 | R_CTR << 16 | R_COUNT << 5 | R_TMP);
+  p = arm_emit(p, 0x35000000 | arm_branch19(p, retry) | R_CTR);  // cbnz
+  p = arm_emit(p, 0xd5033bbf);  // dmb ish
+  p = arm_emit(p, 0x35000000 | arm_branch19(p, loop) | R_TMP);  // cbnz
+  for (j = 0; j < args->par && j < NR_CHAIN_REGS; ++j) {
+    p = arm_str(p, chain_regs[j], R_CYCLE, j * 8);
+  }
+  p = arm_emit(p, 0xd65f03c0);  // ret
+  return jit_finish(code, size, p);
+}
+
+#elif defined(__x86_64__)
+
+// rdi = cycle, rsi = count.  the chains live in registers (pushing the
+// callee saved ones), any more are kept in cycle[] and go through rax.
+// rax also counts the work loop and adds to the count, r11 accumulates the
+// work.
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13,
+       R14, R15 };
+static const int chain_regs[] = {RCX, RDX, R8,  R9,  R10, RBX,
+                                 RBP, R12, R13, R14, R15};
+#define NR_CHAIN_REGS (sizeof(chain_regs) / sizeof(chain_regs[0]))
+#define FIRST_SAVED_REG 5  // chain_regs[5] on are callee saved
+
+static char *x64_rex(char *p, int w, int reg, int base) {
+  int rex = 0x40 | w << 3 | (reg >> 3) << 2 | base >> 3;
+  if (rex != 0x40) *p++ = rex;
+  return p;
+}
+
+// the modrm (and sib and displacement) of [base + disp]
+static char *x64_mem(char *p, int reg, int base, int32_t disp) {
+  int mod = (disp == 0 && (base & 7) != RBP) ? 0 : disp == (int8_t)disp ? 1 : 2;
+  *p++ = mod << 6 | (reg & 7) << 3 | (base & 7);
+  if ((base & 7) == RSP) *p++ = 0x24;
+  if (mod == 1) {
+    *p++ = disp;
+  } else if (mod == 2) {
+    memcpy(p, &disp, sizeof(disp));
+    p += sizeof(disp);
+  }
+  return p;
+}
+
+static char *x64_imm32(char *p, uint32_t imm) {
+  memcpy(p, &imm, sizeof(imm));
+  return p + sizeof(imm);
+}
+
+// mov reg, [base + disp]
+static char *x64_load(char *p, int reg, int base, int32_t disp) {
+  p = x64_rex(p, 1, reg, base);
+  *p++ = 0x8b;
+  return x64_mem(p, reg, base, disp);
+}
+
+// mov [base + disp], reg
+static char *x64_store(char *p, int reg, int base, int32_t disp) {
+  p = x64_rex(p, 1, reg, base);
+  *p++ = 0x89;
+  return x64_mem(p, reg, base, disp);
+}
+
+// movdqa xmm, [base + disp]
+static char *x64_movdqa(char *p, int xmm, int base, int32_t disp) {
+  *p++ = 0x66;
+  p = x64_rex(p, 0, xmm, base);
+  *p++ = 0x0f;
+  *p++ = 0x6f;
+  return x64_mem(p, xmm, base, disp);
+}
+
+static char *x64_deref(char *p, const struct jit_chase_args *args, int r) {
+  static const int hints[] = {0, 1, 2, 3, 0};  // prefetch{t0,t1,t2,nta}
+  unsigned off;
+
+  if (args->prefetch != JIT_PREFETCH_NONE) {
+    p = x64_rex(p, 0, 0, r);
+    *p++ = 0x0f;
+    *p++ = 0x18;
+    p = x64_mem(p, hints[args->prefetch], r, 0);
+  }
+  if (args->work) {
+    // add r11, r
+    p = x64_rex(p, 1, r, R11);
+    *p++ = 0x01;
+    *p++ = 0xc0 | (r & 7) << 3 | (R11 & 7);
+  }
+  if (args->width == 8) return x64_load(p, r, r, 0);
+  // fold the whole width into the pointer, the rest of the line is zero
+  p = x64_movdqa(p, 0, r, 0);
+  for (off = 16; off < args->width; off += 16) {
+    p = x64_movdqa(p, 1, r, off);
+    *p++ = 0x66;  // paddq xmm0, xmm1
+    *p++ = 0x0f;
+    *p++ = 0xd4;
+    *p++ = 0xc1;
+  }
+  *p++ = 0x66;  // movq r, xmm0
+  p = x64_rex(p, 1, 0, r);
+  *p++ = 0x0f;
+  *p++ = 0x7e;
+  *p++ = 0xc0 | (r & 7);
+  return p;
+}
+
+static char *x64_work(char *p, const struct jit_chase_args *args) {
+  char *loop;
+
+  *p++ = 0xb8;  // mov eax, work
+  p = x64_imm32(p, args->work);
+  loop = p;
+  *p++ = 0x49;  // xor r11, rax
+  *p++ = 0x31;
+  *p++ = 0xc3;
+  *p++ = 0xff;  // dec eax
+  *p++ = 0xc8;
+  *p++ = 0x75;  // jnz loop
+  *p = loop - (p + 1);
+  return p + 1;
+}
+
+static char *x64_push_pop(char *p, int r, bool pop) {
+  p = x64_rex(p, 0, 0, r);
+  *p++ = (pop ? 0x58 : 0x50) + (r & 7);
+  return p;
+}
+
+jit_chase_fn jit_chase_build(const struct jit_chase_args *args) {
+  size_t size = jit_code_size(args);
+  char *code = jit_alloc(size);
+  char *p = code, *loop;
+  unsigned nr_regs = args->par < NR_CHAIN_REGS ? args->par : NR_CHAIN_REGS;
+  unsigned i, j;
+
+  for (j = FIRST_SAVED_REG; j < nr_regs; ++j) {
+    p = x64_push_pop(p, chain_regs[j], false);
+  }
+  for (j = 0; j < nr_regs; ++j) p = x64_load(p, chain_regs[j], RDI, j * 8);
+  *p++ = 0x45;  // xor r11d, r11d
+  *p++ = 0x31;
+  *p++ = 0xdb;
+  loop = p;
+  for (i = 0; i < args->unroll; ++i) {
+    for (j = 0; j < args->par; ++j) {
+      if (j < nr_regs) {
+        p = x64_deref(p, args, chain_regs[j]);
+      } else {
+        p = x64_load(p, RAX, RDI, j * 8);
+        p = x64_deref(p, args, RAX);
+        p = x64_store(p, RAX, RDI, j * 8);
+      }
+      if (args->work) p = x64_work(p, args);
+    }
+  }
+  // __sync_add_and_fetch(count, loads) and loop unless it is 0
+  *p++ = 0xb8;  // mov eax, loads
+  p = x64_imm32(p, args->par * args->unroll);
+  *p++ = 0xf0;  // lock xadd [rsi], eax
+  *p++ = 0x0f;
+  *p++ = 0xc1;
+  *p++ = 0x06;
+  *p++ = 0x05;  // add eax, loads
+  p = x64_imm32(p, args->par * args->unroll);
+  *p++ = 0x0f;  // jnz loop
+  *p++ = 0x85;
+  p = x64_imm32(p, loop - (p + 4));
+  for (j = 0; j < nr_regs; ++j) p = x64_store(p, chain_regs[j], RDI, j * 8);
+  for (j = nr_regs; j-- > FIRST_SAVED_REG;) {
+    p = x64_push_pop(p, chain_regs[j], true);
+  }
+  *p++ = 0xc3;  // ret
+  return jit_finish(code, size, p);
+}
+
+#else
+jit_chase_fn jit_chase_build(const struct jit_chase_args *args) {
+  fprintf(stderr, "Not implemented on this architecture.\n");
+  exit(1);
+}
+#endif
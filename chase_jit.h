@@ -0,0 +1,51 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CHASE_JIT_H_INCLUDED
+#define CHASE_JIT_H_INCLUDED
+
+// chase loops generated at runtime (x86_64 and arm64), so every combination
+// of chains, unroll, alu work, load width and prefetch hint is a chase
+// without another hand written function.
+
+#define JIT_MAX_LOADS 4096  // loads in one pass of the generated loop
+
+enum jit_prefetch {
+  JIT_PREFETCH_NONE,
+  JIT_PREFETCH_T0,
+  JIT_PREFETCH_T1,
+  JIT_PREFETCH_T2,
+  JIT_PREFETCH_NTA,
+};
+
+struct jit_chase_args {
+  unsigned par;      // independent chains
+  unsigned unroll;   // derefs of every chain in one pass
+  unsigned work;     // iterations of an alu loop after every deref
+  unsigned width;    // bytes loaded by every deref: 8, 16, 32 or 64
+  enum jit_prefetch prefetch;  // issued on the line before every deref
+};
+
+// parse "par=N,unroll=N,work=N,width=B,prefetch=t0|t1|t2|nta", every field
+// is optional.  unroll defaults to about 200 loads per pass.
+int parse_jit_chase_args(const char *str, unsigned max_par,
+                         struct jit_chase_args *args);
+
+// the generated loop derefs the chains of cycle[] unroll times per pass and
+// adds the loads to *count after every pass, until it wraps to 0 (i.e.
+// never, like the other chases).
+typedef void (*jit_chase_fn)(void **cycle, unsigned *count);
+
+jit_chase_fn jit_chase_build(const struct jit_chase_args *args);
+
+#endif
@@ -27,6 +27,18 @@
 #define SWEEP_SPACER (CACHELINE_SIZE - sizeof(unsigned))
 #endif
 
+#include <stdint.h>
+
+// an element of the store chase: the pointer on one line and the store on
+// the next.  the size is a power of two, so that the chase lays the elements
+// out on line boundaries at any stride.
+struct store_struct {
+  struct store_struct *next;
+  char pad[CACHELINE_SIZE - sizeof(void *)];
+  uintptr_t stored;  // on the next line
+  char pad2[CACHELINE_SIZE - sizeof(uintptr_t)];
+};
+
 #if defined(__x86_64__) || defined(__i386__)
 static inline void cpu_relax(void) { asm volatile("rep; nop"); }
 #elif defined __powerpc__
@@ -24,6 +24,7 @@
 
 #include "cpu_util.h"
 #include "expand.h"
+#include "json_out.h"
 #include "timer.h"
 
 typedef unsigned atomic_t;
@@ -36,17 +37,32 @@ typedef union {
   char pad[AVOID_FALSE_SHARING];
 } per_thread_t;
 
+// a queue node of the mcs and qspin locks, one per thread
+struct mcs_node {
+  struct mcs_node *next;
+  int locked;
+} __attribute__((aligned(CACHELINE_SIZE)));
+
+// the contended line: the counter and the state of every lock protecting
+// it.  only the lock of the selected primitive is used.
+struct line {
+  atomic_t count;
+  atomic_t ticket_next;
+  atomic_t ticket_owner;
+  atomic_t qspin_locked;
+  struct mcs_node *mcs_tail;
+  struct mcs_node *qspin_tail;
+} __attribute__((aligned(CACHELINE_SIZE)));
+
 typedef struct {
-  struct {
-    atomic_t count;
-    char spacer[SWEEP_SPACER];
-  } x[SWEEP_MAX];
+  struct line x[SWEEP_MAX];
   int sweep_id;
 } sync_count;
 
 sync_count global_counter;
 
 static volatile int relaxed;
+static volatile int stop;
 
 static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
@@ -65,9 +81,7 @@ static void wait_for_startup(void) {
   pthread_mutex_unlock(&wait_mutex);
 }
 
-static void *worker(void *_args) {
-  per_thread_t *args = _args;
-
+static void worker_setup(per_thread_t *args) {
   // move to our target cpu
   cpu_set_t cpu;
   CPU_ZERO(&cpu);
@@ -78,24 +92,323 @@ static void *worker(void *_args) {
   }
 
   wait_for_startup();
+}
+
+#define always_inline inline __attribute__((always_inline))
+
+// retry a compare and swap until the increment sticks
+static always_inline void cas_op(struct line *l) {
+  atomic_t old = *(volatile atomic_t *)&l->count;
+  while (!__sync_bool_compare_and_swap(&l->count, old, old + 1)) {
+    old = *(volatile atomic_t *)&l->count;
+  }
+}
+
+static always_inline void xchg_op(struct line *l, atomic_t v) {
+  __atomic_exchange_n(&l->count, v, __ATOMIC_SEQ_CST);
+}
+
+#if defined(__aarch64__)
+// the same increment as the exclusive load / store pair of armv8.0, whatever
+// the compiler would pick for __sync_fetch_and_add
+static always_inline void xadd_llsc_op(struct line *l) {
+  atomic_t tmp;
+  int fail;
+  asm volatile(
+      "1: ldaxr %w0, %2\n"
+      "   add %w0, %w0, #1\n"
+      "   stlxr %w1, %w0, %2\n"
+      "   cbnz %w1, 1b\n"
+      : "=&r"(tmp), "=&r"(fail), "+Q"(l->count)
+      :
+      : "memory");
+}
+
+#if defined(__ARM_FEATURE_ATOMICS)
+// the single armv8.1 atomic
+static always_inline void xadd_lse_op(struct line *l) {
+  atomic_t one = 1, old;
+  asm volatile("ldaddal %w2, %w0, %1"
+               : "=r"(old), "+Q"(l->count)
+               : "r"(one)
+               : "memory");
+}
+#endif
+#endif
+
+static always_inline void ticket_op(struct line *l) {
+  atomic_t me = __atomic_fetch_add(&l->ticket_next, 1, __ATOMIC_RELAXED);
+  while (__atomic_load_n(&l->ticket_owner, __ATOMIC_ACQUIRE) != me) {
+    cpu_relax();
+  }
+  ++*(volatile atomic_t *)&l->count;
+  __atomic_store_n(&l->ticket_owner, me + 1, __ATOMIC_RELEASE);
+}
+
+static always_inline void mcs_lock(struct mcs_node **tail,
+                                   struct mcs_node *node) {
+  node->next = NULL;
+  node->locked = 1;
+  struct mcs_node *prev = __atomic_exchange_n(tail, node, __ATOMIC_ACQ_REL);
+  if (prev) {
+    __atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&node->locked, __ATOMIC_ACQUIRE)) cpu_relax();
+  }
+}
+
+static always_inline void mcs_unlock(struct mcs_node **tail,
+                                     struct mcs_node *node) {
+  struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+  if (!next) {
+    struct mcs_node *expected = node;
+    if (__atomic_compare_exchange_n(tail, &expected, NULL, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+      return;
+    }
+    // a successor is between its exchange and linking itself in
+    while (!(next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE))) {
+      cpu_relax();
+    }
+  }
+  __atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+}
+
+static always_inline void mcs_op(struct line *l, struct mcs_node *node) {
+  mcs_lock(&l->mcs_tail, node);
+  ++*(volatile atomic_t *)&l->count;
+  mcs_unlock(&l->mcs_tail, node);
+}
+
+// like the linux qspinlock: take the lock word with one compare and swap
+// when it is free, otherwise queue up so that only the head of an mcs queue
+// spins on the lock word.
+static always_inline void qspin_op(struct line *l, struct mcs_node *node) {
+  atomic_t unlocked = 0;
+  if (!__atomic_compare_exchange_n(&l->qspin_locked, &unlocked, 1, false,
+                                   __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+    mcs_lock(&l->qspin_tail, node);
+    for (;;) {
+      unlocked = 0;
+      if (__atomic_load_n(&l->qspin_locked, __ATOMIC_RELAXED) == 0 &&
+          __atomic_compare_exchange_n(&l->qspin_locked, &unlocked, 1, false,
+                                      __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        break;
+      }
+      cpu_relax();
+    }
+    mcs_unlock(&l->qspin_tail, node);
+  }
+  ++*(volatile atomic_t *)&l->count;
+  __atomic_store_n(&l->qspin_locked, 0, __ATOMIC_RELEASE);
+}
 
-  if (delay_mask & (1u << args->x.cpu)) {
-    sleep(1);
+// a worker doing op (on the line l, with the queue node node) until stopped,
+// first back to back then with a cpu_relax() after every op.
+#define WORKER(name, op)                                          \
+  static void *name##_worker(void *_args) {                       \
+    per_thread_t *args = _args;                                   \
+    struct mcs_node node;                                         \
+    struct line *l;                                               \
+                                                                  \
+    (void)node;                                                   \
+    worker_setup(args);                                           \
+    if (delay_mask & (1u << args->x.cpu)) {                       \
+      sleep(1);                                                   \
+    }                                                             \
+    while (!relaxed && !stop) {                                   \
+      l = &global_counter.x[global_counter.sweep_id];             \
+      x50(op;);                                                   \
+      __sync_fetch_and_add(&args->x.count, 50);                   \
+    }                                                             \
+    if (delay_mask & (1u << args->x.cpu)) {                       \
+      sleep(1);                                                   \
+    }                                                             \
+    while (relaxed && !stop) {                                    \
+      l = &global_counter.x[global_counter.sweep_id];             \
+      x50(op; cpu_relax(););                                      \
+      __sync_fetch_and_add(&args->x.count, 50);                   \
+    }                                                             \
+    return NULL;                                                  \
   }
-  while (!relaxed) {
-    atomic_t *target = &(global_counter.x[global_counter.sweep_id].count);
-    x50(__sync_fetch_and_add(target, 1););
-    __sync_fetch_and_add(&args->x.count, 50);
+
+WORKER(xadd, __sync_fetch_and_add(&l->count, 1))
+WORKER(cas, cas_op(l))
+WORKER(xchg, xchg_op(l, args->x.cpu))
+#if defined(__aarch64__)
+WORKER(xadd_llsc, xadd_llsc_op(l))
+#if defined(__ARM_FEATURE_ATOMICS)
+WORKER(xadd_lse, xadd_lse_op(l))
+#endif
+#endif
+WORKER(ticket, ticket_op(l))
+WORKER(mcs, mcs_op(l, &node))
+WORKER(qspin, qspin_op(l, &node))
+
+static const struct primitive {
+  const char *name;
+  void *(*worker)(void *);
+  const char *usage;
+} primitives[] = {
+    {"xadd", xadd_worker, "locked increment (default)"},
+    {"cas", cas_worker, "compare and swap retry loop"},
+    {"xchg", xchg_worker, "exchange"},
+#if defined(__aarch64__)
+    {"xadd-llsc", xadd_llsc_worker, "increment with ldaxr/stlxr"},
+#if defined(__ARM_FEATURE_ATOMICS)
+    {"xadd-lse", xadd_lse_worker, "increment with ldaddal"},
+#endif
+#endif
+    {"ticket", ticket_worker, "ticket lock around an increment"},
+    {"mcs", mcs_worker, "mcs queue lock around an increment"},
+    {"qspin", qspin_worker, "qspinlock style lock around an increment"},
+};
+
+static const struct primitive *primitive = &primitives[0];
+
+// start a worker on each of the first nr_threads cpus and wait for them
+static pthread_t *start_workers(per_thread_t *thread_args, size_t nr_threads) {
+  pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+  size_t u;
+
+  if (threads == NULL) {
+    perror("calloc");
+    exit(1);
   }
-  if (delay_mask & (1u << args->x.cpu)) {
-    sleep(1);
+  relaxed = 0;
+  stop = 0;
+  nr_to_startup = nr_threads + 1;
+  for (u = 0; u < nr_threads; ++u) {
+    thread_args[u].x.count = 0;
+    if (pthread_create(&threads[u], NULL, primitive->worker,
+                       &thread_args[u])) {
+      perror("pthread_create");
+      exit(1);
+    }
   }
-  while (relaxed) {
-    atomic_t *target = &(global_counter.x[global_counter.sweep_id].count);
-    x50(__sync_fetch_and_add(target, 1); cpu_relax(););
-    __sync_fetch_and_add(&args->x.count, 50);
+  wait_for_startup();
+  return threads;
+}
+
+static void stop_workers(pthread_t *threads, size_t nr_threads) {
+  size_t u;
+
+  stop = 1;
+  for (u = 0; u < nr_threads; ++u) {
+    if (pthread_join(threads[u], NULL)) {
+      perror("pthread_join");
+      exit(1);
+    }
   }
-  return NULL;
+  free(threads);
+}
+
+// wait a time slice and collect every thread's ops since the last sample,
+// returns the ns that took
+static int64_t take_sample(per_thread_t *thread_args, size_t nr_threads,
+                           atomic_t *samples, size_t time_slice,
+                           uint64_t *last_stamp) {
+  size_t u;
+
+  usleep(time_slice);
+  for (u = 0; u < nr_threads; ++u) {
+    samples[u] = __sync_lock_test_and_set(&thread_args[u].x.count, 0);
+  }
+  uint64_t stamp = now_nsec();
+  int64_t time_delta = stamp - *last_stamp;
+  *last_stamp = stamp;
+  return time_delta;
+}
+
+// the thread counts of a sweep: powers of two and every cpu
+static size_t next_thread_count(size_t n, size_t nr_cpus) {
+  if (n == nr_cpus) return 0;
+  return 2 * n < nr_cpus ? 2 * n : nr_cpus;
+}
+
+// measure every thread count of the sweep and print one row per count,
+// relaxation and line: the throughput of all threads together, and how
+// evenly the threads shared the ops.
+static void sweep_threads(per_thread_t *thread_args, size_t nr_cpus,
+                          int sweep_max, size_t sample_size, size_t time_slice,
+                          char sep) {
+  atomic_t *samples = calloc(nr_cpus, sizeof(*samples));
+  uint64_t *ops = calloc(nr_cpus, sizeof(*ops));
+  size_t n, u;
+
+  if (samples == NULL || ops == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  if (json_output) {
+    // every row is a record
+  } else if (sep == ',') {
+    printf("threads,relaxed,sweep,mops,ns_per_op,min_max,jain\n");
+  } else {
+    printf(
+        "%s: total Mops/s, avg ns per op of the threads with ops, fewest/most "
+        "ops of a\nthread and jain's fairness index (1 = every thread got the same "
+        "share)\n\n",
+        primitive->name);
+    printf("threads  relaxed  sweep     Mops/s    ns/op  min/max     jain\n");
+  }
+  for (n = 1; n; n = next_thread_count(n, nr_cpus)) {
+    pthread_t *threads = start_workers(thread_args, n);
+    for (relaxed = 0; relaxed < 2; ++relaxed) {
+      for (int sweep = 0; sweep < sweep_max; sweep++) {
+        global_counter.sweep_id = sweep;
+        uint64_t last_stamp = now_nsec();
+        uint64_t total_ns = 0;
+        memset(ops, 0, n * sizeof(*ops));
+        // The first sample is thrown out, like below.
+        for (size_t sample_nr = 0; sample_nr < sample_size + 1; ++sample_nr) {
+          int64_t time_delta =
+              take_sample(thread_args, n, samples, time_slice, &last_stamp);
+          if (sample_nr == 0) continue;
+          total_ns += time_delta;
+          for (u = 0; u < n; ++u) ops[u] += samples[u];
+        }
+
+        double sum = 0., sum_squared = 0., ns_sum = 0.;
+        uint64_t min = ~0ull, max = 0;
+        size_t nr_active = 0;
+        for (u = 0; u < n; ++u) {
+          sum += ops[u];
+          sum_squared += (double)ops[u] * ops[u];
+          // a starved thread has no ns per op, min/max and jain show it
+          if (ops[u]) {
+            ns_sum += total_ns / (double)ops[u];
+            ++nr_active;
+          }
+          min = min < ops[u] ? min : ops[u];
+          max = max > ops[u] ? max : ops[u];
+        }
+        double mops = sum * 1000. / total_ns;
+        double ns_per_op = nr_active ? ns_sum / nr_active : 0.;
+        double min_max = max ? min / (double)max : 0.;
+        double jain = sum_squared ? sum * sum / (n * sum_squared) : 0.;
+        if (json_output) {
+          json_record("fairness", "threads");
+          json_uint("threads", n);
+          json_bool("relaxed", relaxed);
+          json_int("sweep", sweep);
+          json_double("mops", mops);
+          json_double("ns_per_op", ns_per_op);
+          json_double("min_max", min_max);
+          json_double("jain", jain);
+          json_end_record();
+        } else if (sep == ',') {
+          printf("%zu,%d,%d,%.3f,%.1f,%.3f,%.3f\n", n, relaxed, sweep, mops,
+                 ns_per_op, min_max, jain);
+        } else {
+          printf("%7zu  %7d  %5d  %9.3f  %7.1f  %7.3f  %7.3f\n", n, relaxed,
+                 sweep, mops, ns_per_op, min_max, jain);
+        }
+      }
+    }
+    stop_workers(threads, n);
+  }
+  free(samples);
+  free(ops);
 }
 
 int main(int argc, char **argv) {
@@ -104,13 +417,35 @@ int main(int argc, char **argv) {
   size_t time_slice = 500000;
   char sep = ' ';
   size_t sample_size = 6;
+  bool sweep_thread_counts = false;
+  size_t i_prim;
 
   delay_mask = 0;
-  while ((c = getopt(argc, argv, "d:n:s:t:S:")) != -1) {
+
+  timer_init();
+
+  while ((c = getopt(argc, argv, "ad:Jl:n:s:t:S:")) != -1) {
     switch (c) {
+      case 'a':
+        sweep_thread_counts = true;
+        break;
       case 'd':
         delay_mask = strtoul(optarg, 0, 0);
         break;
+      case 'J':
+        json_output = true;
+        break;
+      case 'l':
+        for (i_prim = 0; i_prim < sizeof(primitives) / sizeof(primitives[0]);
+             ++i_prim) {
+          if (strcmp(optarg, primitives[i_prim].name) == 0) break;
+        }
+        if (i_prim == sizeof(primitives) / sizeof(primitives[0])) {
+          fprintf(stderr, "not a recognized primitive: %s\n", optarg);
+          goto usage;
+        }
+        primitive = &primitives[i_prim];
+        break;
       case 'n':
         sample_size =  strtof(optarg, 0);
         break;
@@ -133,12 +468,18 @@ int main(int argc, char **argv) {
     fprintf(
         stderr,
         "usage: %s \n"
+        " [-a]\n"
         " [-d delay_mask]\n"
+        " [-l primitive]\n"
         " [-n sample_nr]\n"
         " [-s sweep_max]\n"
         " [-t time]\n"
+        " [-S separator]\n"
+        " [-J]\n"
         "By default runs one thread on each cpu, use taskset(1) to "
         "restrict operation to fewer cpus/threads.\n"
+        "The optional -a sweeps the number of threads from 1 to every cpu "
+        "and prints\nthe throughput and fairness of each.\n"
         "The optional delay_mask specifies a mask of cpus on which to delay "
         "the startup.\n"
         "The optional sample_nr determines the number of samples taken for "
@@ -146,8 +487,15 @@ int main(int argc, char **argv) {
         "The optional sweep_max causes testing across multiple different "
         "cache lines.\n"
         "The optional time determines how often to poll results (float in "
-        "seconds).\n",
+        "seconds).\n"
+        "-S , prints CSV and -J prints JSON lines, one object per sample.\n"
+        "The primitive is one of:\n",
         argv[0]);
+    for (i_prim = 0; i_prim < sizeof(primitives) / sizeof(primitives[0]);
+         ++i_prim) {
+      fprintf(stderr, "  %-10s %s\n", primitives[i_prim].name,
+              primitives[i_prim].usage);
+    }
     exit(1);
   }
 
@@ -170,7 +518,6 @@ int main(int argc, char **argv) {
   }
 
   per_thread_t *thread_args = calloc(nr_threads, sizeof(*thread_args));
-  nr_to_startup = nr_threads + 1;
   size_t u;
   i = 0;
   for (u = 0; u < nr_threads; ++u) {
@@ -179,37 +526,59 @@ int main(int argc, char **argv) {
     }
     thread_args[u].x.cpu = i;
     ++i;
-    thread_args[u].x.count = 0;
-    pthread_t dummy;
-    if (pthread_create(&dummy, NULL, worker, &thread_args[u])) {
-      perror("pthread_create");
-      exit(1);
-    }
   }
 
-  wait_for_startup();
+  if (json_output) {
+    json_host_record("fairness");
+    json_record("fairness", "config");
+    json_string("primitive", primitive->name);
+    json_array("cpus");
+    for (u = 0; u < nr_threads; ++u) json_int(NULL, thread_args[u].x.cpu);
+    json_end();
+    json_uint("nr_samples", sample_size);
+    json_uint("sample_ns", time_slice * 1000ull);
+    json_uint("sweep_max", sweep_max);
+    json_uint("delay_mask", delay_mask);
+    json_bool("sweep_threads", sweep_thread_counts);
+    json_end_record();
+  }
+
+  if (sweep_thread_counts) {
+    sweep_threads(thread_args, nr_threads, sweep_max, sample_size, time_slice,
+                  sep);
+    return 0;
+  }
+
+  start_workers(thread_args, nr_threads);
 
   atomic_t *samples = calloc(nr_threads, sizeof(*samples));
+  double *thread_ns = calloc(nr_threads, sizeof(*thread_ns));
 
-  printf(
-      "results are avg latency per locked increment in ns, one column per "
-      "thread\n");
   char *fmt, *tail = "";
-  if (sep == ',') {
+  if (json_output) {
+    // the config record above
+  } else if (sep == ',') {
     printf("relaxed,sweep");
     fmt = ",cpu-%u";
     tail = ",avg,stdev,min,max";
   } else {
+    printf(
+        "results are avg latency per %s in ns, one column per thread\n",
+        primitive == &primitives[0] ? "locked increment" : primitive->usage);
     fmt = "%6u  ";
     printf("cpu:");
   }
-  for (u = 0; u < nr_threads; ++u) {
-    printf(fmt, thread_args[u].x.cpu);
+  if (!json_output) {
+    for (u = 0; u < nr_threads; ++u) {
+      printf(fmt, thread_args[u].x.cpu);
+    }
+    printf("%s\n", tail);
   }
-  printf("%s\n", tail);
   global_counter.sweep_id = 0;
   for (relaxed = 0; relaxed < 2; ++relaxed) {
-    if (sep != ',') printf(relaxed ? "relaxed:\n" : "unrelaxed:\n");
+    if (sep != ',' && !json_output) {
+      printf(relaxed ? "relaxed:\n" : "unrelaxed:\n");
+    }
     for (int sweep = 0; sweep < sweep_max; sweep++) {
       global_counter.sweep_id = sweep;
       uint64_t last_stamp = now_nsec();
@@ -218,17 +587,36 @@ int main(int argc, char **argv) {
       // the requested number of samples.
       for (sample_nr = 0; sample_nr < sample_size + 1; ++sample_nr) {
         double min = 1.0 / 0., max = 0.;
-        usleep(time_slice);
-        for (u = 0; u < nr_threads; ++u) {
-          samples[u] = __sync_lock_test_and_set(&thread_args[u].x.count, 0);
-        }
-        uint64_t stamp = now_nsec();
-        int64_t time_delta = stamp - last_stamp;
-        last_stamp = stamp;
+        int64_t time_delta = take_sample(thread_args, nr_threads, samples,
+                                         time_slice, &last_stamp);
 
         // throw away the first sample to avoid race issues at startup / mode
         // switch
         if (sample_nr == 0) continue;
+        double sum = 0.;
+        double sum_squared = 0.;
+        for (u = 0; u < nr_threads; ++u) {
+          double s = time_delta / (double)samples[u];
+          thread_ns[u] = s;
+          min = min < s ? min : s;
+          max = max > s ? max : s;
+          sum += s;
+          sum_squared += s * s;
+        }
+        double stdev =
+            sqrt((sum_squared - sum * sum / nr_threads) / (nr_threads - 1));
+        if (json_output) {
+          json_record("fairness", "sample");
+          json_bool("relaxed", relaxed);
+          json_int("sweep", sweep);
+          json_doubles("thread_ns", thread_ns, nr_threads);
+          json_double("avg", sum / nr_threads);
+          json_double("stdev", stdev);
+          json_double("min", min);
+          json_double("max", max);
+          json_end_record();
+          continue;
+        }
         if (sep == ',')
           printf("%d,%p", relaxed,
                  &(global_counter.x[global_counter.sweep_id].count));
@@ -239,24 +627,15 @@ int main(int argc, char **argv) {
           fmt = "  %6.1f";
           printf("  ");
         }
-        double sum = 0.;
-        double sum_squared = 0.;
         for (u = 0; u < nr_threads; ++u) {
-          double s = time_delta / (double)samples[u];
-          printf(fmt, s);
-          min = min < s ? min : s;
-          max = max > s ? max : s;
-          sum += s;
-          sum_squared += s * s;
+          printf(fmt, thread_ns[u]);
         }
         if (sep == ',') {
           fmt = ",%.1f,%.1f,%.1f,%.1f\n";
         } else {
           fmt = " : avg %6.1f  sdev %6.1f  min %6.1f  max %6.1f\n";
         }
-        printf(fmt, sum / nr_threads,
-               sqrt((sum_squared - sum * sum / nr_threads) / (nr_threads - 1)),
-               min, max);
+        printf(fmt, sum / nr_threads, stdev, min, max);
         fflush(stdout);
       }
     }
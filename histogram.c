@@ -0,0 +1,77 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "histogram.h"
+
+#include <stdlib.h>
+
+#include "json_out.h"
+
+struct histogram *histogram_alloc(void) {
+  struct histogram *h = calloc(1, sizeof(*h));
+
+  if (h == NULL) {
+    fprintf(stderr, "Could not allocate a histogram\n");
+    exit(1);
+  }
+  return h;
+}
+
+// smallest value which falls in bucket b
+static uint64_t bucket_low(unsigned b) {
+  if (b < HIST_SUB_BUCKETS) return b;
+  unsigned e = (b >> HIST_SUB_BITS) + HIST_SUB_BITS - 1;
+  return ((uint64_t)(HIST_SUB_BUCKETS + (b & (HIST_SUB_BUCKETS - 1))))
+         << (e - HIST_SUB_BITS);
+}
+
+double histogram_percentile(const struct histogram *h, double pct) {
+  uint64_t rank = h->nr * pct / 100.;
+  uint64_t seen = 0;
+  unsigned b;
+
+  if (h->nr == 0) return 0.;
+  if (rank >= h->nr) return h->max;
+  for (b = 0; b < HIST_NR_BUCKETS; ++b) {
+    seen += h->count[b];
+    if (seen > rank) break;
+  }
+  // report the middle of the bucket, but never more than the real maximum
+  double mid = (bucket_low(b) + bucket_low(b + 1)) / 2.;
+  return mid < h->max ? mid : h->max;
+}
+
+static const double pcts[] = {50., 90., 99., 99.9};
+static const char *names[] = {"p50", "p90", "p99", "p99.9"};
+
+void histogram_print_percentiles(FILE *f, const struct histogram *h,
+                                 double scale) {
+  unsigned i;
+
+  for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); ++i) {
+    double v = histogram_percentile(h, pcts[i]) / scale;
+    fprintf(f, " %s=%.*f", names[i], v < 100. ? 3 : 1, v);
+  }
+  fprintf(f, " max=%.*f", h->max / scale < 100. ? 3 : 1, h->max / scale);
+}
+
+void histogram_json(const char *key, const struct histogram *h, double scale) {
+  unsigned i;
+
+  json_object(key);
+  for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); ++i) {
+    json_double(names[i], histogram_percentile(h, pcts[i]) / scale);
+  }
+  json_double("max", h->max / scale);
+  json_end();
+}
@@ -0,0 +1,59 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HISTOGRAM_H_INCLUDED
+#define HISTOGRAM_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+// A log-linear histogram: every power of two is split into
+// 1 << HIST_SUB_BITS equal buckets, so a recorded value is off by at most
+// 1 / (1 << HIST_SUB_BITS) of itself.  Values are unitless; the chases record
+// picoseconds per load.
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1u << HIST_SUB_BITS)
+#define HIST_NR_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS)
+
+struct histogram {
+  uint64_t count[HIST_NR_BUCKETS];
+  uint64_t nr;   // number of values recorded
+  uint64_t max;  // exact largest value
+};
+
+static inline unsigned histogram_bucket(uint64_t v) {
+  if (v < HIST_SUB_BUCKETS) return v;
+  unsigned e = 63 - __builtin_clzll(v);
+  return ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) +
+         ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+static inline void histogram_add(struct histogram *h, uint64_t v) {
+  ++h->count[histogram_bucket(v)];
+  ++h->nr;
+  if (v > h->max) h->max = v;
+}
+
+struct histogram *histogram_alloc(void);
+
+// the value below which pct percent of the recorded values fall
+double histogram_percentile(const struct histogram *h, double pct);
+
+// print "p50 .. p90 .. p99 .. p99.9 .. max .." with values divided by scale
+void histogram_print_percentiles(FILE *f, const struct histogram *h,
+                                 double scale);
+
+// the same percentiles as a json object {"p50": .., "max": ..}
+void histogram_json(const char *key, const struct histogram *h, double scale);
+
+#endif
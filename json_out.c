@@ -0,0 +1,187 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "json_out.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/utsname.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "timer.h"
+#include "topology.h"
+
+#define MAX_JSON_DEPTH 8
+
+bool json_output;
+
+// the closing bracket and whether a value has been written yet, for every
+// open object or array
+static char json_close[MAX_JSON_DEPTH];
+static bool json_first[MAX_JSON_DEPTH];
+static int json_depth = -1;
+
+static void json_quoted(const char *s) {
+  putchar('"');
+  for (; *s; ++s) {
+    if (*s == '"' || *s == '\\') {
+      printf("\\%c", *s);
+    } else if ((unsigned char)*s < 0x20) {
+      printf("\\u%04x", (unsigned char)*s);
+    } else {
+      putchar(*s);
+    }
+  }
+  putchar('"');
+}
+
+static void json_key(const char *key) {
+  if (!json_first[json_depth]) putchar(',');
+  json_first[json_depth] = false;
+  if (key) {
+    json_quoted(key);
+    putchar(':');
+  }
+}
+
+static void json_open(const char *key, char open, char close) {
+  if (json_depth >= 0) json_key(key);
+  if (json_depth + 1 == MAX_JSON_DEPTH) {
+    fprintf(stderr, "json output nested too deeply\n");
+    exit(1);
+  }
+  ++json_depth;
+  json_close[json_depth] = close;
+  json_first[json_depth] = true;
+  putchar(open);
+}
+
+void json_object(const char *key) { json_open(key, '{', '}'); }
+
+void json_array(const char *key) { json_open(key, '[', ']'); }
+
+void json_end(void) {
+  putchar(json_close[json_depth]);
+  --json_depth;
+}
+
+void json_record(const char *tool, const char *type) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  json_object(NULL);
+  json_string("tool", tool);
+  json_string("type", type);
+  json_key("timestamp");
+  printf("%lld.%06ld", (long long)ts.tv_sec, ts.tv_nsec / 1000);
+}
+
+void json_end_record(void) {
+  while (json_depth >= 0) json_end();
+  putchar('\n');
+  fflush(stdout);
+}
+
+void json_string(const char *key, const char *value) {
+  json_key(key);
+  json_quoted(value);
+}
+
+void json_uint(const char *key, uint64_t value) {
+  json_key(key);
+  printf("%" PRIu64, value);
+}
+
+void json_int(const char *key, int64_t value) {
+  json_key(key);
+  printf("%" PRId64, value);
+}
+
+void json_double(const char *key, double value) {
+  json_key(key);
+  if (isfinite(value)) {
+    printf("%.10g", value);
+  } else {
+    printf("null");
+  }
+}
+
+void json_bool(const char *key, bool value) {
+  json_key(key);
+  printf(value ? "true" : "false");
+}
+
+void json_doubles(const char *key, const double *values, size_t n) {
+  size_t i;
+
+  json_array(key);
+  for (i = 0; i < n; ++i) json_double(NULL, values[i]);
+  json_end();
+}
+
+static void json_nodes(const char *key, const char *list) {
+  int nodes[MAX_CPUS];
+  size_t i, nr = get_node_list(list, nodes, MAX_CPUS);
+
+  json_array(key);
+  for (i = 0; i < nr; ++i) json_int(NULL, nodes[i]);
+  json_end();
+}
+
+void json_host_record(const char *tool) {
+  struct utsname u;
+  struct cpu_cache caches[MAX_CPU_CACHES];
+  cpu_set_t cpus;
+  int first_cpu = -1;
+  size_t i, nr_caches;
+
+  json_record(tool, "host");
+  if (uname(&u) == 0) {
+    json_string("hostname", u.nodename);
+    json_string("kernel", u.release);
+    json_string("machine", u.machine);
+  }
+  json_int("online_cpus", sysconf(_SC_NPROCESSORS_ONLN));
+  json_array("allowed_cpus");
+  if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+    for (i = 0; i < CPU_SETSIZE; ++i) {
+      if (!CPU_ISSET(i, &cpus)) continue;
+      if (first_cpu < 0) first_cpu = i;
+      json_uint(NULL, i);
+    }
+  }
+  json_end();
+  json_nodes("cpu_nodes", "has_cpu");
+  json_nodes("memory_nodes", "has_memory");
+  json_int("page_size", sysconf(_SC_PAGESIZE));
+  json_string("timer", timer_source());
+  if (timer_ghz() > 0.) json_double("timer_ghz", timer_ghz());
+  // the caches of the first allowed cpu
+  nr_caches = get_cpu_caches(first_cpu < 0 ? 0 : first_cpu, caches,
+                             MAX_CPU_CACHES);
+  json_array("caches");
+  for (i = 0; i < nr_caches; ++i) {
+    json_object(NULL);
+    json_string("name", caches[i].name);
+    json_uint("level", caches[i].level);
+    json_uint("size", caches[i].size);
+    json_end();
+  }
+  json_end();
+  json_end_record();
+}
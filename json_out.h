@@ -0,0 +1,43 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef JSON_OUT_H_INCLUDED
+#define JSON_OUT_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// JSON lines output (-J) shared by all the tools.  every record is one
+// object on one line of stdout, and starts with the tool, the record type
+// ("host", "config", "sample", "result", ...) and a unix timestamp.
+extern bool json_output;
+
+void json_record(const char *tool, const char *type);
+void json_end_record(void);
+
+// values take a key inside objects and NULL inside arrays.
+void json_object(const char *key);
+void json_array(const char *key);
+void json_end(void);  // closes the innermost object or array
+void json_string(const char *key, const char *value);
+void json_uint(const char *key, uint64_t value);
+void json_int(const char *key, int64_t value);
+void json_double(const char *key, double value);  // null unless finite
+void json_bool(const char *key, bool value);
+void json_doubles(const char *key, const double *values, size_t n);
+
+// a "host" record: kernel, allowed cpus, numa nodes and caches.
+void json_host_record(const char *tool);
+
+#endif
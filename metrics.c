@@ -0,0 +1,204 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "timer.h"
+
+#define METRICS_BACKLOG 16
+#define METRICS_REQUEST_MS 100  // for a client to send its request
+
+static int listen_failed(const char *addr, struct metrics_server *server) {
+  fprintf(stderr, "Error: could not listen on %s: %s\n", addr,
+          strerror(errno));
+  if (server->fd >= 0) close(server->fd);
+  server->fd = -1;
+  return -1;
+}
+
+// a socket file is stale when connecting to it is refused, a running probe
+// keeps it
+static bool socket_is_stale(const char *addr, const struct sockaddr_un *un) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int err = 0;
+
+  if (fd < 0 || connect(fd, (const struct sockaddr *)un, sizeof(*un))) {
+    err = errno;
+  }
+  if (fd >= 0) close(fd);
+  if (err == ECONNREFUSED) return true;
+  if (err) {
+    fprintf(stderr, "Error: could not connect to %s: %s\n", addr,
+            strerror(err));
+  } else {
+    fprintf(stderr, "Error: %s is in use by a running probe\n", addr);
+  }
+  return false;
+}
+
+static int listen_unix(const char *addr, struct metrics_server *server) {
+  struct sockaddr_un un = {.sun_family = AF_UNIX};
+  struct stat st;
+
+  if (strlen(addr) >= sizeof(un.sun_path)) {
+    fprintf(stderr, "Error: socket path too long: %s\n", addr);
+    return -1;
+  }
+  strcpy(un.sun_path, addr);
+  // only ever replace a socket nobody listens on, e.g. one left by an
+  // earlier run
+  bool exists = lstat(addr, &st) == 0;
+  if (exists && !S_ISSOCK(st.st_mode)) {
+    fprintf(stderr, "Error: %s exists and is not a socket\n", addr);
+    return -1;
+  }
+  if (exists && !socket_is_stale(addr, &un)) return -1;
+  server->http = false;
+  server->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (server->fd < 0) return listen_failed(addr, server);
+  if (exists) unlink(addr);
+  if (bind(server->fd, (struct sockaddr *)&un, sizeof(un)) ||
+      listen(server->fd, METRICS_BACKLOG)) {
+    return listen_failed(addr, server);
+  }
+  return 0;
+}
+
+static int bind_tcp(const struct sockaddr *sa, socklen_t len,
+                    struct metrics_server *server) {
+  int one = 1, err;
+
+  server->fd = socket(sa->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (server->fd < 0) return -1;
+  if (setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+      bind(server->fd, sa, len) || listen(server->fd, METRICS_BACKLOG)) {
+    err = errno;
+    close(server->fd);
+    server->fd = -1;
+    errno = err;
+    return -1;
+  }
+  return 0;
+}
+
+// "PORT" listens on every address, ipv6 (which takes ipv4 too) if the host
+// has it, otherwise ipv4.  "ADDR:PORT" or "[ADDR]:PORT" on one address.
+static int listen_tcp(const char *addr, struct metrics_server *server) {
+  struct sockaddr_in6 in6 = {.sin6_family = AF_INET6,
+                             .sin6_addr = IN6ADDR_ANY_INIT};
+  struct sockaddr_in in = {.sin_family = AF_INET,
+                           .sin_addr.s_addr = htonl(INADDR_ANY)};
+  const char *colon = strrchr(addr, ':');
+  const char *port_str = colon ? colon + 1 : addr;
+  const char *host = addr;
+  size_t host_len = colon ? (size_t)(colon - addr) : 0;
+  char host_buf[INET6_ADDRSTRLEN];
+  char *end;
+  bool v6 = true, v4 = true;
+
+  if (host_len >= 2 && host[0] == '[' && host[host_len - 1] == ']') {
+    ++host;
+    host_len -= 2;
+  }
+  unsigned long port = strtoul(port_str, &end, 10);
+  bool ok = !*end && end != port_str && port > 0 && port <= 65535;
+  if (ok && colon) {
+    ok = host_len > 0 && host_len < sizeof(host_buf);
+    if (ok) {
+      memcpy(host_buf, host, host_len);
+      host_buf[host_len] = 0;
+      v6 = inet_pton(AF_INET6, host_buf, &in6.sin6_addr) == 1;
+      v4 = !v6 && inet_pton(AF_INET, host_buf, &in.sin_addr) == 1;
+      ok = v6 || v4;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: not a [ADDR:]PORT or a socket path: %s\n", addr);
+    return -1;
+  }
+  in6.sin6_port = in.sin_port = htons(port);
+  server->http = true;
+  if (v6 && bind_tcp((struct sockaddr *)&in6, sizeof(in6), server) == 0) {
+    return 0;
+  }
+  if (v4 && bind_tcp((struct sockaddr *)&in, sizeof(in), server) == 0) {
+    return 0;
+  }
+  return listen_failed(addr, server);
+}
+
+int metrics_listen(const char *addr, struct metrics_server *server) {
+  server->fd = -1;
+  return addr[0] == '/' ? listen_unix(addr, server) : listen_tcp(addr, server);
+}
+
+static void write_all(int fd, const char *buf, size_t len) {
+  ssize_t n;
+
+  while (len > 0) {
+    n = send(fd, buf, len, MSG_NOSIGNAL);
+    if (n <= 0) return;  // the client went away, nothing to do about it
+    buf += n;
+    len -= n;
+  }
+}
+
+// one connection: read (and ignore) the request, then send the metrics
+static void answer(const struct metrics_server *server, int fd,
+                   const char *text) {
+  static const char header[] =
+      "HTTP/1.0 200 OK\r\n"
+      "Content-Type: text/plain; version=0.0.4\r\n"
+      "Connection: close\r\n"
+      "\r\n";
+  struct pollfd p = {.fd = fd, .events = POLLIN};
+  char request[1024];
+
+  if (server->http) {
+    if (poll(&p, 1, METRICS_REQUEST_MS) <= 0 ||
+        recv(fd, request, sizeof(request), MSG_DONTWAIT) < 0) {
+      return;
+    }
+    write_all(fd, header, sizeof(header) - 1);
+  }
+  write_all(fd, text, strlen(text));
+}
+
+void metrics_serve(struct metrics_server *server, const char *text,
+                   uint64_t until_ns) {
+  struct pollfd p = {.fd = server->fd, .events = POLLIN};
+  uint64_t now;
+  int fd;
+
+  while ((now = now_nsec()) < until_ns) {
+    int ms = (until_ns - now + 999999) / 1000000;
+    if (poll(&p, 1, ms) <= 0) continue;
+    fd = accept4(server->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    answer(server, fd, text);
+    close(fd);
+  }
+}
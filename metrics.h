@@ -0,0 +1,38 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A minimal endpoint answering every connection with the latest metrics in
+// the Prometheus text format: over http on a tcp port, or as the bare text
+// on a unix socket (e.g. for socat or a node exporter textfile script).
+
+struct metrics_server {
+  int fd;
+  bool http;
+};
+
+// listen on "PORT" (every address), "ADDR:PORT" or on a unix socket "/path",
+// replacing a socket file nobody listens on any more.  returns -1 after
+// printing why it could not.
+int metrics_listen(const char *addr, struct metrics_server *server);
+
+// answer connections with text until now_nsec() reaches until_ns.
+void metrics_serve(struct metrics_server *server, const char *text,
+                   uint64_t until_ns);
+
+#endif
@@ -16,21 +16,30 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <linux/mempolicy.h>
+#include <math.h>
 #include <pthread.h>
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "arena.h"
+#include "chase_image.h"
+#include "chase_jit.h"
 #include "br_asm.h"
 #include "cpu_util.h"
 #include "expand.h"
+#include "histogram.h"
+#include "json_out.h"
+#include "perf_counters.h"
 #include "permutation.h"
 #include "timer.h"
+#include "topology.h"
 #include "util.h"
 
 // The total memory, stride, and TLB locality have been chosen carefully for
@@ -55,9 +64,27 @@
 #define DEF_NR_THREADS ((size_t)1)
 #define DEF_CACHE_FLUSH ((size_t)64 * 1024 * 1024)
 #define DEF_OFFSET ((size_t)0)
+#define DEF_SEED ((uint64_t)1)
+#define DEF_NR_CHASE_WORKERS ((size_t)1)
 #define DELAY_USECS 500000
 #define NSECS_PER_USEC 1000
 #define NSECS_PER_MSEC (1000 * 1000)
+#define NSECS_PER_SEC (1000 * 1000 * 1000)
+
+// during a working set sweep (-m low:high:step) a size is reported as having
+// exceeded some capacity once its latency is SWEEP_JUMP times the latency of
+// the last plateau.  a new plateau starts once a step changes the latency by
+// less than SWEEP_FLAT.
+#define SWEEP_JUMP 1.15
+#define SWEEP_FLAT 1.05
+
+// an mlp sweep (-c mlp:sweep) stops once MLP_FLAT_STEPS more chains in a
+// row didn't raise the bandwidth by MLP_GROWTH, and reports the fewest
+// chains reaching MLP_SATURATED of the best bandwidth.
+#define MLP_GROWTH 1.03
+#define MLP_FLAT_STEPS 3
+#define MLP_SATURATED 0.95
+#define MLP_LINE 64  // bytes of bandwidth per load
 
 int verbosity;
 int print_timestamp;
@@ -66,8 +93,10 @@ uint16_t mbind_weights[MAX_MEM_NODES];
 
 #ifdef __i386__
 #define MAX_PARALLEL (6)  // maximum number of chases in parallel
+#define MAX_MLP (6)       // maximum of the mlp:N chases
 #else
 #define MAX_PARALLEL (10)
+#define MAX_MLP (48)
 #endif
 
 // forward declare
@@ -79,30 +108,71 @@ typedef union {
   struct {
     unsigned thread_num;        // which thread is this
     unsigned count;             // count of number of iterations
-    void *cycle[MAX_PARALLEL];  // initial address for the chases
+    int stop;                   // a sweep is done with this chase
+    void *cycle[MAX_MLP];  // initial address for the chases
     const char *extra_args;
     int dummy;  // useful for confusing the compiler
 
     const struct generate_chase_common_args *genchase_args;
     size_t nr_threads;
     const chase_t *chase;
+    struct histogram *hist;  // per block latencies, NULL unless -P
     void *flush_arena;
     size_t cache_flush_size;
     bool use_longer_chase;
     int branch_chunk_size;
+    pid_t tid;  // for perf_event_open
   } x;
 } per_thread_t;
 
 int always_zero;
 
+// count the loads of a block and keep going until a sweep stops the chase.
+// stop shares the line of count, so polling it costs no extra miss.
+static inline int chase_continue(per_thread_t *t, unsigned loads) {
+  __sync_add_and_fetch(&t->x.count, loads);
+  return !__atomic_load_n(&t->x.stop, __ATOMIC_ACQUIRE);
+}
+
 static void chase_simple(per_thread_t *t) {
   void *p = t->x.cycle[0];
 
   do {
     x200(p = *(void **)p;)
-  } while (__sync_add_and_fetch(&t->x.count, 200));
+  } while (chase_continue(t, 200));
+
+  // only reached when a sweep stops the chase
+  t->x.dummy = (uintptr_t)p;
+}
+
+// histogram versions of the chases take a timestamp after every block of
+// loads and record the block's time per load.  nothing in the chase depends
+// on the timer, so the timestamps stay off the dependency chain.  a block
+// may still be recorded after main clears hist_recording, so main stops the
+// threads before it reads the histograms.
+static int hist_recording;
+
+static inline void record_block(per_thread_t *t, uint64_t *last,
+                                unsigned nr_loads) {
+  uint64_t now = now_nsec();
+  if (__atomic_load_n(&hist_recording, __ATOMIC_ACQUIRE)) {
+    histogram_add(t->x.hist, (now - *last) * 1000 / nr_loads);  // ps
+  }
+  *last = now;
+}
+
+static void chase_simple_hist(per_thread_t *t) {
+  void *p = t->x.cycle[0];
+  uint64_t last = now_nsec();
+
+  do {
+    x200(p = *(void **)p;)
+    // don't let the compiler take the timestamp before the last load
+    asm volatile("" ::"r"(p));
+    record_block(t, &last, 200);
+  } while (chase_continue(t, 200));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when a sweep stops the chase
   t->x.dummy = (uintptr_t)p;
 }
 
@@ -110,6 +180,7 @@ static void chase_simple(per_thread_t *t) {
 
 #define declare(i) void *p##i = start[i];
 #define cleanup(i) tmp += (uintptr_t)p##i;
+#define use(i) asm volatile("" ::"r"(p##i));
 #if MAX_PARALLEL == 6
 #define parallel(foo) foo(0) foo(1) foo(2) foo(3) foo(4) foo(5)
 #else
@@ -117,15 +188,29 @@ static void chase_simple(per_thread_t *t) {
   foo(0) foo(1) foo(2) foo(3) foo(4) foo(5) foo(6) foo(7) foo(8) foo(9)
 #endif
 
-#define template(n, expand, inner)                        \
-  static void chase_parallel##n(per_thread_t *t) {        \
-    void **start = t->x.cycle;                            \
-    parallel(declare) do { x##expand(inner) }             \
-    while (__sync_add_and_fetch(&t->x.count, n * expand)) \
-      ;                                                   \
-                                                          \
-    uintptr_t tmp = 0;                                    \
-    parallel(cleanup) t->x.dummy = tmp;                   \
+#define template(n, expand, inner)                           \
+  static void chase_parallel##n(per_thread_t *t) {           \
+    void **start = t->x.cycle;                               \
+    parallel(declare) do { x##expand(inner) }                \
+    while (chase_continue(t, n * expand))                    \
+      ;                                                      \
+                                                             \
+    uintptr_t tmp = 0;                                       \
+    parallel(cleanup) t->x.dummy = tmp;                      \
+  }                                                          \
+                                                             \
+  static void chase_parallel##n##_hist(per_thread_t *t) {    \
+    void **start = t->x.cycle;                               \
+    uint64_t last = now_nsec();                              \
+    parallel(declare) do {                                   \
+      x##expand(inner) parallel(use)                         \
+      record_block(t, &last, n * expand);                    \
+    }                                                        \
+    while (chase_continue(t, n * expand))                    \
+      ;                                                      \
+                                                             \
+    uintptr_t tmp = 0;                                       \
+    parallel(cleanup) t->x.dummy = tmp;                      \
   }
 
 #if defined(__x86_64__) || defined(__i386__)
@@ -144,11 +229,71 @@ template(8, 24, D(0) D(1) D(2) D(3) D(4) D(5) D(6) D(7));
 template(9, 22, D(0) D(1) D(2) D(3) D(4) D(5) D(6) D(7) D(8));
 template(10, 20, D(0) D(1) D(2) D(3) D(4) D(5) D(6) D(7) D(8) D(9));
 #endif
+
+// wider chases keep their chains in an array.  the j loop is unrolled so
+// the compiler can keep as many of them in registers as it has, the rest
+// are spilled to the stack (l1 hits, off the chains' dependencies).
+#define wide_template(n)                                              \
+  static void chase_parallel##n(per_thread_t *t) {                    \
+    enum { expand = (200 + n - 1) / n };                              \
+    void *p[n];                                                       \
+    memcpy(p, t->x.cycle, sizeof(p));                                 \
+    do {                                                              \
+      for (unsigned e = 0; e < expand; ++e) {                         \
+        _Pragma("GCC unroll 64") for (unsigned j = 0; j < n; ++j) {   \
+          D(p[j])                                                     \
+        }                                                             \
+      }                                                               \
+    } while (chase_continue(t, n * expand));                          \
+                                                                      \
+    uintptr_t tmp = 0;                                                \
+    for (unsigned j = 0; j < n; ++j) tmp += (uintptr_t)p[j];          \
+    t->x.dummy = tmp;                                                 \
+  }
+#undef D
+#if defined(__x86_64__) || defined(__i386__)
+#define D(p) asm volatile("mov (%1),%0" : "=r"(p) : "r"(p));
+#else
+#define D(p) p = *(void **)p;
+#endif
+#if MAX_MLP > MAX_PARALLEL
+wide_template(11) wide_template(12) wide_template(13) wide_template(14)
+wide_template(15) wide_template(16) wide_template(17) wide_template(18)
+wide_template(19) wide_template(20) wide_template(21) wide_template(22)
+wide_template(23) wide_template(24) wide_template(25) wide_template(26)
+wide_template(27) wide_template(28) wide_template(29) wide_template(30)
+wide_template(31) wide_template(32) wide_template(33) wide_template(34)
+wide_template(35) wide_template(36) wide_template(37) wide_template(38)
+wide_template(39) wide_template(40) wide_template(41) wide_template(42)
+wide_template(43) wide_template(44) wide_template(45) wide_template(46)
+wide_template(47) wide_template(48)
+#endif
+#undef wide_template
 #undef D
 #undef parallel
+#undef use
 #undef cleanup
 #undef declare
 
+// the chase with n independent chains per thread, for mlp:N
+static void (*const mlp_fns[MAX_MLP + 1])(per_thread_t *t) = {
+    NULL, chase_simple, chase_parallel2, chase_parallel3, chase_parallel4,
+    chase_parallel5, chase_parallel6,
+#if MAX_MLP > 6
+    chase_parallel7, chase_parallel8, chase_parallel9, chase_parallel10,
+    chase_parallel11, chase_parallel12, chase_parallel13, chase_parallel14,
+    chase_parallel15, chase_parallel16, chase_parallel17, chase_parallel18,
+    chase_parallel19, chase_parallel20, chase_parallel21, chase_parallel22,
+    chase_parallel23, chase_parallel24, chase_parallel25, chase_parallel26,
+    chase_parallel27, chase_parallel28, chase_parallel29, chase_parallel30,
+    chase_parallel31, chase_parallel32, chase_parallel33, chase_parallel34,
+    chase_parallel35, chase_parallel36, chase_parallel37, chase_parallel38,
+    chase_parallel39, chase_parallel40, chase_parallel41, chase_parallel42,
+    chase_parallel43, chase_parallel44, chase_parallel45, chase_parallel46,
+    chase_parallel47, chase_parallel48,
+#endif
+};
+
 static void chase_work(per_thread_t *t) {
   void *p = t->x.cycle[0];
   size_t extra_work = strtoul(t->x.extra_args, 0, 0);
@@ -163,9 +308,9 @@ static void chase_work(per_thread_t *t) {
   do {
     x25(work += (uintptr_t)p; p = *(void **)p;
         for (i = 0; i < extra_work; ++i) { work ^= i; })
-  } while (__sync_add_and_fetch(&t->x.count, 25));
+  } while (chase_continue(t, 25));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when a sweep stops the chase
   t->x.cycle[0] = p;
   t->x.dummy = work;
 }
@@ -180,9 +325,71 @@ static void chase_incr(per_thread_t *t) {
 
   do {
     x50(++p->incme; p = *(void **)p;)
-  } while (__sync_add_and_fetch(&t->x.count, 50));
+  } while (chase_continue(t, 50));
+
+  // only reached when a sweep stops the chase
+  t->x.cycle[0] = p;
+}
+
+// every deref is an atomic add of 0, so the next pointer isn't known until
+// the line is owned: the latency of a read for ownership.  with several
+// threads and a 64 byte stride the threads share every line, so each hop
+// takes a line last written by another core.
+static void chase_rfo(per_thread_t *t) {
+  void *p = t->x.cycle[0];
+
+  do {
+    x100(p = (void *)__sync_fetch_and_add((uintptr_t *)p, 0);)
+  } while (chase_continue(t, 100));
+
+  // only reached when a sweep stops the chase
+  t->x.cycle[0] = p;
+}
+
+// a store to a second line after each deref.  the stores don't delay the
+// chase until the store buffer fills with misses, then the chase runs at
+// the rate lines can be owned and written.
+static void chase_store(per_thread_t *t) {
+  struct store_struct *p = t->x.cycle[0];
+
+  do {
+    x50(p->stored = (uintptr_t)p; p = p->next;)
+  } while (chase_continue(t, 50));
+
+  // only reached when a sweep stops the chase
+  t->x.cycle[0] = p;
+}
+
+struct dirty_struct {
+  struct dirty_struct *next;
+  uintptr_t dirty;
+};
+
+// the word to write after visiting p: its own line for the lines picked by
+// a hash of their address (the same ones every lap), otherwise a scratch
+// word.  selected without a branch.
+static inline uintptr_t *dirty_target(struct dirty_struct *p, uint64_t limit,
+                                      uintptr_t *scratch) {
+  uint32_t h = ((uintptr_t)p / CACHELINE_SIZE) * 2654435761u;
+  uintptr_t sel = -(uintptr_t)(h < limit);
+
+  return (uintptr_t *)(((uintptr_t)&p->dirty & sel) |
+                       ((uintptr_t)scratch & ~sel));
+}
+
+// write N% of the lines after their deref and leave the rest clean, so
+// evicting them costs a writeback.
+static void chase_dirty(per_thread_t *t) {
+  struct dirty_struct *p = t->x.cycle[0];
+  uint64_t limit =
+      strtoul(t->x.extra_args, 0, 0) * ((uint64_t)1 << 32) / 100;
+  uintptr_t scratch[1];
+
+  do {
+    x50(*dirty_target(p, limit, scratch) = (uintptr_t)p; p = p->next;)
+  } while (chase_continue(t, 50));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when a sweep stops the chase
   t->x.cycle[0] = p;
 }
 
@@ -193,12 +400,20 @@ static void chase_branch(per_thread_t *t) {
 
   do {
     fp = (fptr)(fp)();
-  } while (__sync_add_and_fetch(&t->x.count, t->x.branch_chunk_size));
+  } while (chase_continue(t, t->x.branch_chunk_size));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when a sweep stops the chase
   t->x.dummy = (uintptr_t)p;
 }
 
+// -c jit:..., generated once for all the threads
+static jit_chase_fn jit_chase_loop;
+static unsigned jit_chase_loads;  // added to the count by every pass
+
+static void chase_jit(per_thread_t *t) {
+  jit_chase_loop(t->x.cycle, &t->x.count);
+}
+
 #if defined(__x86_64__) || defined(__i386__)
 #define chase_prefetch(type)                                               \
   static void chase_prefetch##type(per_thread_t *t) {                      \
@@ -207,9 +422,9 @@ static void chase_branch(per_thread_t *t) {
     do {                                                                   \
       x100(asm volatile("prefetch" #type " %0" ::"m"(*(void **)p));        \
            p = *(void **)p;)                                               \
-    } while (__sync_add_and_fetch(&t->x.count, 100));                      \
+    } while (chase_continue(t, 100));                                      \
                                                                            \
-    /* we never actually reach here, but the compiler doesn't know that */ \
+    /* only reached when a sweep stops the chase */                        \
     t->x.cycle[0] = p;                                                     \
   }
 chase_prefetch(t0);
@@ -234,7 +449,7 @@ static void chase_movdqa(per_thread_t *t) {
                       "\n     movq %%xmm0,%%rax"
                       : "=a"(p)
                       : "0"(p));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
   t->x.cycle[0] = p;
 }
 
@@ -264,7 +479,7 @@ static void chase_movntdqa(per_thread_t *t) {
 #endif
              : "=a"(p)
              : "0"(p));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
   t->x.cycle[0] = p;
 }
 
@@ -280,7 +495,7 @@ static void chase_critword2(per_thread_t *t) {
          asm volatile("mov (%1),%0"
                       : "=r"(q)
                       : "r"(q));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
 
   t->x.cycle[0] = (void *)((uintptr_t)p + (uintptr_t)q);
 }
@@ -288,6 +503,7 @@ static void chase_critword2(per_thread_t *t) {
 
 struct chase_t {
   void (*fn)(per_thread_t *t);
+  void (*hist_fn)(per_thread_t *t);  // histogram version (-P), if any
   size_t base_object_size;
   const char *name;
   const char *usage1;
@@ -299,6 +515,7 @@ static const chase_t chases[] = {
     // the default must be first
     {
         .fn = chase_simple,
+        .hist_fn = chase_simple_hist,
         .base_object_size = sizeof(void *),
         .name = "simple",
         .usage1 = "simple",
@@ -324,6 +541,35 @@ static const chase_t chases[] = {
         .requires_arg = 0,
         .parallelism = 1,
     },
+    {
+        .fn = chase_rfo,
+        .base_object_size = sizeof(void *),
+        .name = "rfo",
+        .usage1 = "rfo",
+        .usage2 = "atomically add 0 to each pointer, i.e. own the line "
+                  "before the next deref",
+        .requires_arg = 0,
+        .parallelism = 1,
+    },
+    {
+        .fn = chase_store,
+        .base_object_size = sizeof(struct store_struct),
+        .name = "store",
+        .usage1 = "store",
+        .usage2 = "store to a second line after each deref",
+        .requires_arg = 0,
+        .parallelism = 1,
+    },
+    {
+        .fn = chase_dirty,
+        .base_object_size = sizeof(struct dirty_struct),
+        .name = "dirty",
+        .usage1 = "dirty:N",
+        .usage2 = "keep N% of the lines dirty by writing them after their "
+                  "deref",
+        .requires_arg = 1,
+        .parallelism = 1,
+    },
     {
         .fn = chase_branch,
         .base_object_size = 16,
@@ -368,7 +614,8 @@ static const chase_t chases[] = {
 #endif
 #define PAR(n)                                                        \
   {                                                                   \
-    .fn = chase_parallel##n, .base_object_size = sizeof(void *),      \
+    .fn = chase_parallel##n, .hist_fn = chase_parallel##n##_hist,     \
+    .base_object_size = sizeof(void *),                               \
     .name = "parallel" #n, .usage1 = "parallel" #n,                   \
     .usage2 = "alternate " #n " non-dependent chases in each thread", \
     .parallelism = n,                                                 \
@@ -385,6 +632,34 @@ static const chase_t chases[] = {
     PAR(10),
 #endif
 #undef PAR
+    {
+        // resolved into mlp_chase once N is known
+        .base_object_size = sizeof(void *),
+        .name = "mlp",
+        .usage1 = "mlp:N|sweep",
+        .usage2 = "N non-dependent chases in each thread, sweep raises "
+                  "N until the\n"
+                  "               bandwidth stops growing",
+        .requires_arg = 1,
+        .parallelism = 1,
+    },
+#if defined(__x86_64__) || defined(__aarch64__)
+    {
+        // resolved into jit_chase once the arguments are parsed
+        .fn = chase_jit,
+        .base_object_size = sizeof(void *),
+        .name = "jit",
+        .usage1 = "jit:ARGS",
+        .usage2 = "a generated chase, ARGS are a comma separated list of\n"
+                  "               par=N (chains per thread), unroll=N, "
+                  "work=N (alu loop\n"
+                  "               after each deref), width=8|16|32|64 "
+                  "(bytes loaded per deref)\n"
+                  "               and prefetch=t0|t1|t2|nta",
+        .requires_arg = 1,
+        .parallelism = 1,
+    },
+#endif
 #if defined(__x86_64__)
     {
         .fn = chase_critword2,
@@ -398,6 +673,7 @@ static const chase_t chases[] = {
 #endif
     {
         .fn = chase_simple,
+        .hist_fn = chase_simple_hist,
         .base_object_size = 64,
         .name = "critword",
         .usage1 = "critword:N",
@@ -411,44 +687,30 @@ static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
 static size_t nr_to_startup;
 static int set_thread_affinity = 1;
-
-static void *thread_start(void *data) {
-  per_thread_t *args = data;
-
-  // ensure every thread has a different RNG
-  rng_init(args->x.thread_num);
-
-  if (set_thread_affinity) {
-    // find out which cpus we can run on and move us to an appropriate cpu
-    cpu_set_t cpus;
-    if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
-      perror("sched_getaffinity");
-      exit(1);
-    }
-    int my_cpu;
-    unsigned num = args->x.thread_num;
-    for (my_cpu = 0; my_cpu < CPU_SETSIZE; ++my_cpu) {
-      if (!CPU_ISSET(my_cpu, &cpus)) continue;
-      if (num == 0) break;
-      --num;
-    }
-    if (my_cpu == CPU_SETSIZE) {
-      fprintf(stderr, "error: more threads than cpus available\n");
-      exit(1);
-    }
-    CPU_ZERO(&cpus);
-    CPU_SET(my_cpu, &cpus);
-    if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
-      perror("sched_setaffinity");
-      exit(1);
-    }
-  }
-
+static bool use_placement;
+static struct placement placement;  // -C
+static bool use_perf_events;
+static struct perf_event_list perf_events;  // -e
+
+static const char *chase_image_path;
+static char chase_image_config[CHASE_IMAGE_CONFIG_LEN];
+static bool chase_image_loaded;
+static void **chase_heads;  // cycle[] of every thread, for chase images
+static size_t nr_chase_heads;
+static pthread_barrier_t chase_image_barrier;
+static bool chases_built;  // a matrix (-G) keeps the chases between cells
+
+// generate chases for this thread and apply any chase specific fixups.
+static void build_chases(per_thread_t *args) {
   // generate chases -- using a different mixer index for every
   // thread and for every parallel chase within a thread
   unsigned parallelism = args->x.chase->parallelism;
   for (unsigned par = 0; par < parallelism; ++par) {
-    if (args->x.use_longer_chase) {
+    if (args->x.genchase_args->pattern) {
+      args->x.cycle[par] = generate_chase_pattern(
+          args->x.genchase_args, parallelism * args->x.thread_num + par,
+          parallelism * args->x.nr_threads);
+    } else if (args->x.use_longer_chase) {
       args->x.cycle[par] = generate_chase_long(args->x.genchase_args,
                                         parallelism * args->x.thread_num + par,
                                         parallelism * args->x.nr_threads);
@@ -482,6 +744,83 @@ static void *thread_start(void *data) {
       p = next;
     } while (p != q);
   }
+}
+
+static void load_chase_heads(per_thread_t *args) {
+  unsigned parallelism = args->x.chase->parallelism;
+  for (unsigned par = 0; par < parallelism; ++par) {
+    args->x.cycle[par] = chase_heads[parallelism * args->x.thread_num + par];
+  }
+}
+
+// once every chase thread has built its chases, one of them saves the arena.
+static void save_chase_image(per_thread_t *args) {
+  const struct generate_chase_common_args *genchase_args =
+      args->x.genchase_args;
+  unsigned parallelism = args->x.chase->parallelism;
+  for (unsigned par = 0; par < parallelism; ++par) {
+    chase_heads[parallelism * args->x.thread_num + par] = args->x.cycle[par];
+  }
+  if (pthread_barrier_wait(&chase_image_barrier) ==
+      PTHREAD_BARRIER_SERIAL_THREAD) {
+    chase_image_save(chase_image_path, chase_image_config,
+                     genchase_args->arena, genchase_args->total_memory,
+                     chase_heads, nr_chase_heads);
+  }
+  pthread_barrier_wait(&chase_image_barrier);
+}
+
+// the cpu a chase thread runs on: the placement's (-C) or the n-th cpu we
+// are allowed to run on.  -1 if there are not enough cpus.
+static int thread_cpu(const per_thread_t *args) {
+  if (use_placement) {
+    return placement_cpu(&placement, "chase", args->x.thread_num,
+                         args->x.thread_num);
+  }
+  cpu_set_t cpus;
+  if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  int my_cpu;
+  unsigned num = args->x.thread_num;
+  for (my_cpu = 0; my_cpu < CPU_SETSIZE; ++my_cpu) {
+    if (!CPU_ISSET(my_cpu, &cpus)) continue;
+    if (num == 0) break;
+    --num;
+  }
+  return my_cpu == CPU_SETSIZE ? -1 : my_cpu;
+}
+
+static void *thread_start(void *data) {
+  per_thread_t *args = data;
+
+  args->x.tid = syscall(SYS_gettid);
+  // ensure every thread has a different RNG
+  rng_init(args->x.thread_num);
+
+  if (set_thread_affinity) {
+    // move us to an appropriate cpu
+    int my_cpu = thread_cpu(args);
+    if (my_cpu < 0) {
+      fprintf(stderr, "error: more threads than cpus available\n");
+      exit(1);
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(my_cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+      perror("sched_setaffinity");
+      exit(1);
+    }
+  }
+
+  if (chase_image_loaded) {
+    load_chase_heads(args);
+  } else if (!chases_built) {
+    build_chases(args);
+    if (chase_image_path) save_chase_image(args);
+  }
 
   // handle branch chases
   if (!strcmp(args->x.chase->name, "branch")) {
@@ -524,10 +863,38 @@ static void *thread_start(void *data) {
   }
   pthread_mutex_unlock(&wait_mutex);
 
-  args->x.chase->fn(data);
+  if (args->x.hist) {
+    args->x.chase->hist_fn(data);
+  } else {
+    args->x.chase->fn(data);
+  }
   return NULL;
 }
 
+// the time spent in every startup phase, reported by -v and -J
+static struct {
+  uint64_t alloc;    // mapping (and -W placing) the arenas
+  uint64_t fault;    // faulting in the chase and flush arenas
+  uint64_t mixer;    // generating the mixer
+  uint64_t threads;  // starting the threads until every chase is built
+} phase_ns;
+
+static void report_phases(void) {
+  if (json_output) {
+    json_record("multichase", "phases");
+    json_uint("alloc_ns", phase_ns.alloc);
+    json_uint("fault_ns", phase_ns.fault);
+    json_uint("mixer_ns", phase_ns.mixer);
+    json_uint("threads_ns", phase_ns.threads);
+    json_end_record();
+  } else if (verbosity > 0) {
+    printf("startup: alloc %.1f ms, fault %.1f ms, mixer %.1f ms, "
+           "threads %.1f ms\n",
+           phase_ns.alloc / 1e6, phase_ns.fault / 1e6, phase_ns.mixer / 1e6,
+           phase_ns.threads / 1e6);
+  }
+}
+
 static void timestamp(void) {
   if (!print_timestamp) return;
   struct timeval tv;
@@ -535,6 +902,567 @@ static void timestamp(void) {
   printf("%.6f ", tv.tv_sec + tv.tv_usec / 1000000.);
 }
 
+// ensure some sanity in the various arguments
+static void fit_chase_args(struct generate_chase_common_args *args) {
+  if (args->tlb_locality < args->stride) {
+    args->tlb_locality = args->stride;
+  } else {
+    args->tlb_locality -= args->tlb_locality % args->stride;
+  }
+
+  if (args->total_memory < args->tlb_locality) {
+    if (args->total_memory < args->stride) {
+      args->total_memory = args->stride;
+    } else {
+      args->total_memory -= args->total_memory % args->stride;
+    }
+    args->tlb_locality = args->total_memory;
+  } else {
+    args->total_memory -= args->total_memory % args->tlb_locality;
+  }
+}
+
+static void start_chase_threads(per_thread_t *thread_data, size_t nr_threads,
+                                pthread_t *threads) {
+  static bool started;  // the first start builds the chases
+  uint64_t start = now_nsec();
+
+  __atomic_store_n(&hist_recording, 0, __ATOMIC_RELEASE);
+  nr_to_startup = nr_threads;
+  for (size_t i = 0; i < nr_threads; ++i) {
+    thread_data[i].x.count = 0;
+    thread_data[i].x.stop = 0;
+    if (thread_data[i].x.hist) {
+      memset(thread_data[i].x.hist, 0, sizeof(*thread_data[i].x.hist));
+    }
+    if (pthread_create(&threads[i], NULL, thread_start, &thread_data[i])) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+
+  // now wait for them all to finish generating their chases and start chasing
+  pthread_mutex_lock(&wait_mutex);
+  if (nr_to_startup) {
+    pthread_cond_wait(&wait_cond, &wait_mutex);
+  }
+  pthread_mutex_unlock(&wait_mutex);
+  if (!started) {
+    started = true;
+    phase_ns.threads = now_nsec() - start;
+    report_phases();
+  }
+}
+
+// the chases return at the end of their block once stop is set.  the jit
+// loop only returns when its count wraps to 0, so it gets the count one pass
+// short of that instead.
+static void stop_chase_threads(per_thread_t *thread_data, pthread_t *threads,
+                               size_t nr_threads) {
+  for (size_t i = 0; i < nr_threads; ++i) {
+    __atomic_store_n(&thread_data[i].x.stop, 1, __ATOMIC_RELEASE);
+    if (thread_data[i].x.chase->fn == chase_jit) {
+      __atomic_store_n(&thread_data[i].x.count, -jit_chase_loads,
+                       __ATOMIC_RELEASE);
+    }
+  }
+  for (size_t i = 0; i < nr_threads; ++i) pthread_join(threads[i], NULL);
+}
+
+// -A: the confidence interval to reach, and what the last sampling reached
+static double ci_target;
+static double last_ci;          // relative to the mean
+static size_t last_nr_samples;  // samples taken, after dropping the first
+
+// sample the progress of the chase threads, returns the best (or average)
+// latency in ns per load.  thread_ns (unless NULL) gets the same for every
+// thread.
+static double sample_chases(per_thread_t *thread_data, size_t nr_threads,
+                            size_t nr_samples, uint64_t duration_nsecs,
+                            int print_average, double *thread_ns) {
+  size_t i;
+
+  nr_samples = nr_samples + 1;  // we drop the first sample
+  uint64_t *cur_samples = alloca(nr_threads * sizeof(*cur_samples));
+  uint64_t last_sample_time = now_nsec();
+  uint64_t start_time = last_sample_time;
+  uint64_t total = 0;
+  uint64_t stalls = 0;
+  double best = 1. / 0.;
+  double running_sum = 0.;
+  size_t nr_used = 0;
+  struct sample_ci ci = {0};
+  double *thread_best = alloca(nr_threads * sizeof(*thread_best));
+  double *thread_sum = alloca(nr_threads * sizeof(*thread_sum));
+  for (i = 0; i < nr_threads; ++i) {
+    thread_best[i] = 1. / 0.;
+    thread_sum[i] = 0.;
+  }
+  // per thread counts of every perf event of the current sample, and the
+  // totals over all threads and samples
+  struct perf_counters *counters = NULL;
+  double *deltas = NULL, *event_totals = NULL;
+  uint64_t counted_loads = 0;
+  size_t j;
+  if (use_perf_events) {
+    counters = alloca(nr_threads * sizeof(*counters));
+    deltas = alloca(nr_threads * perf_events.nr * sizeof(*deltas));
+    event_totals = alloca(perf_events.nr * sizeof(*event_totals));
+    for (j = 0; j < perf_events.nr; ++j) event_totals[j] = 0.;
+    for (i = 0; i < nr_threads; ++i) {
+      perf_counters_open(&counters[i], &perf_events, thread_data[i].x.tid);
+    }
+  }
+  if (verbosity > 0)
+    printf("samples (one column per thread, one row per sample):\n");
+  for (size_t sample_no = 0; nr_samples == 1 || sample_no < nr_samples;
+       ++sample_no) {
+    usleep(DELAY_USECS);
+
+    uint64_t sum = 0;
+    for (i = 0; i < nr_threads; ++i) {
+      cur_samples[i] = __sync_lock_test_and_set(&thread_data[i].x.count, 0);
+      sum += cur_samples[i];
+    }
+
+    uint64_t cur_sample_time = now_nsec();
+    uint64_t time_delta = cur_sample_time - last_sample_time;
+    last_sample_time = cur_sample_time;
+    for (i = 0; counters && i < nr_threads; ++i) {
+      perf_counters_sample(&counters[i], &perf_events,
+                           deltas + i * perf_events.nr);
+    }
+
+    // we drop the first sample because it's fairly likely one
+    // thread had some advantage initially due to still having
+    // portions of the chase in a cache.
+    if (sample_no == 0) {
+      __atomic_store_n(&hist_recording, 1, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    for (i = 0; counters && i < nr_threads; ++i) {
+      double *d = deltas + i * perf_events.nr;
+      if (!json_output) {
+        printf("thread %zu: %.1f ns/load", i,
+               time_delta / (double)cur_samples[i]);
+        print_perf_deltas(&perf_events, d, cur_samples[i], "load");
+        printf("\n");
+      }
+      for (j = 0; j < perf_events.nr; ++j) event_totals[j] += d[j];
+      counted_loads += cur_samples[i];
+    }
+
+    if (verbosity > 0) {
+      timestamp();
+      for (i = 0; i < nr_threads; ++i) {
+        double z = time_delta / (double)cur_samples[i];
+        printf(" %6.*f", z < 100. ? 3 : 1, z);
+      }
+    }
+
+    for (i = 0; i < nr_threads; ++i) {
+      double z = time_delta / (double)cur_samples[i];
+      if (z < thread_best[i]) thread_best[i] = z;
+      thread_sum[i] += z;
+    }
+
+    total += sum;
+    if (!sum)
+      stalls++;
+    double t = time_delta / (double)sum;
+    running_sum += t;
+    ++nr_used;
+    sample_ci_add(&ci, t * nr_threads);
+    if (t < best) {
+      best = t;
+    }
+    if (verbosity > 0) {
+      double z = t * nr_threads;
+      printf("  avg=%.*f\n", z < 100. ? 3 : 1, z);
+    }
+    if (json_output) {
+      double *loads = alloca(nr_threads * sizeof(*loads));
+      json_record("multichase", "sample");
+      json_uint("sample", sample_no);
+      json_uint("duration_ns", time_delta);
+      json_array("thread_ns_per_load");
+      for (i = 0; i < nr_threads; ++i) {
+        loads[i] = cur_samples[i];
+        json_double(NULL, time_delta / loads[i]);
+      }
+      json_end();
+      json_double("ns_per_load", t * nr_threads);
+      if (counters) {
+        json_perf_deltas("thread_events_per_load", &perf_events, deltas,
+                         loads, nr_threads);
+      }
+      json_end_record();
+    }
+
+    if (ci_target > 0. && nr_used >= CI_MIN_SAMPLES &&
+        sample_ci_half_width(&ci) <= ci_target * ci.mean) {
+      break;
+    }
+    if (last_sample_time - start_time > duration_nsecs) {
+      if (!json_output) {
+        printf("timed out: %lu samples, %lu stalls, %lu iterations per msec\n",
+               sample_no, stalls, total * NSECS_PER_MSEC / duration_nsecs);
+      }
+      break;
+    }
+  }
+  __atomic_store_n(&hist_recording, 0, __ATOMIC_RELEASE);
+  last_ci = sample_ci_half_width(&ci) / ci.mean;
+  last_nr_samples = nr_used;
+  if (counters && json_output) {
+    double loads = counted_loads;
+    json_record("multichase", "events");
+    json_perf_deltas("events_per_load", &perf_events, event_totals, &loads, 1);
+    json_end_record();
+  } else if (counters) {
+    printf("all threads:");
+    print_perf_deltas(&perf_events, event_totals, counted_loads, "load");
+    printf("\n");
+  }
+  for (i = 0; counters && i < nr_threads; ++i) {
+    perf_counters_close(&counters[i], &perf_events);
+  }
+  for (i = 0; thread_ns && i < nr_threads; ++i) {
+    thread_ns[i] = print_average ? thread_sum[i] / nr_used : thread_best[i];
+  }
+  if (print_average) {
+    return running_sum * nr_threads / nr_used;
+  }
+  return best * nr_threads;
+}
+
+// the percentiles of every thread as "thread_ns_per_load": [{...}, ...]
+static void json_histograms(per_thread_t *thread_data, size_t nr_threads) {
+  json_array("thread_ns_per_load_percentiles");
+  for (size_t i = 0; i < nr_threads; ++i) {
+    histogram_json(NULL, thread_data[i].x.hist, 1000.);
+  }
+  json_end();
+}
+
+static void print_histograms(per_thread_t *thread_data, size_t nr_threads) {
+  for (size_t i = 0; i < nr_threads; ++i) {
+    printf("thread %zu ns/load:", i);
+    histogram_print_percentiles(stdout, thread_data[i].x.hist, 1000.);
+    printf("\n");
+  }
+}
+
+// name the capacity that a working set of size bytes most likely exceeded:
+// the closest cache within a factor of two which hasn't been named already.
+// anything else is most likely the reach of some level of the TLB.
+static void sweep_boundary(size_t size, const struct cpu_cache *caches,
+                           bool *named, size_t nr_caches, char *buf,
+                           size_t len) {
+  size_t best = nr_caches;
+  double best_dist = 1.;
+  for (size_t i = 0; i < nr_caches; ++i) {
+    double dist = fabs(log2((double)size / caches[i].size));
+    if (!named[i] && dist <= best_dist) {
+      best = i;
+      best_dist = dist;
+    }
+  }
+  if (best == nr_caches) {
+    snprintf(buf, len, "%zuK (TLB reach?)", size / 1024);
+    return;
+  }
+  named[best] = true;
+  snprintf(buf, len, "%s (%zuK)%s", caches[best].name,
+           caches[best].size / 1024, best == nr_caches - 1 ? " DRAM" : "");
+}
+
+// measure every size of the sweep using prefixes of the arena, which has been
+// allocated for the largest size.  prints one row per size, and marks the
+// sizes where the latency leaves a plateau.
+static void sweep_chases(per_thread_t *thread_data, size_t nr_threads,
+                         struct generate_chase_common_args *genchase_args,
+                         const struct mem_sweep *sweep, size_t nr_samples,
+                         uint64_t duration_nsecs, int print_average) {
+  pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+  if (threads == NULL) {
+    fprintf(stderr, "Could not allocate threads\n");
+    exit(1);
+  }
+
+  // the caches of the cpu the first chase thread runs on
+  int cpu = set_thread_affinity ? thread_cpu(&thread_data[0]) : 0;
+  if (cpu < 0) cpu = 0;
+  struct cpu_cache caches[MAX_CPU_CACHES];
+  bool named[MAX_CPU_CACHES] = {false};
+  size_t nr_caches = get_cpu_caches(cpu, caches, MAX_CPU_CACHES);
+  if (verbosity > 0) {
+    for (size_t i = 0; i < nr_caches; ++i) {
+      printf("cpu%d %s = %zuK\n", cpu, caches[i].name, caches[i].size / 1024);
+    }
+  }
+
+  size_t tlb_locality = genchase_args->tlb_locality;
+  size_t last_size = 0;
+  double plateau = 0.;
+  double last_res = 0.;
+  bool climbing = false;
+  for (size_t size = sweep->low; size <= sweep->high;
+       size = mem_sweep_next(sweep, size)) {
+    genchase_args->total_memory = size;
+    genchase_args->tlb_locality = tlb_locality;
+    fit_chase_args(genchase_args);
+    // sizes are rounded down like -m, don't measure the same size twice
+    if (genchase_args->total_memory == last_size) continue;
+    size_t prev_size = last_size;
+    last_size = genchase_args->total_memory;
+    if (thread_data[0].x.use_longer_chase) {
+      // the long chase expects an arena without any previous chase
+      memset(genchase_args->arena, 0, last_size);
+    }
+
+    start_chase_threads(thread_data, nr_threads, threads);
+    double res = sample_chases(thread_data, nr_threads, nr_samples,
+                               duration_nsecs, print_average, NULL);
+    stop_chase_threads(thread_data, threads, nr_threads);
+
+    char boundary[64] = "";
+    if (plateau == 0.) {
+      plateau = res;
+    } else if (climbing) {
+      if (res < last_res * SWEEP_FLAT) {
+        climbing = false;
+        plateau = res;
+      }
+    } else if (res > plateau * SWEEP_JUMP) {
+      climbing = true;
+      sweep_boundary(prev_size, caches, named, nr_caches, boundary,
+                     sizeof(boundary));
+    } else if (res < plateau) {
+      plateau = res;
+    }
+    last_res = res;
+    if (json_output) {
+      json_record("multichase", "sweep");
+      json_uint("size", last_size);
+      json_double("ns_per_load", res);
+      if (boundary[0]) json_string("exceeded", boundary);
+      if (thread_data[0].x.hist) json_histograms(thread_data, nr_threads);
+      json_end_record();
+      continue;
+    }
+    timestamp();
+    printf("%12zu %6.*f", last_size, res < 100. ? 3 : 1, res);
+    if (boundary[0]) printf("  > %s", boundary);
+    printf("\n");
+
+    if (thread_data[0].x.hist) print_histograms(thread_data, nr_threads);
+  }
+  free(threads);
+}
+
+static chase_t mlp_chase;  // -c mlp:N, a copy of "mlp" with N chains
+static chase_t jit_chase;  // -c jit:..., a copy of "jit" with its shape
+
+static double mlp_mibps(double ns_per_load) {
+  return MLP_LINE / ns_per_load * 1e9 / (1024 * 1024);
+}
+
+// raise the number of independent chains of every thread from 1 to (at
+// most) max_chains until the bandwidth saturates.  prints the latency and
+// bandwidth of every step, then the saturation point.
+static void mlp_sweep(per_thread_t *thread_data, size_t nr_threads,
+                      struct generate_chase_common_args *genchase_args,
+                      unsigned max_chains, size_t nr_samples,
+                      uint64_t duration_nsecs, int print_average) {
+  pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+  double *thread_ns = calloc(nr_threads, sizeof(*thread_ns));
+  double *mibps = calloc(max_chains + 1, sizeof(*mibps));
+  double *latency = calloc(max_chains + 1, sizeof(*latency));
+  if (threads == NULL || thread_ns == NULL || mibps == NULL ||
+      latency == NULL) {
+    fprintf(stderr, "Could not allocate the mlp sweep\n");
+    exit(1);
+  }
+
+  if (!json_output) {
+    printf("chains  ns/load  latency(ns)     MiB/s%s\n",
+           nr_threads > 1 ? "  (MiB/s of every thread)" : "");
+  }
+  double best = 0.;
+  unsigned n, last = 0, flat = 0;
+  for (n = 1; n <= max_chains && flat < MLP_FLAT_STEPS; ++n) {
+    mlp_chase.parallelism = n;
+    mlp_chase.fn = mlp_fns[n];
+    if (thread_data[0].x.use_longer_chase) {
+      // the long chase expects an arena without any previous chase
+      memset(genchase_args->arena, 0, genchase_args->total_memory);
+    }
+
+    start_chase_threads(thread_data, nr_threads, threads);
+    double res = sample_chases(thread_data, nr_threads, nr_samples,
+                               duration_nsecs, print_average, thread_ns);
+    stop_chase_threads(thread_data, threads, nr_threads);
+
+    // every thread has n loads in flight, each takes n times its ns/load
+    latency[n] = res * n;
+    mibps[n] = nr_threads * mlp_mibps(res);
+    last = n;
+    if (mibps[n] > best * MLP_GROWTH) {
+      flat = 0;
+    } else {
+      ++flat;
+    }
+    if (mibps[n] > best) best = mibps[n];
+
+    if (json_output) {
+      json_record("multichase", "mlp");
+      json_uint("chains", n);
+      json_double("ns_per_load", res);
+      json_double("latency_ns", latency[n]);
+      json_double("mibps", mibps[n]);
+      json_array("thread_mibps");
+      for (size_t i = 0; i < nr_threads; ++i) {
+        json_double(NULL, mlp_mibps(thread_ns[i]));
+      }
+      json_end();
+      json_end_record();
+      continue;
+    }
+    timestamp();
+    printf("%6u  %7.3f  %11.1f  %8.0f", n, res, latency[n], mibps[n]);
+    for (size_t i = 0; nr_threads > 1 && i < nr_threads; ++i) {
+      printf(" %8.0f", mlp_mibps(thread_ns[i]));
+    }
+    printf("\n");
+  }
+
+  n = 1;
+  while (n < last && mibps[n] < best * MLP_SATURATED) ++n;
+  if (json_output) {
+    json_record("multichase", "result");
+    json_uint("saturation_chains", n);
+    json_double("mibps", mibps[n]);
+    json_double("latency_ns", latency[n]);
+    json_double("best_mibps", best);
+    json_bool("saturated", flat == MLP_FLAT_STEPS);
+    json_end_record();
+  } else {
+    printf("%s, %.0f%% of the best bandwidth at %u chains per thread: "
+           "%.0f MiB/s, %.1f ns latency\n",
+           flat == MLP_FLAT_STEPS ? "saturated" : "not saturated yet",
+           100. * MLP_SATURATED, n, mibps[n], latency[n]);
+  }
+  free(threads);
+  free(thread_ns);
+  free(mibps);
+  free(latency);
+}
+
+// measure the latency from the cpus of every node (rows) to the memory of
+// every node (columns).  the chases are built once, then for every memory
+// node the arena's pages are moved there and the chase threads run on the
+// first cores of each cpu node in turn.
+static void matrix_chases(per_thread_t *thread_data, size_t nr_threads,
+                          void *arena, size_t arena_size, size_t nr_samples,
+                          uint64_t duration_nsecs, int print_average) {
+  static const char *const roles[] = {"chase", NULL};
+  int cpu_nodes[MAX_MEM_NODES];
+  int mem_nodes[MAX_MEM_NODES];
+  size_t nr_cpu_nodes = get_node_list("has_cpu", cpu_nodes, MAX_MEM_NODES);
+  size_t nr_mem_nodes =
+      get_node_list("has_memory", mem_nodes, MAX_MEM_NODES);
+  size_t c, m;
+
+  if (nr_cpu_nodes == 0 || nr_mem_nodes == 0) {
+    fprintf(stderr, "no numa nodes found in sysfs\n");
+    exit(1);
+  }
+  double *res = calloc(nr_cpu_nodes * nr_mem_nodes, sizeof(*res));
+  pthread_t *threads = calloc(nr_threads, sizeof(*threads));
+  if (res == NULL || threads == NULL) {
+    fprintf(stderr, "Could not allocate the matrix\n");
+    exit(1);
+  }
+
+  for (m = 0; m < nr_mem_nodes; ++m) {
+    struct mem_policy policy = {
+        .mode = MPOL_BIND,
+        .nodes = (uint64_t)1 << mem_nodes[m],
+    };
+    arena_mbind_policy(arena, arena_size, &policy);
+
+    for (c = 0; c < nr_cpu_nodes; ++c) {
+      char spec[32];
+      res[c * nr_mem_nodes + m] = -1.;
+      snprintf(spec, sizeof(spec), "node%d.cores", cpu_nodes[c]);
+      if (parse_placement(spec, roles, &placement) ||
+          placement.role[0].nr_cpus < nr_threads) {
+        if (verbosity > 0) {
+          printf("not enough cores on node %d for %zu threads\n",
+                 cpu_nodes[c], nr_threads);
+        }
+        continue;
+      }
+      use_placement = true;
+
+      start_chase_threads(thread_data, nr_threads, threads);
+      chases_built = true;
+      res[c * nr_mem_nodes + m] =
+          sample_chases(thread_data, nr_threads, nr_samples, duration_nsecs,
+                        print_average, NULL);
+      stop_chase_threads(thread_data, threads, nr_threads);
+
+      if (verbosity > 0) {
+        printf("cpu node %d, memory node %d (arena starts on node %d): %.3f\n",
+               cpu_nodes[c], mem_nodes[m], arena_page_node(arena),
+               res[c * nr_mem_nodes + m]);
+      }
+    }
+  }
+
+  if (json_output) {
+    for (c = 0; c < nr_cpu_nodes; ++c) {
+      for (m = 0; m < nr_mem_nodes; ++m) {
+        json_record("multichase", "matrix");
+        json_int("cpu_node", cpu_nodes[c]);
+        json_int("memory_node", mem_nodes[m]);
+        json_double("ns_per_load", res[c * nr_mem_nodes + m] < 0.
+                                       ? NAN
+                                       : res[c * nr_mem_nodes + m]);
+        json_end_record();
+      }
+    }
+    free(threads);
+    free(res);
+    return;
+  }
+
+  printf("latency in ns from the cpus of each node (rows) to the memory of "
+         "each node (columns)\n\n");
+  const int col_width = 8;
+  timestamp();
+  printf("   ");
+  for (m = 0; m < nr_mem_nodes; ++m) printf("%*d", col_width, mem_nodes[m]);
+  printf("\n");
+  for (c = 0; c < nr_cpu_nodes; ++c) {
+    timestamp();
+    printf("%2d:", cpu_nodes[c]);
+    for (m = 0; m < nr_mem_nodes; ++m) {
+      double z = res[c * nr_mem_nodes + m];
+      if (z < 0.) {
+        printf("%*s", col_width, "-");
+      } else {
+        printf("%*.*f", col_width, z < 100. ? 3 : 1, z);
+      }
+    }
+    printf("\n");
+  }
+  free(threads);
+  free(res);
+}
+
 int main(int argc, char **argv) {
   char *p;
   int c;
@@ -548,8 +1476,19 @@ int main(int argc, char **argv) {
   size_t nr_samples = DEF_NR_SAMPLES;
   size_t cache_flush_size = DEF_CACHE_FLUSH;
   size_t offset = DEF_OFFSET;
+  size_t nr_chase_workers = DEF_NR_CHASE_WORKERS;
   int print_average = 0;
+  bool use_histogram = false;
+  bool use_sweep = false;
+  bool use_matrix = false;
+  double ci_max_secs = 0.;  // -A
+  bool use_mlp_sweep = false;
+  unsigned mlp_max = 0;
+  struct mem_sweep sweep;
   const char *extra_args = NULL;
+  const char *placement_optarg = NULL;
+  const char *pattern_optarg = NULL;
+  struct chase_pattern pattern;
   const char *chase_optarg = chases[0].name;
   const chase_t *chase = &chases[0];
   struct generate_chase_common_args genchase_args;
@@ -560,14 +1499,28 @@ int main(int argc, char **argv) {
   genchase_args.stride = DEF_STRIDE;
   genchase_args.tlb_locality = DEF_TLB_LOCALITY * default_page_size;
   genchase_args.gen_permutation = gen_random_permutation;
+  genchase_args.keyed = false;
+  genchase_args.pattern = NULL;
+  rng_seed = DEF_SEED;
 
   setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
 
-  while ((c = getopt(argc, argv, "ac:F:p:HLm:Nn:oO:S:s:T:t:vXyW:f:M")) != -1) {
+  timer_init();
+
+  while ((c = getopt(argc, argv, "aA:C:c:e:F:GI:Jj:kp:HLm:Nn:oO:Pr:S:s:T:t:vXyz:W:f:M")) != -1) {
     switch (c) {
       case 'a':
         print_average = 1;
         break;
+      case 'A':
+        if (parse_ci_arg(optarg, &ci_target, &ci_max_secs)) {
+          fprintf(stderr, "-A needs pct[:secs], both positive\n");
+          exit(1);
+        }
+        break;
+      case 'C':
+        placement_optarg = optarg;
+        break;
       case 'c':
         chase_optarg = optarg;
         p = strchr(optarg, ':');
@@ -614,6 +1567,19 @@ int main(int argc, char **argv) {
           exit(1);
         }
         break;
+      case 'I':
+        chase_image_path = optarg;
+        break;
+      case 'j':
+        nr_chase_workers = strtoul(optarg, &p, 0);
+        if (*p || nr_chase_workers == 0) {
+          fprintf(stderr, "nr_chase_workers must be a positive integer\n");
+          exit(1);
+        }
+        break;
+      case 'k':
+        genchase_args.keyed = true;
+        break;
       case 'p':
         if (parse_mem_arg(optarg, &page_size)) {
           fprintf(stderr,
@@ -622,6 +1588,19 @@ int main(int argc, char **argv) {
           exit(1);
         }
         break;
+      case 'e':
+        if (parse_perf_events(optarg, &perf_events)) {
+          fprintf(stderr,
+                  "not a list of at most %d perf events: %s\nknown events: "
+                  "%s\n",
+                  MAX_PERF_EVENTS, optarg, perf_event_names());
+          exit(1);
+        }
+        use_perf_events = true;
+        break;
+      case 'G':
+        use_matrix = true;
+        break;
       case 'H':
         use_thp = true;
         break;
@@ -632,7 +1611,17 @@ int main(int argc, char **argv) {
         use_longer_chase = true;
         break;
       case 'm':
-        if (parse_mem_arg(optarg, &genchase_args.total_memory) ||
+        if (strchr(optarg, ':')) {
+          if (parse_mem_sweep_arg(optarg, &sweep) || sweep.low == 0) {
+            fprintf(stderr,
+                    "a memory sweep must be low:high:xF or low:high:+nnnn "
+                    "(sizes suffixed\nwith k, m or g, 0 < low <= high, F > "
+                    "1)\n");
+            exit(1);
+          }
+          use_sweep = true;
+          genchase_args.total_memory = sweep.high;
+        } else if (parse_mem_arg(optarg, &genchase_args.total_memory) ||
             genchase_args.total_memory == 0) {
           fprintf(stderr,
                   "total_memory must be a positive integer (suffixed with k, m "
@@ -661,6 +1650,16 @@ int main(int argc, char **argv) {
       case 'o':
         genchase_args.gen_permutation = gen_ordered_permutation;
         break;
+      case 'P':
+        use_histogram = true;
+        break;
+      case 'r':
+        rng_seed = strtoull(optarg, &p, 0);
+        if (*p) {
+          fprintf(stderr, "seed must be a non-negative integer\n");
+          exit(1);
+        }
+        break;
       case 's':
         if (parse_mem_arg(optarg, &genchase_args.stride)) {
           fprintf(
@@ -684,6 +1683,9 @@ int main(int argc, char **argv) {
           exit(1);
         }
         break;
+      case 'J':
+        json_output = true;
+        break;
       case 'v':
         ++verbosity;
         break;
@@ -714,6 +1716,17 @@ int main(int argc, char **argv) {
       case 'y':
         print_timestamp = 1;
         break;
+      case 'z':
+        if (parse_chase_pattern(optarg, &pattern)) {
+          fprintf(stderr,
+                  "pattern must be uniform, zipf or hot, optionally "
+                  "followed by\n"
+                  ":skew=S (> 0), frac=F (0-1), p=P (0-1) and run=N (> 0)\n");
+          exit(1);
+        }
+        pattern_optarg = optarg;
+        genchase_args.pattern = &pattern;
+        break;
       default:
         goto usage;
     }
@@ -724,22 +1737,48 @@ int main(int argc, char **argv) {
     fprintf(stderr, "usage: %s [options]\n", argv[0]);
     fprintf(stderr,
             "-a             print average latency (default is best latency)\n");
+    fprintf(stderr,
+            "-A pct[:secs]  sample until the 95%% confidence interval of the "
+            "mean latency is\n"
+            "               within pct%% of it (at least %d samples) or for "
+            "secs (default %.0f),\n"
+            "               replacing -n\n",
+            CI_MIN_SAMPLES, CI_DEF_MAX_SECS);
+    fprintf(stderr,
+            "-C placement   run thread i on the i-th cpu of a list, e.g. 0-3, "
+            "node0.cores,\n"
+            "               all.llcs or package1.core0+node1.cores (default: "
+            "the i-th\n"
+            "               allowed cpu)\n");
     fprintf(stderr, "-c chase       select one of several different chases:\n");
     for (i = 0; i < sizeof(chases) / sizeof(chases[0]); ++i) {
       fprintf(stderr, "   %-12s%s\n", chases[i].usage1, chases[i].usage2);
     }
     fprintf(stderr, "               default: %s\n", chases[0].name);
+    fprintf(stderr,
+            "-e events      count these perf events per load in every sample, "
+            "one of:\n               %s\n",
+            perf_event_names());
     fprintf(stderr, "-m nnnn[kmg]   total memory size (default %zu)\n",
             DEF_TOTAL_MEMORY);
     fprintf(stderr,
             "               NOTE: memory size will be rounded down to a "
             "multiple of -T option\n");
+    fprintf(stderr,
+            "-m low:high:xF sweep the memory size from low to high, "
+            "multiplying by F (or\n"
+            "               adding nnnn with +nnnn) and mark where the latency "
+            "jumps\n");
     fprintf(stderr,
             "-N             timed run (stops at nr_samples/2 seconds)\n");
     fprintf(stderr,
             "-n nr_samples  nr of 0.5 second samples to use (default %zu, 0 = "
             "infinite)\n",
             DEF_NR_SAMPLES);
+    fprintf(stderr,
+            "-P             time each block of loads and print per thread "
+            "latency\n"
+            "               percentiles (simple, critword and parallel chases)\n");
     fprintf(
         stderr,
         "-o             perform an ordered traversal (rather than random)\n");
@@ -752,9 +1791,37 @@ int main(int argc, char **argv) {
             "multiple of stride\n");
     fprintf(stderr, "-t nr_threads  number of threads (default %zu)\n",
             DEF_NR_THREADS);
+    fprintf(stderr,
+            "-I file        load the chase from this image if it was saved "
+            "with the same\n"
+            "               settings, otherwise build it and save it there\n");
+    fprintf(stderr,
+            "-j nr_workers  number of threads used to build each chase "
+            "(default %zu)\n"
+            "               the workers first touch the chase, use -W or numactl to "
+            "control placement\n",
+            DEF_NR_CHASE_WORKERS);
+    fprintf(stderr,
+            "-J             print JSON lines: the host, the configuration, "
+            "every sample\n"
+            "               and the result as one object per line\n");
+    fprintf(stderr,
+            "-k             walk a keyed bijection instead of storing the "
+            "permutation\n"
+            "               needs no memory beyond the arena, but takes longer to "
+            "build\n");
+    fprintf(stderr,
+            "-r seed        seed for the chase and mixer generator "
+            "(default %" PRIu64 ")\n",
+            DEF_SEED);
     fprintf(stderr, "-p page_size   backing page size to use (default %zu)\n",
             default_page_size);
     fprintf(stderr, "-f file        mmap memory using the provided file\n");
+    fprintf(stderr,
+            "-G             print a matrix of the latency from the cpus of "
+            "every numa node\n"
+            "               to the memory of every numa node (moving the "
+            "arena between cells)\n");
     fprintf(stderr,
             "-H             use transparent hugepages (leave page size at "
             "default)\n");
@@ -773,38 +1840,87 @@ int main(int argc, char **argv) {
         stderr,
         "-W mbind list  list of node:weight,... pairs for allocating memory\n"
         "               has no effect if -H flag is specified\n"
-        "               0:10,1:90 weights it as 10%% on 0 and 90%% on 1\n");
+        "               0:10,1:90 weights it as 10%% on 0 and 90%% on 1\n"
+        "               weighted interleave is used if the system wide node "
+        "weights\n"
+        "               already have this ratio, they are never changed\n");
     fprintf(stderr, "-X             do not set thread affinity\n");
     fprintf(stderr, "-y             print timestamp in front of each line\n");
+    fprintf(stderr,
+            "-z pattern     draw the chase from an access pattern instead of "
+            "a permutation:\n"
+            "               uniform, zipf or hot with optional :skew=S "
+            "(default 0.99),\n"
+            "               frac=F of the elements hot (default 0.1), p=P of "
+            "the loads to them\n"
+            "               (default 0.9) and run=N elements read in order "
+            "per draw\n");
     exit(1);
   }
 
-  if (genchase_args.stride < sizeof(void *)) {
-    fprintf(stderr, "stride must be at least %zu\n", sizeof(void *));
+  if (genchase_args.pattern &&
+      (genchase_args.keyed || use_longer_chase ||
+       genchase_args.gen_permutation == gen_ordered_permutation)) {
+    fprintf(stderr, "-z can not be combined with -k, -L or -o\n");
     exit(1);
   }
 
-  // ensure some sanity in the various arguments
-  if (genchase_args.tlb_locality < genchase_args.stride) {
-    genchase_args.tlb_locality = genchase_args.stride;
-  } else {
-    genchase_args.tlb_locality -=
-        genchase_args.tlb_locality % genchase_args.stride;
+  if (!strcmp(chase->name, "mlp")) {
+    mlp_chase = *chase;
+    if (!strcmp(extra_args, "sweep")) {
+      use_mlp_sweep = true;
+    } else {
+      mlp_chase.parallelism = strtoul(extra_args, &p, 0);
+      if (*p || mlp_chase.parallelism == 0 ||
+          mlp_chase.parallelism > MAX_MLP) {
+        fprintf(stderr, "mlp:N needs 1 <= N <= %d\n", MAX_MLP);
+        exit(1);
+      }
+      mlp_chase.fn = mlp_fns[mlp_chase.parallelism];
+    }
+    chase = &mlp_chase;
   }
 
-  if (genchase_args.total_memory < genchase_args.tlb_locality) {
-    if (genchase_args.total_memory < genchase_args.stride) {
-      genchase_args.total_memory = genchase_args.stride;
-    } else {
-      genchase_args.total_memory -=
-          genchase_args.total_memory % genchase_args.stride;
+  if (!strcmp(chase->name, "dirty") &&
+      (strtoul(extra_args, &p, 0) > 100 || *p)) {
+    fprintf(stderr, "dirty:N needs 0 <= N <= 100\n");
+    exit(1);
+  }
+
+  if (!strcmp(chase->name, "jit")) {
+    struct jit_chase_args jit_args;
+    if (parse_jit_chase_args(extra_args, MAX_MLP, &jit_args)) {
+      fprintf(stderr,
+              "jit needs 1 <= par <= %d, par * unroll <= %d and a width of "
+              "8, 16, 32 or 64\n",
+              MAX_MLP, JIT_MAX_LOADS);
+      exit(1);
     }
-    genchase_args.tlb_locality = genchase_args.total_memory;
-  } else {
-    genchase_args.total_memory -=
-        genchase_args.total_memory % genchase_args.tlb_locality;
+    jit_chase = *chase;
+    jit_chase.parallelism = jit_args.par;
+    jit_chase.base_object_size = jit_args.width;
+    jit_chase_loop = jit_chase_build(&jit_args);
+    jit_chase_loads = jit_args.par * jit_args.unroll;
+    chase = &jit_chase;
+  }
+
+  if (placement_optarg) {
+    static const char *const roles[] = {"chase", NULL};
+    if (!set_thread_affinity) {
+      fprintf(stderr, "-C can not be combined with -X\n");
+      exit(1);
+    }
+    if (parse_placement(placement_optarg, roles, &placement)) exit(1);
+    use_placement = true;
+  }
+
+  if (genchase_args.stride < sizeof(void *)) {
+    fprintf(stderr, "stride must be at least %zu\n", sizeof(void *));
+    exit(1);
   }
 
+  fit_chase_args(&genchase_args);
+
   genchase_args.nr_mixer_indices =
       genchase_args.stride / chase->base_object_size;
   if (genchase_args.nr_mixer_indices < nr_threads * chase->parallelism) {
@@ -815,24 +1931,160 @@ int main(int argc, char **argv) {
     exit(1);
   }
 
+  if (use_sweep) {
+    if (nr_samples == 0) {
+      fprintf(stderr, "a memory sweep needs a finite number of samples\n");
+      exit(1);
+    }
+    if (chase_image_path || !strcmp(chase->name, "branch")) {
+      fprintf(stderr,
+              "a memory sweep can not be combined with -I or the branch "
+              "chase\n");
+      exit(1);
+    }
+  }
+
+  if (use_mlp_sweep) {
+    if (use_sweep || use_matrix || chase_image_path || use_perf_events ||
+        nr_samples == 0) {
+      fprintf(stderr,
+              "mlp:sweep needs a finite number of samples and can not be "
+              "combined with a\nmemory sweep, -G, -I or -e\n");
+      exit(1);
+    }
+    // as many chains as the stride has room for
+    mlp_max = genchase_args.nr_mixer_indices / nr_threads;
+    if (mlp_max > MAX_MLP) mlp_max = MAX_MLP;
+    if (mlp_max < 2) {
+      fprintf(stderr,
+              "the stride is too small for more than one chain per thread\n");
+      exit(1);
+    }
+    mlp_chase.parallelism = mlp_max;
+  }
+
+  if (use_matrix) {
+    if (use_sweep || placement_optarg || !set_thread_affinity ||
+        chase_image_path || use_histogram || nr_samples == 0) {
+      fprintf(stderr,
+              "a matrix needs a finite number of samples and can not be "
+              "combined with a\nmemory sweep, -C, -I, -P or -X\n");
+      exit(1);
+    }
+    if (use_malloc || fd != -1 || !strcmp(chase->name, "branch")) {
+      fprintf(stderr,
+              "a matrix moves the pages of an anonymous mmap, it can not be "
+              "used with -M, -f\nor the branch chase\n");
+      exit(1);
+    }
+  }
+
+  if (use_perf_events) {
+    if (use_sweep || use_matrix) {
+      fprintf(stderr, "-e can not be combined with a memory sweep or -G\n");
+      exit(1);
+    }
+    check_perf_events(&perf_events);
+  }
+
+  if (json_output && (verbosity > 0 || print_timestamp)) {
+    fprintf(stderr, "-J can not be combined with -v or -y\n");
+    exit(1);
+  }
+
+  if (use_histogram && !chase->hist_fn) {
+    fprintf(stderr, "-P is not supported by the %s chase\n",
+            chase->usage1);
+    exit(1);
+  }
+
   if (verbosity > 0) {
     printf("nr_mixer_indices = %zu\n", genchase_args.nr_mixer_indices);
     printf("base_object_size = %zu\n", chase->base_object_size);
     printf("nr_threads = %zu\n", nr_threads);
     print_page_size(page_size, use_thp);
+    printf("timer = %s", timer_source());
+    if (timer_ghz() > 0.) printf(" (%.3f GHz)", timer_ghz());
+    printf("\n");
     printf("total_memory = %zu (%.1f MiB)\n", genchase_args.total_memory,
            genchase_args.total_memory / (1024. * 1024.));
     printf("stride = %zu\n", genchase_args.stride);
     printf("tlb_locality = %zu\n", genchase_args.tlb_locality);
+    printf("seed = %" PRIu64 "\n", rng_seed);
+    printf("nr_chase_workers = %zu\n", nr_chase_workers);
+    if (genchase_args.keyed) printf("keyed chase\n");
+    if (pattern_optarg) printf("pattern = %s\n", pattern_optarg);
+    if (chase_image_path) printf("chase image = %s\n", chase_image_path);
+    if (use_placement) print_placement(&placement);
+    if (use_perf_events) {
+      printf("perf events =");
+      for (i = 0; i < perf_events.nr; ++i) {
+        printf(" %s", perf_events.event[i].name);
+      }
+      printf("\n");
+    }
     printf("chase = %s\n", chase_optarg);
     if (use_malloc) printf("malloc allocation\n");
   }
 
+  if (json_output) {
+    json_host_record("multichase");
+    json_record("multichase", "config");
+    json_string("chase", chase_optarg);
+    json_uint("nr_threads", nr_threads);
+    if (use_sweep) {
+      json_uint("sweep_low", sweep.low);
+      json_uint("sweep_high", sweep.high);
+      if (sweep.increment) {
+        json_uint("sweep_increment", sweep.increment);
+      } else {
+        json_double("sweep_factor", sweep.factor);
+      }
+    } else {
+      json_uint("total_memory", genchase_args.total_memory);
+    }
+    json_uint("stride", genchase_args.stride);
+    json_uint("tlb_locality", genchase_args.tlb_locality);
+    json_uint("page_size", page_size);
+    json_bool("thp", use_thp);
+    json_bool("malloc", use_malloc);
+    json_bool("ordered",
+              genchase_args.gen_permutation == gen_ordered_permutation);
+    json_bool("keyed", genchase_args.keyed);
+    json_bool("longer_chase", use_longer_chase);
+    if (pattern_optarg) json_string("pattern", pattern_optarg);
+    json_uint("seed", rng_seed);
+    json_uint("offset", offset);
+    json_uint("cache_flush_size", cache_flush_size);
+    json_uint("nr_samples", nr_samples);
+    json_uint("sample_ns", DELAY_USECS * NSECS_PER_USEC);
+    if (ci_target > 0.) {
+      json_double("ci_target", ci_target);
+      json_double("ci_max_secs", ci_max_secs);
+    }
+    json_string("statistic", print_average ? "average" : "best");
+    json_bool("affinity", set_thread_affinity);
+    if (placement_optarg) json_string("placement", placement_optarg);
+    if (chase_image_path) json_string("chase_image", chase_image_path);
+    if (use_perf_events) {
+      json_array("perf_events");
+      for (i = 0; i < perf_events.nr; ++i) {
+        json_string(NULL, perf_events.event[i].name);
+      }
+      json_end();
+    }
+    json_end_record();
+  }
+
+  set_chase_workers(nr_chase_workers);
   rng_init(1);
 
+  uint64_t phase_start = now_nsec();
   generate_chase_mixer(&genchase_args, nr_threads * chase->parallelism);
+  phase_ns.mixer = now_nsec() - phase_start;
 
   // generate the chases by launching multiple threads
+  phase_start = now_nsec();
   if (use_malloc) {
     genchase_args.arena = (char *)malloc(genchase_args.total_memory + offset) +
         offset;
@@ -846,17 +2098,54 @@ int main(int argc, char **argv) {
                                  genchase_args.total_memory + offset, fd) +
         offset;
   }
+  phase_ns.alloc = now_nsec() - phase_start;
+  // with a single chase worker the pinned chase threads first touch their
+  // chases, as the load threads do their buffers
+  if (!use_malloc && fd == -1 && nr_chase_workers > 1) {
+    phase_start = now_nsec();
+    arena_prefault(genchase_args.arena - offset,
+                   genchase_args.total_memory + offset, page_size, true);
+    phase_ns.fault = now_nsec() - phase_start;
+  }
+  if (chase_image_path) {
+    snprintf(chase_image_config, sizeof(chase_image_config),
+             "multichase c=%s m=%zu s=%zu T=%zu t=%zu r=%" PRIu64
+             " k=%d L=%d o=%d z=%s",
+             chase_optarg, genchase_args.total_memory, genchase_args.stride,
+             genchase_args.tlb_locality, nr_threads, rng_seed,
+             genchase_args.keyed, use_longer_chase,
+             genchase_args.gen_permutation == gen_ordered_permutation,
+             pattern_optarg ? pattern_optarg : "");
+    nr_chase_heads = nr_threads * chase->parallelism;
+    chase_heads = calloc(nr_chase_heads, sizeof(*chase_heads));
+    if (chase_heads == NULL) {
+      fprintf(stderr, "Could not allocate chase heads\n");
+      exit(1);
+    }
+    chase_image_loaded = chase_image_load(
+        chase_image_path, chase_image_config, genchase_args.arena,
+        genchase_args.total_memory, chase_heads, nr_chase_heads);
+    if (!chase_image_loaded &&
+        pthread_barrier_init(&chase_image_barrier, NULL, nr_threads)) {
+      perror("pthread_barrier_init");
+      exit(1);
+    }
+  }
+  phase_start = now_nsec();
   per_thread_t *thread_data = alloc_arena_mmap(
       default_page_size, false, nr_threads * sizeof(per_thread_t), -1);
   void *flush_arena = NULL;
   if (cache_flush_size) {
     flush_arena = alloc_arena_mmap(default_page_size, false, cache_flush_size,
                                    -1);
-    memset(flush_arena, 1, cache_flush_size);  // ensure pages are mapped
+  }
+  phase_ns.alloc += now_nsec() - phase_start;
+  if (cache_flush_size) {
+    phase_start = now_nsec();
+    arena_prefault(flush_arena, cache_flush_size, default_page_size, true);
+    phase_ns.fault += now_nsec() - phase_start;
   }
 
-  pthread_t thread;
-  nr_to_startup = nr_threads;
   for (i = 0; i < nr_threads; ++i) {
     thread_data[i].x.genchase_args = &genchase_args;
     thread_data[i].x.nr_threads = nr_threads;
@@ -866,86 +2155,64 @@ int main(int argc, char **argv) {
     thread_data[i].x.flush_arena = flush_arena;
     thread_data[i].x.cache_flush_size = cache_flush_size;
     thread_data[i].x.use_longer_chase = use_longer_chase;
-    if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
-      perror("pthread_create");
-      exit(1);
-    }
+    thread_data[i].x.hist = use_histogram ? histogram_alloc() : NULL;
   }
 
-  // now wait for them all to finish generating their chases and start chasing
-  pthread_mutex_lock(&wait_mutex);
-  if (nr_to_startup) {
-    pthread_cond_wait(&wait_cond, &wait_mutex);
+  if (ci_target > 0.) {
+    nr_samples = 0;
+    duration_nsecs = ci_max_secs * NSECS_PER_SEC;
   }
-  pthread_mutex_unlock(&wait_mutex);
-
-  // now start sampling their progress
- if (!duration_nsecs)
+  if (!duration_nsecs)
     duration_nsecs = nr_samples * DELAY_USECS * NSECS_PER_USEC;
-  nr_samples = nr_samples + 1;  // we drop the first sample
-  uint64_t *cur_samples = alloca(nr_threads * sizeof(*cur_samples));
-  uint64_t last_sample_time = now_nsec();
-  uint64_t start_time = last_sample_time;
-  uint64_t total = 0;
-  uint64_t stalls = 0;
-  double best = 1. / 0.;
-  double running_sum = 0.;
-  if (verbosity > 0)
-    printf("samples (one column per thread, one row per sample):\n");
-  for (size_t sample_no = 0; nr_samples == 1 || sample_no < nr_samples;
-       ++sample_no) {
-    usleep(DELAY_USECS);
 
-    uint64_t sum = 0;
-    for (i = 0; i < nr_threads; ++i) {
-      cur_samples[i] = __sync_lock_test_and_set(&thread_data[i].x.count, 0);
-      sum += cur_samples[i];
-    }
-
-    uint64_t cur_sample_time = now_nsec();
-    uint64_t time_delta = cur_sample_time - last_sample_time;
-    last_sample_time = cur_sample_time;
+  if (use_matrix) {
+    size_t pagemask = page_size - 1;
+    matrix_chases(thread_data, nr_threads, genchase_args.arena - offset,
+                  (genchase_args.total_memory + offset + pagemask) & ~pagemask,
+                  nr_samples, duration_nsecs, print_average);
+    exit(0);
+  }
 
-    // we drop the first sample because it's fairly likely one
-    // thread had some advantage initially due to still having
-    // portions of the chase in a cache.
-    if (sample_no == 0) continue;
+  if (use_mlp_sweep) {
+    mlp_sweep(thread_data, nr_threads, &genchase_args, mlp_max, nr_samples,
+              duration_nsecs, print_average);
+    exit(0);
+  }
 
-    if (verbosity > 0) {
-      timestamp();
-      for (i = 0; i < nr_threads; ++i) {
-        double z = time_delta / (double)cur_samples[i];
-        printf(" %6.*f", z < 100. ? 3 : 1, z);
-      }
-    }
+  if (use_sweep) {
+    sweep_chases(thread_data, nr_threads, &genchase_args, &sweep, nr_samples,
+                 duration_nsecs, print_average);
+    exit(0);
+  }
 
-    total += sum;
-    if (!sum)
-      stalls++;
-    double t = time_delta / (double)sum;
-    running_sum += t;
-    if (t < best) {
-      best = t;
-    }
-    if (verbosity > 0) {
-      double z = t * nr_threads;
-      printf("  avg=%.*f\n", z < 100. ? 3 : 1, z);
-    }
+  pthread_t *threads = alloca(nr_threads * sizeof(*threads));
+  start_chase_threads(thread_data, nr_threads, threads);
 
-    if (last_sample_time - start_time > duration_nsecs) {
-      printf("timed out: %lu samples, %lu stalls, %lu iterations per msec\n",
-             sample_no, stalls, total * NSECS_PER_MSEC / duration_nsecs);
-      break;
+  // now start sampling their progress
+  double res = sample_chases(thread_data, nr_threads, nr_samples,
+                             duration_nsecs, print_average, NULL);
+  // the join orders the threads' last histogram_add() before our reads
+  if (use_histogram) stop_chase_threads(thread_data, threads, nr_threads);
+  if (json_output) {
+    json_record("multichase", "result");
+    json_double("ns_per_load", res);
+    json_string("statistic", print_average ? "average" : "best");
+    if (ci_target > 0.) {
+      json_uint("nr_samples", last_nr_samples);
+      json_double("ci", last_ci);
     }
+    if (use_histogram) json_histograms(thread_data, nr_threads);
+    json_end_record();
+    exit(0);
   }
   timestamp();
-  double res;
-  if (print_average) {
-    res = running_sum * nr_threads / (nr_samples - 1);
-  } else {
-    res = best * nr_threads;
+  printf("%6.*f", res < 100. ? 3 : 1, res);
+  if (ci_target > 0.) {
+    printf(" (ci %.2f%%, %zu samples)", 100. * last_ci, last_nr_samples);
   }
-  printf("%6.*f\n", res < 100. ? 3 : 1, res);
+  printf("\n");
+
+  if (use_histogram) print_histograms(thread_data, nr_threads);
 
   exit(0);
 }
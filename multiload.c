@@ -18,20 +18,31 @@
 #include <math.h>
 #include <pthread.h>
 #include <sched.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "arena.h"
+#include "chase_image.h"
 #include "cpu_util.h"
 #include "expand.h"
+#include "histogram.h"
+#include "json_out.h"
+#include "metrics.h"
+#include "perf_counters.h"
 #include "permutation.h"
+#include "simd_kernels.h"
 #include "timer.h"
+#include "topology.h"
 #include "util.h"
+#include "workers.h"
 
 #if defined(__x86_64__)
 #include <emmintrin.h>
@@ -59,20 +70,48 @@
 #define DEF_NR_THREADS ((size_t)1)
 #define DEF_CACHE_FLUSH ((size_t)64 * 1024 * 1024)
 #define DEF_OFFSET ((size_t)0)
+#define DEF_SEED ((uint64_t)1)
+#define DEF_NR_CHASE_WORKERS ((size_t)1)
 #define DEF_DELAY ((size_t)1)
 #define DEF_CACHELINE ((size_t)64)
+#define MAX_KNEE_POINTS 8  // extra delays measured where a delay sweep bends
+#define KNEE_MIN_DISTANCE 0.05  // don't bother once neighbours are this close
 
 #define LOAD_DELAY_WARMUP_uS \
   4000000  // Latency & Load thread warmup before data sampling starts
-#define LOAD_DELAY_RUN_uS 2000000  // Data sampling request frequency
+#define LOAD_DELAY_RUN_uS 2000000  // Default sample interval (-i)
 #define LOAD_DELAY_SAMPLE_uS \
   10000  // Data sample polling loop delay waiting for load threads to update
          // mutex variable
 
 typedef enum { RUN_CHASE, RUN_BANDWIDTH, RUN_CHASE_LOADED } test_type_t;
+
+// the mix memload: rd reads then wr writes of width bytes each, stride bytes
+// apart.  reads and writes walk separate regions sized by the ratio.
+struct mix_args {
+  size_t rd;
+  size_t wr;
+  size_t width;   // 8, 16, 32 or 64
+  size_t stride;  // a multiple of 8, at least width
+  bool nt;        // nontemporal stores
+};
+
+// the gups memload: random 64 byte accesses over the load buffer, upd% of
+// them read-modify-writes.  every pass generates the addresses of a batch
+// before touching any of them.  with depth=N there are N chains whose next
+// batch depends on the data of their previous one, so at most N * batch
+// accesses are outstanding; depth=0 leaves the addresses independent.
+#define GUPS_MAX_BATCH 64
+#define GUPS_MAX_DEPTH 32
+struct gups_args {
+  size_t upd;    // percent of the accesses that are updates
+  size_t batch;  // addresses generated ahead of their accesses
+  size_t depth;  // dependent chains, 0 for independent addresses
+};
 static volatile uint64_t use_result_dummy = 0x0123456789abcdef;
 
 static size_t default_page_size;
+static uint64_t sample_interval_usecs = LOAD_DELAY_RUN_uS;
 static size_t page_size;
 static bool use_thp;
 int verbosity;
@@ -89,6 +128,22 @@ uint16_t mbind_weights[MAX_MEM_NODES];
 // forward declare
 typedef struct chase_t chase_t;
 
+// bytes a load thread has moved so far and when, published seqlock style:
+// seq is odd while the thread updates the pair.
+struct load_progress {
+  uint64_t seq;
+  uint64_t bytes;
+  uint64_t nsec;
+};
+
+// -R: a load thread holds its rate by waiting after every chunk until the
+// chunk's share of time has passed.  threads with one total rate share a
+// pacer, so the faster ones make up for the slower ones.
+struct load_pacer {
+  uint64_t next_ns;             // when the next chunk may start
+  volatile double ns_per_byte;  // 0 while not throttled
+};
+
 // the arguments for the chase threads
 typedef union {
   char pad[AVOID_FALSE_SHARING];
@@ -96,39 +151,90 @@ typedef union {
     unsigned thread_num;        // which thread is this
     volatile uint64_t count;    // return thread measurement - need 64 bits when
                                 // passing bandwidth
+    int stop;                   // the chase is done, before the histograms
     void *cycle[MAX_PARALLEL];  // initial address for the chases
     const char *extra_args;
     int dummy;  // useful for confusing the compiler
 
     const struct generate_chase_common_args *genchase_args;
     size_t nr_threads;
+    size_t nr_chase_threads;  // threads 0 .. nr_chase_threads-1 chase
     const chase_t *chase;
+    struct histogram *hist;  // per block latencies, NULL unless -P
     void *flush_arena;
     size_t cache_flush_size;
     bool use_longer_chase;
     test_type_t run_test_type;  // test type: chase or memory bandwidth
     const chase_t *memload;     // memory bandwidth function
+    const struct simd_kernel *simd_kernel;  // kernel of the simd-* memloads
+    const struct mix_args *mix;             // arguments of the mix memload
+    const struct gups_args *gups;           // arguments of the gups memload
     char *load_arena;           // load memory buffer used by this thread
     size_t load_total_memory;   // load size of the arena
     size_t load_offset;         // load offset of the arena
+    const struct mem_policy *load_policy;  // -B policy of the load arena
     size_t load_tlb_locality;   // group accesses within this range in order to
                                 // amortize TLB fills
-    volatile size_t sample_no;  // flag from main thread to tell bandwdith
-                                // thread to start the next sample.
-    size_t delay;               // injection delay for load
+    volatile size_t delay;      // injection delay for load, a delay sweep
+                                // changes it while the load runs
+    pid_t tid;                  // for perf_event_open
+    pthread_t thread;           // to park it between probes (-D)
+    // written only by a load thread, in a line of its own so that the main
+    // thread reading it doesn't disturb the thread's other fields
+    struct load_progress progress __attribute__((aligned(DEF_CACHELINE)));
+    struct load_pacer *pacer;  // -R, NULL unless the load is throttled
+    struct load_pacer pace __attribute__((aligned(DEF_CACHELINE)));
   } x;
 } per_thread_t;
 
 int always_zero;
 
+// count the loads of a block and keep going until the chase is stopped.
+// stop shares the line of count, so polling it costs no extra miss.
+static inline int chase_continue(per_thread_t *t, unsigned loads) {
+  __sync_add_and_fetch(&t->x.count, loads);
+  return !__atomic_load_n(&t->x.stop, __ATOMIC_ACQUIRE);
+}
+
 static void chase_simple(per_thread_t *t) {
   void *p = t->x.cycle[0];
 
   do {
     x200(p = *(void **)p;)
-  } while (__sync_add_and_fetch(&t->x.count, 200));
+  } while (chase_continue(t, 200));
+
+  // only reached when the chase is stopped
+  t->x.dummy = (uintptr_t)p;
+}
+
+// histogram versions of the chases take a timestamp after every block of
+// loads and record the block's time per load.  nothing in the chase depends
+// on the timer, so the timestamps stay off the dependency chain.  a block
+// may still be recorded after main clears hist_recording, so main stops the
+// chase threads before it reads the histograms.
+static int hist_recording;
+
+static inline void record_block(per_thread_t *t, uint64_t *last,
+                                unsigned nr_loads) {
+  uint64_t now = now_nsec();
+  if (__atomic_load_n(&hist_recording, __ATOMIC_ACQUIRE)) {
+    histogram_add(t->x.hist, (now - *last) * 1000 / nr_loads);  // ps
+  }
+  *last = now;
+}
+
+static void chase_simple_hist(per_thread_t *t) {
+  void *p = t->x.cycle[0];
+  uint64_t last = now_nsec();
+
+  do {
+    x200(p = *(void **)p;)
+    // don't let the compiler take the timestamp before the last load
+    asm volatile("" ::"r"(p));
+    record_block(t, &last, 200);
+  } while (chase_continue(t, 200));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when the chase is stopped
   t->x.dummy = (uintptr_t)p;
 }
 
@@ -136,6 +242,7 @@ static void chase_simple(per_thread_t *t) {
 
 #define declare(i) void *p##i = start[i];
 #define cleanup(i) tmp += (uintptr_t)p##i;
+#define use(i) asm volatile("" ::"r"(p##i));
 #if MAX_PARALLEL == 6
 #define parallel(foo) foo(0) foo(1) foo(2) foo(3) foo(4) foo(5)
 #else
@@ -143,15 +250,29 @@ static void chase_simple(per_thread_t *t) {
   foo(0) foo(1) foo(2) foo(3) foo(4) foo(5) foo(6) foo(7) foo(8) foo(9)
 #endif
 
-#define template(n, expand, inner)                        \
-  static void chase_parallel##n(per_thread_t *t) {        \
-    void **start = t->x.cycle;                            \
-    parallel(declare) do { x##expand(inner) }             \
-    while (__sync_add_and_fetch(&t->x.count, n * expand)) \
-      ;                                                   \
-                                                          \
-    uintptr_t tmp = 0;                                    \
-    parallel(cleanup) t->x.dummy = tmp;                   \
+#define template(n, expand, inner)                           \
+  static void chase_parallel##n(per_thread_t *t) {           \
+    void **start = t->x.cycle;                               \
+    parallel(declare) do { x##expand(inner) }                \
+    while (chase_continue(t, n * expand))                    \
+      ;                                                      \
+                                                             \
+    uintptr_t tmp = 0;                                       \
+    parallel(cleanup) t->x.dummy = tmp;                      \
+  }                                                          \
+                                                             \
+  static void chase_parallel##n##_hist(per_thread_t *t) {    \
+    void **start = t->x.cycle;                               \
+    uint64_t last = now_nsec();                              \
+    parallel(declare) do {                                   \
+      x##expand(inner) parallel(use)                         \
+      record_block(t, &last, n * expand);                    \
+    }                                                        \
+    while (chase_continue(t, n * expand))                    \
+      ;                                                      \
+                                                             \
+    uintptr_t tmp = 0;                                       \
+    parallel(cleanup) t->x.dummy = tmp;                      \
   }
 
 #if defined(__x86_64__) || defined(__i386__)
@@ -172,6 +293,7 @@ template(10, 20, D(0) D(1) D(2) D(3) D(4) D(5) D(6) D(7) D(8) D(9));
 #endif
 #undef D
 #undef parallel
+#undef use
 #undef cleanup
 #undef declare
 
@@ -189,9 +311,9 @@ static void chase_work(per_thread_t *t) {
   do {
     x25(work += (uintptr_t)p; p = *(void **)p;
         for (i = 0; i < extra_work; ++i) { work ^= i; })
-  } while (__sync_add_and_fetch(&t->x.count, 25));
+  } while (chase_continue(t, 25));
 
-  // we never actually reach here, but the compiler doesn't know that
+  // only reached when the chase is stopped
   t->x.cycle[0] = p;
   t->x.dummy = work;
 }
@@ -206,9 +328,71 @@ static void chase_incr(per_thread_t *t) {
 
   do {
     x50(++p->incme; p = *(void **)p;)
-  } while (__sync_add_and_fetch(&t->x.count, 50));
+  } while (chase_continue(t, 50));
+
+  // only reached when the chase is stopped
+  t->x.cycle[0] = p;
+}
+
+// every deref is an atomic add of 0, so the next pointer isn't known until
+// the line is owned: the latency of a read for ownership.  with several
+// threads and a 64 byte stride the threads share every line, so each hop
+// takes a line last written by another core.
+static void chase_rfo(per_thread_t *t) {
+  void *p = t->x.cycle[0];
+
+  do {
+    x100(p = (void *)__sync_fetch_and_add((uintptr_t *)p, 0);)
+  } while (chase_continue(t, 100));
+
+  // only reached when the chase is stopped
+  t->x.cycle[0] = p;
+}
+
+// a store to a second line after each deref.  the stores don't delay the
+// chase until the store buffer fills with misses, then the chase runs at
+// the rate lines can be owned and written.
+static void chase_store(per_thread_t *t) {
+  struct store_struct *p = t->x.cycle[0];
 
-  // we never actually reach here, but the compiler doesn't know that
+  do {
+    x50(p->stored = (uintptr_t)p; p = p->next;)
+  } while (chase_continue(t, 50));
+
+  // only reached when the chase is stopped
+  t->x.cycle[0] = p;
+}
+
+struct dirty_struct {
+  struct dirty_struct *next;
+  uintptr_t dirty;
+};
+
+// the word to write after visiting p: its own line for the lines picked by
+// a hash of their address (the same ones every lap), otherwise a scratch
+// word.  selected without a branch.
+static inline uintptr_t *dirty_target(struct dirty_struct *p, uint64_t limit,
+                                      uintptr_t *scratch) {
+  uint32_t h = ((uintptr_t)p / CACHELINE_SIZE) * 2654435761u;
+  uintptr_t sel = -(uintptr_t)(h < limit);
+
+  return (uintptr_t *)(((uintptr_t)&p->dirty & sel) |
+                       ((uintptr_t)scratch & ~sel));
+}
+
+// write N% of the lines after their deref and leave the rest clean, so
+// evicting them costs a writeback.
+static void chase_dirty(per_thread_t *t) {
+  struct dirty_struct *p = t->x.cycle[0];
+  uint64_t limit =
+      strtoul(t->x.extra_args, 0, 0) * ((uint64_t)1 << 32) / 100;
+  uintptr_t scratch[1];
+
+  do {
+    x50(*dirty_target(p, limit, scratch) = (uintptr_t)p; p = p->next;)
+  } while (chase_continue(t, 50));
+
+  // only reached when the chase is stopped
   t->x.cycle[0] = p;
 }
 
@@ -220,9 +404,9 @@ static void chase_incr(per_thread_t *t) {
     do {                                                                   \
       x100(asm volatile("prefetch" #type " %0" ::"m"(*(void **)p));        \
            p = *(void **)p;)                                               \
-    } while (__sync_add_and_fetch(&t->x.count, 100));                      \
+    } while (chase_continue(t, 100));                                      \
                                                                            \
-    /* we never actually reach here, but the compiler doesn't know that */ \
+    /* only reached when the chase is stopped */                           \
     t->x.cycle[0] = p;                                                     \
   }
 chase_prefetch(t0);
@@ -247,7 +431,7 @@ static void chase_movdqa(per_thread_t *t) {
                       "\n     movq %%xmm0,%%rax"
                       : "=a"(p)
                       : "0"(p));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
   t->x.cycle[0] = p;
 }
 
@@ -277,7 +461,7 @@ static void chase_movntdqa(per_thread_t *t) {
 #endif
              : "=a"(p)
              : "0"(p));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
   t->x.cycle[0] = p;
 }
 
@@ -293,7 +477,7 @@ static void chase_critword2(per_thread_t *t) {
          asm volatile("mov (%1),%0"
                       : "=r"(q)
                       : "r"(q));)
-  } while (__sync_add_and_fetch(&t->x.count, 100));
+  } while (chase_continue(t, 100));
 
   t->x.cycle[0] = (void *)((uintptr_t)p + (uintptr_t)q);
 }
@@ -301,17 +485,20 @@ static void chase_critword2(per_thread_t *t) {
 
 struct chase_t {
   void (*fn)(per_thread_t *t);
+  void (*hist_fn)(per_thread_t *t);  // histogram version (-P), if any
   size_t base_object_size;
   const char *name;
   const char *usage1;
   const char *usage2;
   int requires_arg;
+  int optional_arg;      // an argument may be given but isn't required
   unsigned parallelism;  // number of parallel chases (at least 1)
 };
 static const chase_t chases[] = {
     // the default must be first
     {
         .fn = chase_simple,
+        .hist_fn = chase_simple_hist,
         .base_object_size = sizeof(void *),
         .name = "simple    ",
         .usage1 = "simple",
@@ -321,10 +508,11 @@ static const chase_t chases[] = {
     },
     {
         .fn = chase_simple,
+        .hist_fn = chase_simple_hist,
         .base_object_size = sizeof(void *),
         .name = "chaseload",
-        .usage1 = "chaseload",
-        .usage2 = "runs simple chase with multiple memory bandwidth loads",
+        .usage1 = "chaseload[:N]",
+        .usage2 = "runs N (default 1) simple chases with memory bandwidth loads",
         .requires_arg = 0,
         .parallelism = 1,
     },
@@ -346,6 +534,35 @@ static const chase_t chases[] = {
         .requires_arg = 0,
         .parallelism = 1,
     },
+    {
+        .fn = chase_rfo,
+        .base_object_size = sizeof(void *),
+        .name = "rfo",
+        .usage1 = "rfo",
+        .usage2 = "atomically add 0 to each pointer, i.e. own the line "
+                  "before the next deref",
+        .requires_arg = 0,
+        .parallelism = 1,
+    },
+    {
+        .fn = chase_store,
+        .base_object_size = sizeof(struct store_struct),
+        .name = "store",
+        .usage1 = "store",
+        .usage2 = "store to a second line after each deref",
+        .requires_arg = 0,
+        .parallelism = 1,
+    },
+    {
+        .fn = chase_dirty,
+        .base_object_size = sizeof(struct dirty_struct),
+        .name = "dirty",
+        .usage1 = "dirty:N",
+        .usage2 = "keep N% of the lines dirty by writing them after their "
+                  "deref",
+        .requires_arg = 1,
+        .parallelism = 1,
+    },
 #if defined(__x86_64__) || defined(__i386__)
 #define chase_prefetch(type)                                        \
   {                                                                 \
@@ -381,7 +598,8 @@ static const chase_t chases[] = {
 #endif
 #define PAR(n)                                                        \
   {                                                                   \
-    .fn = chase_parallel##n, .base_object_size = sizeof(void *),      \
+    .fn = chase_parallel##n, .hist_fn = chase_parallel##n##_hist,     \
+    .base_object_size = sizeof(void *),                               \
     .name = "parallel" #n, .usage1 = "parallel" #n,                   \
     .usage2 = "alternate " #n " non-dependent chases in each thread", \
     .parallelism = n,                                                 \
@@ -411,6 +629,7 @@ static const chase_t chases[] = {
 #endif
     {
         .fn = chase_simple,
+        .hist_fn = chase_simple_hist,
         .base_object_size = 64,
         .name = "critword",
         .usage1 = "critword:N",
@@ -423,54 +642,92 @@ static const chase_t chases[] = {
 //========================================================================================================
 // Memory Bandwidth load generation
 //========================================================================================================
-#define LOAD_MEMORY_INIT_MIBPS                             \
-  register uint64_t loops = 0;                             \
-  size_t cur_sample = -1, nxt_sample = 0;                  \
-  double time0, time1, timetot;                            \
-  double bite_sum = 0, mibps = 0; /*mibps = MiB per sec.*/ \
-  time0 = (double)now_nsec();
-
-#define LOAD_MEMORY_SAMPLE_MIBPS                                             \
-  loops++;                                                                   \
-  /* Main thread will increment x.sample_no when it wants a sample. */       \
-  nxt_sample = t->x.sample_no;                                               \
-  /* printf("T(%d)%ld:%ld,%ld ", t->x.thread_num, cur_sample, nxt_sample,    \
-   * t->x.count ); */                                                        \
-  /* if ( (loops&0xF)==0xf ) printf("T(%d)%ld:%ld,%ld ", t->x.thread_num,    \
-   * cur_sample, nxt_sample, t->x.count ); */                                \
-  if ((cur_sample != nxt_sample) && (t->x.count == 0)) {                     \
-    time1 = (double)now_nsec();                                              \
-    bite_sum = loops * load_bites;                                           \
-    timetot = time1 - time0;                                                 \
-    mibps = (bite_sum * 1000000000.0) / (timetot * 1024 * 1024);             \
-    /* printf(" T(%d)=%.0f:%ld:%ld ", t->x.thread_num, mibps, cur_sample,    \
-     * nxt_sample ); */                                                      \
-    /* printf(" %ld,%ld,%ld,%.0f:%.0f(%.1fMiBs)\n", cur_sample, loops,       \
-     * t->x.count, bite_sum, timetot, mibps); */                             \
-    /* update the MiB/s count. Main thread will read and set to 0 so we know \
-     * this sample is done. */                                               \
-    __sync_add_and_fetch(&t->x.count, (uint64_t)mibps);                      \
-    cur_sample = nxt_sample;                                                 \
-    loops = 0;                                                               \
-    time0 = (double)now_nsec();                                              \
+// a load publishes its progress after every chunk of at most
+// LOAD_CHUNK_BYTES, so the main thread can sample it at any time and at
+// any interval no matter how large the buffer is.
+#define LOAD_CHUNK_BYTES ((uint64_t)1 << 20)
+// with -R the chunks are smaller, so that a throttled load doesn't alternate
+// between long bursts and long pauses
+#define LOAD_PACED_CHUNK_BYTES ((uint64_t)64 << 10)
+#define LOAD_PACE_MAX_DEBT_NS 1000000  // time lost a pacer catches up on
+#define LOAD_PACE_SPIN_NS 100000       // sleep through longer waits
+#define RATE_PEAK_SAMPLES 2            // measuring the peak for -R N%
+static uint64_t load_chunk_bytes = LOAD_CHUNK_BYTES;
+
+static void publish_progress(struct load_progress *p, uint64_t bytes) {
+  uint64_t seq = p->seq;
+
+  __atomic_store_n(&p->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&p->bytes, bytes, __ATOMIC_RELAXED);
+  __atomic_store_n(&p->nsec, now_nsec(), __ATOMIC_RELAXED);
+  __atomic_store_n(&p->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void read_progress(const struct load_progress *p, uint64_t *bytes,
+                          uint64_t *nsec) {
+  uint64_t seq;
+
+  do {
+    seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE);
+    *bytes = __atomic_load_n(&p->bytes, __ATOMIC_RELAXED);
+    *nsec = __atomic_load_n(&p->nsec, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while ((seq & 1) || seq != __atomic_load_n(&p->seq, __ATOMIC_RELAXED));
+}
+
+// take the time of the bytes just moved on the pacer and wait for it
+static void pace_load(struct load_pacer *p, uint64_t bytes) {
+  double ns_per_byte = p->ns_per_byte;
+  uint64_t now, old, next;
+
+  if (ns_per_byte == 0.) return;
+  now = now_nsec();
+  do {
+    old = __atomic_load_n(&p->next_ns, __ATOMIC_RELAXED);
+    // don't burst to make up for a long stall (or the start)
+    next = old + LOAD_PACE_MAX_DEBT_NS < now ? now - LOAD_PACE_MAX_DEBT_NS
+                                             : old;
+    next += (uint64_t)(bytes * ns_per_byte);
+  } while (!__sync_bool_compare_and_swap(&p->next_ns, old, next));
+  while (now < next) {
+    if (next - now > LOAD_PACE_SPIN_NS) {
+      usleep((next - now - LOAD_PACE_SPIN_NS) / 1000);
+    } else {
+      cpu_relax();
+    }
+    now = now_nsec();
   }
+}
+
+#define LOAD_MEMORY_INIT uint64_t bytes_done = 0;
+
+#define LOAD_MEMORY_PROGRESS(bytes)               \
+  bytes_done += (bytes);                          \
+  publish_progress(&t->x.progress, bytes_done);   \
+  if (t->x.pacer) pace_load(t->x.pacer, (bytes));
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 //--------------------------------------------------------------------------------------------------------
 static void load_memcpy_libc(per_thread_t *t) {
 #define LOOP_OPS 2
   uint64_t load_loop = t->x.load_total_memory / LOOP_OPS;
-  uint64_t load_bites = load_loop * LOOP_OPS;
   register char *a = (char *)t->x.load_arena;
   register char *b = a + load_loop;
   register char *tmp;
+  uint64_t off, n;
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
     tmp = a;
     a = b;
     b = tmp;
-    memcpy((void *)a, (void *)b, load_loop);
-    LOAD_MEMORY_SAMPLE_MIBPS
+    for (off = 0; off < load_loop; off += n) {
+      n = MIN(load_chunk_bytes, load_loop - off);
+      memcpy((void *)(a + off), (void *)(b + off), n);
+      LOAD_MEMORY_PROGRESS(n * LOOP_OPS)
+    }
   } while (1);
 #undef LOOP_OPS
 }
@@ -480,11 +737,15 @@ static void load_memset_libc(per_thread_t *t) {
 #define LOOP_OPS 1
   uint64_t load_bites = t->x.load_total_memory * LOOP_OPS;
   register char *a = (char *)t->x.load_arena;
+  uint64_t off, n;
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
-    memset((void *)a, 0xdeadbeef, load_bites);
-    LOAD_MEMORY_SAMPLE_MIBPS
+    for (off = 0; off < load_bites; off += n) {
+      n = MIN(load_chunk_bytes, load_bites - off);
+      memset((void *)(a + off), 0xdeadbeef, n);
+      LOAD_MEMORY_PROGRESS(n)
+    }
   } while (1);
 #undef LOOP_OPS
 }
@@ -494,11 +755,15 @@ static void load_memsetz_libc(per_thread_t *t) {
 #define LOOP_OPS 1
   uint64_t load_bites = t->x.load_total_memory * LOOP_OPS;
   register char *a = (char *)t->x.load_arena;
+  uint64_t off, n;
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
-    memset((void *)a, 0, load_bites);
-    LOAD_MEMORY_SAMPLE_MIBPS
+    for (off = 0; off < load_bites; off += n) {
+      n = MIN(load_chunk_bytes, load_bites - off);
+      memset((void *)(a + off), 0, n);
+      LOAD_MEMORY_PROGRESS(n)
+    }
   } while (1);
 #undef LOOP_OPS
 }
@@ -507,8 +772,9 @@ static void load_memsetz_libc(per_thread_t *t) {
 static void load_stream_triad(per_thread_t *t) {
 #define LOOP_OPS 3
 #define LOOP_ALIGN 16
-  uint64_t load_loop, load_bites;
+  uint64_t load_loop;
   register uint64_t N, i;
+  uint64_t j, end;
   register double *a;
   register double *b;
   register double *c;
@@ -521,7 +787,6 @@ static void load_stream_triad(per_thread_t *t) {
               ~(LOOP_ALIGN - 1);  // divide by 3 buffers and align byte count on
                                   // LOOP_ALIGN byte multiple
   N = load_loop / sizeof(double);
-  load_bites = N * sizeof(double) * LOOP_OPS;
   size_t aa = (((size_t)t->x.load_arena + LOOP_ALIGN) &
                ~(LOOP_ALIGN));  // align on 16 byte address
   a = (double *)aa;
@@ -534,17 +799,20 @@ static void load_stream_triad(per_thread_t *t) {
         (char *)t->x.load_arena, t->x.load_total_memory, load_loop, N, a, b, c);
   }
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
     tmp = a;
     a = b;
     b = c;
     c = tmp;
 
-    for (i = 0; i < N; ++i) {
-      a[i] = b[i] + c[i];
+    for (j = 0; j < N; j = end) {
+      end = MIN(j + load_chunk_bytes / sizeof(double), N);
+      for (i = j; i < end; ++i) {
+        a[i] = b[i] + c[i];
+      }
+      LOAD_MEMORY_PROGRESS((end - j) * sizeof(double) * LOOP_OPS)
     }
-    LOAD_MEMORY_SAMPLE_MIBPS
   } while (1);
 #undef LOOP_OPS
 #undef LOOP_ALIGN
@@ -561,8 +829,9 @@ static inline void delay_until_iteration(uint64_t iteration) {
 static void load_stream_triad_nontemporal_injection_delay(per_thread_t *t) {
 #define LOOP_OPS 3
 #define LOOP_ALIGN 16
-  uint64_t load_loop, load_bites;
+  uint64_t load_loop;
   register uint64_t N, i;
+  uint64_t j, end;
   register uint64_t *a;
   register uint64_t *b;
   register uint64_t *c;
@@ -576,7 +845,6 @@ static void load_stream_triad_nontemporal_injection_delay(per_thread_t *t) {
               ~(LOOP_ALIGN - 1);  // divide by 3 buffers and align byte count on
                                   // LOOP_ALIGN byte multiple
   N = load_loop / sizeof(uint64_t);
-  load_bites = N * sizeof(uint64_t) * LOOP_OPS;
   size_t aa = (((size_t)t->x.load_arena + LOOP_ALIGN) &
                ~(LOOP_ALIGN));  // align on 16 byte address
   a = (uint64_t *)aa;
@@ -590,26 +858,30 @@ static void load_stream_triad_nontemporal_injection_delay(per_thread_t *t) {
         (char *)t->x.load_arena, t->x.load_total_memory, load_loop, N, a, b, c);
   }
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
     tmp = a;
     a = b;
     b = c;
     c = tmp;
 
-    for (i = 0; i < N; i += 2) {
-      if (i % num_elem_twocachelines == 0) delay_until_iteration(t->x.delay);
+    for (j = 0; j < N; j = end) {
+      const size_t delay = t->x.delay;
+      end = MIN(j + load_chunk_bytes / sizeof(uint64_t), N);
+      for (i = j; i < end; i += 2) {
+        if (i % num_elem_twocachelines == 0) delay_until_iteration(delay);
 #if defined(__aarch64__)
-      asm volatile ("stnp %0, %1, [%2]" :: "r"(b[i]+c[i]), "r"(b[i+1]+c[i+1]), "r" (a+i));
+        asm volatile ("stnp %0, %1, [%2]" :: "r"(b[i]+c[i]), "r"(b[i+1]+c[i+1]), "r" (a+i));
 #elif defined(__x86_64__)
-      _mm_stream_si64(&((long long*)a)[i], b[i]+c[i]);
-      _mm_stream_si64(&((long long*)a)[i+1], b[i+1]+c[i+1]);
+        _mm_stream_si64(&((long long*)a)[i], b[i]+c[i]);
+        _mm_stream_si64(&((long long*)a)[i+1], b[i+1]+c[i+1]);
 #else
-      a[i] = b[i] + c[i];
-      a[i+1] = b[i+1] + c[i+1];
+        a[i] = b[i] + c[i];
+        a[i+1] = b[i+1] + c[i+1];
 #endif
+      }
+      LOAD_MEMORY_PROGRESS((end - j) * sizeof(uint64_t) * LOOP_OPS)
     }
-    LOAD_MEMORY_SAMPLE_MIBPS
   } while (1);
 #undef LOOP_OPS
 #undef LOOP_ALIGN
@@ -620,21 +892,24 @@ static void load_stream_copy(per_thread_t *t) {
 #define LOOP_OPS 2
   uint64_t load_loop = t->x.load_total_memory / LOOP_OPS;
   register uint64_t N = load_loop / sizeof(double);
-  uint64_t load_bites = N * sizeof(double) * LOOP_OPS;
   register uint64_t i;
   register double *a = (double *)t->x.load_arena;
   register double *b = a + N;
   register double *tmp;
+  uint64_t j, end;
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
     tmp = a;
     a = b;
     b = tmp;
-    for (i = 0; i < N; ++i) {
-      b[i] = a[i];
+    for (j = 0; j < N; j = end) {
+      end = MIN(j + load_chunk_bytes / sizeof(double), N);
+      for (i = j; i < end; ++i) {
+        b[i] = a[i];
+      }
+      LOAD_MEMORY_PROGRESS((end - j) * sizeof(double) * LOOP_OPS)
     }
-    LOAD_MEMORY_SAMPLE_MIBPS
   } while (1);
 #undef LOOP_OPS
 }
@@ -644,22 +919,320 @@ static void load_stream_sum(per_thread_t *t) {
 #define LOOP_OPS 1
   uint64_t load_loop = t->x.load_total_memory / LOOP_OPS;
   register uint64_t N = load_loop / sizeof(uint64_t);
-  uint64_t load_bites = N * sizeof(uint64_t) * LOOP_OPS;
   register uint64_t i;
   register uint64_t *a = (uint64_t *)t->x.load_arena;
   register uint64_t s = 0;
+  uint64_t j, end;
 
-  LOAD_MEMORY_INIT_MIBPS
+  LOAD_MEMORY_INIT
   do {
-    for (i = 0; i < N; ++i) {
-      s += a[i];
+    for (j = 0; j < N; j = end) {
+      end = MIN(j + load_chunk_bytes / sizeof(uint64_t), N);
+      for (i = j; i < end; ++i) {
+        s += a[i];
+      }
+      LOAD_MEMORY_PROGRESS((end - j) * sizeof(uint64_t) * LOOP_OPS)
     }
-    LOAD_MEMORY_SAMPLE_MIBPS
     use_result_dummy += s;
   } while (1);
 #undef LOOP_OPS
 }
 
+//--------------------------------------------------------------------------------------------------------
+// hand written vector kernels, the isa is picked once at startup
+static void load_simd(per_thread_t *t) {
+  const struct simd_kernel *k = t->x.simd_kernel;
+  char *base = (char *)(((uintptr_t)t->x.load_arena + SIMD_KERNEL_ALIGN - 1) &
+                        ~(uintptr_t)(SIMD_KERNEL_ALIGN - 1));
+  size_t len = ((t->x.load_total_memory - (base - t->x.load_arena)) /
+                k->nr_streams) &
+               ~(size_t)(SIMD_KERNEL_ALIGN - 1);
+  uint64_t *s[3], *tmp;
+  size_t i, off, n;
+
+  // the first stream is the destination, rotate them like the stream loads
+  for (i = 0; i < 3; ++i) {
+    s[i] = (uint64_t *)(base + (i < k->nr_streams ? i : 0) * len);
+  }
+  if (verbosity > 1) {
+    printf("load_arena=%p, load_total_memory=0x%lX, len=0x%zX, kernel=%s:%s\n",
+           (char *)t->x.load_arena, t->x.load_total_memory, len, k->pattern,
+           k->isa);
+  }
+
+  LOAD_MEMORY_INIT
+  do {
+    tmp = s[0];
+    s[0] = s[1];
+    if (k->nr_streams > 2) {
+      s[1] = s[2];
+      s[2] = tmp;
+    } else {
+      s[1] = tmp;
+    }
+    for (off = 0; off < len; off += n) {
+      n = MIN(load_chunk_bytes, len - off);
+      use_result_dummy +=
+          k->fn(s[0] + off / sizeof(uint64_t), s[1] + off / sizeof(uint64_t),
+                s[2] + off / sizeof(uint64_t), n / sizeof(uint64_t));
+      LOAD_MEMORY_PROGRESS(n * k->nr_streams)
+    }
+  } while (1);
+}
+
+//--------------------------------------------------------------------------------------------------------
+static inline __attribute__((always_inline)) void mix_store(uint64_t *p,
+                                                            uint64_t v,
+                                                            size_t words,
+                                                            bool nt) {
+  size_t k;
+
+  if (!nt) {
+    for (k = 0; k < words; ++k) p[k] = v;
+    return;
+  }
+#if defined(__aarch64__)
+  // width=8 with nt is rejected by main, words is always even here.
+  for (k = 0; k < words; k += 2) {
+    asm volatile("stnp %0, %1, [%2]" ::"r"(v), "r"(v), "r"(p + k) : "memory");
+  }
+#elif defined(__x86_64__)
+  for (k = 0; k < words; ++k) _mm_stream_si64((long long *)p + k, v);
+#else
+  for (k = 0; k < words; ++k) p[k] = v;
+#endif
+}
+
+// rounds of the mix load, inlined with a constant width and nt so that
+// each variant gets its own loop.
+static inline __attribute__((always_inline)) uint64_t mix_pass(
+    const struct mix_args *m, char *r, char *w, size_t rounds, size_t width,
+    bool nt) {
+  const size_t words = width / sizeof(uint64_t);
+  uint64_t sum = 0;
+  size_t i, j, k;
+
+  for (i = 0; i < rounds; ++i) {
+    for (j = 0; j < m->rd; ++j) {
+      for (k = 0; k < words; ++k) sum += ((uint64_t *)r)[k];
+      r += m->stride;
+    }
+    for (j = 0; j < m->wr; ++j) {
+      mix_store((uint64_t *)w, i, words, nt);
+      w += m->stride;
+    }
+  }
+#if defined(__x86_64__)
+  if (nt) _mm_sfence();
+#endif
+  return sum;
+}
+
+#define MIX_PASS(width)                                 \
+  (m->nt ? mix_pass(m, r, w, n, width, true)            \
+         : mix_pass(m, r, w, n, width, false))
+
+static void load_mix(per_thread_t *t) {
+  const struct mix_args *m = t->x.mix;
+  const size_t round_bytes = m->stride * (m->rd + m->wr);
+  size_t rounds = t->x.load_total_memory / round_bytes;
+  size_t chunk =
+      load_chunk_bytes > round_bytes ? load_chunk_bytes / round_bytes : 1;
+  char *rd_base = t->x.load_arena;
+  char *wr_base = rd_base + rounds * m->rd * m->stride;
+  char *r, *w;
+  size_t done, n;
+
+  if (verbosity > 1) {
+    printf("load_arena=%p, load_total_memory=0x%lX, rounds=%zu, wr_base=%p\n",
+           (char *)t->x.load_arena, t->x.load_total_memory, rounds, wr_base);
+  }
+
+  LOAD_MEMORY_INIT
+  do {
+    for (done = 0; done < rounds; done += n) {
+      n = MIN(chunk, rounds - done);
+      r = rd_base + done * m->rd * m->stride;
+      w = wr_base + done * m->wr * m->stride;
+      switch (m->width) {
+        case 8:
+          use_result_dummy += MIX_PASS(8);
+          break;
+        case 16:
+          use_result_dummy += MIX_PASS(16);
+          break;
+        case 32:
+          use_result_dummy += MIX_PASS(32);
+          break;
+        default:
+          use_result_dummy += MIX_PASS(64);
+          break;
+      }
+      // bytes referenced, with a stride wider than the access the memory
+      // traffic is in whole lines
+      LOAD_MEMORY_PROGRESS(n * (m->rd + m->wr) * m->width)
+    }
+  } while (1);
+}
+#undef MIX_PASS
+
+// parse "rd=N,wr=N,width=B,stride=B,nt", every field is optional
+static int parse_mix_args(const char *str, struct mix_args *m) {
+  char *copy = strdup(str ? str : "");
+  char *tok, *save = NULL, *val;
+  int rc = 0;
+
+  m->rd = 1;
+  m->wr = 1;
+  m->width = 8;
+  m->stride = 0;
+  m->nt = false;
+  for (tok = strtok_r(copy, ",", &save); tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    val = strchr(tok, '=');
+    if (val) *val++ = 0;
+    if (strcmp(tok, "nt") == 0 && val == NULL) {
+      m->nt = true;
+    } else if (val == NULL) {
+      rc = -1;
+    } else if (strcmp(tok, "rd") == 0) {
+      rc = parse_mem_arg(val, &m->rd);
+    } else if (strcmp(tok, "wr") == 0) {
+      rc = parse_mem_arg(val, &m->wr);
+    } else if (strcmp(tok, "width") == 0) {
+      rc = parse_mem_arg(val, &m->width);
+    } else if (strcmp(tok, "stride") == 0) {
+      rc = parse_mem_arg(val, &m->stride);
+    } else {
+      rc = -1;
+    }
+  }
+  free(copy);
+  if (m->stride == 0) m->stride = m->width;
+  if (rc || m->rd + m->wr == 0 ||
+      (m->width != 8 && m->width != 16 && m->width != 32 && m->width != 64) ||
+      m->stride < m->width || m->stride % sizeof(uint64_t)) {
+    return -1;
+  }
+  return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------
+// one pass over the batches of every chain, inlined with a constant
+// dependent so that the independent variant carries no data dependency.
+static inline __attribute__((always_inline)) uint64_t gups_pass(
+    const struct gups_args *g, char *base, uint64_t nr_lines,
+    uint64_t upd_threshold, size_t nr_chains, uint64_t *state, uint64_t *dep,
+    bool dependent) {
+  uint64_t *line[GUPS_MAX_BATCH];
+  uint64_t key[GUPS_MAX_BATCH];
+  uint64_t sum = 0, r, v, chain_sum;
+  size_t c, j;
+
+  for (c = 0; c < nr_chains; ++c) {
+    for (j = 0; j < g->batch; ++j) {
+      r = rng_splitmix64(&state[c]);
+      if (dependent) r ^= dep[c];
+      key[j] = r;
+#ifdef __SIZEOF_INT128__
+      r = ((unsigned __int128)r * nr_lines) >> 64;
+#else
+      r %= nr_lines;
+#endif
+      line[j] = (uint64_t *)(base + r * DEF_CACHELINE);
+    }
+    chain_sum = 0;
+    for (j = 0; j < g->batch; ++j) {
+      v = *line[j];
+      // the low half of the key picks updates, the high half the line
+      if ((uint32_t)key[j] < upd_threshold) *line[j] = v ^ key[j];
+      chain_sum += v;
+    }
+    if (dependent) dep[c] = chain_sum;
+    sum += chain_sum;
+  }
+  return sum;
+}
+
+static void load_gups(per_thread_t *t) {
+  const struct gups_args *g = t->x.gups;
+  const uint64_t nr_lines = t->x.load_total_memory / DEF_CACHELINE;
+  const uint64_t upd_threshold = ((uint64_t)g->upd << 32) / 100;
+  const size_t nr_chains = g->depth ? g->depth : 1;
+  const size_t pass_accesses = nr_chains * g->batch;
+  const size_t chunk = load_chunk_bytes / DEF_CACHELINE > pass_accesses
+                           ? load_chunk_bytes / DEF_CACHELINE / pass_accesses
+                           : 1;
+  uint64_t state[GUPS_MAX_DEPTH], dep[GUPS_MAX_DEPTH];
+  size_t c, i;
+
+  for (c = 0; c < nr_chains; ++c) {
+    uint64_t x = ((uint64_t)t->x.thread_num << 32) | c;
+    state[c] = rng_seed ^ rng_splitmix64(&x);
+    dep[c] = 0;
+  }
+  if (verbosity > 1) {
+    printf("load_arena=%p, load_total_memory=0x%lX, lines=%" PRIu64
+           ", chains=%zu\n",
+           (char *)t->x.load_arena, t->x.load_total_memory, nr_lines,
+           nr_chains);
+  }
+
+  LOAD_MEMORY_INIT
+  do {
+    for (i = 0; i < chunk; ++i) {
+      use_result_dummy +=
+          g->depth ? gups_pass(g, t->x.load_arena, nr_lines, upd_threshold,
+                               nr_chains, state, dep, true)
+                   : gups_pass(g, t->x.load_arena, nr_lines, upd_threshold,
+                               nr_chains, state, dep, false);
+    }
+    // a line per access, whether it was a read or an update
+    LOAD_MEMORY_PROGRESS(chunk * pass_accesses * DEF_CACHELINE)
+  } while (1);
+}
+
+// parse "upd=P,batch=N,depth=N", every field is optional
+static int parse_gups_args(const char *str, struct gups_args *g) {
+  char *copy = strdup(str ? str : "");
+  char *tok, *save = NULL, *val;
+  int rc = 0;
+
+  g->upd = 100;
+  g->batch = 8;
+  g->depth = 0;
+  for (tok = strtok_r(copy, ",", &save); tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    val = strchr(tok, '=');
+    if (val) *val++ = 0;
+    if (val == NULL) {
+      rc = -1;
+    } else if (strcmp(tok, "upd") == 0) {
+      rc = parse_mem_arg(val, &g->upd);
+    } else if (strcmp(tok, "batch") == 0) {
+      rc = parse_mem_arg(val, &g->batch);
+    } else if (strcmp(tok, "depth") == 0) {
+      rc = parse_mem_arg(val, &g->depth);
+    } else {
+      rc = -1;
+    }
+  }
+  free(copy);
+  if (rc || g->upd > 100 || g->batch == 0 || g->batch > GUPS_MAX_BATCH ||
+      g->depth > GUPS_MAX_DEPTH) {
+    return -1;
+  }
+  return 0;
+}
+
+#define SIMD_MEMLOAD(pattern, usage)                              \
+  {                                                               \
+    .fn = load_simd, .base_object_size = sizeof(void *),          \
+    .name = "simd-" pattern, .usage1 = "simd-" pattern,           \
+    .usage2 = usage, .requires_arg = 0, .optional_arg = 1,        \
+    .parallelism = 0,                                             \
+  }
+
 //--------------------------------------------------------------------------------------------------------
 static const chase_t memloads[] = {
     // the default must be first
@@ -725,37 +1298,170 @@ static const chase_t memloads[] = {
         .usage2 = "2:1 rd:wr - lmbench stream triad with nontemporal hint",
         .requires_arg = 0,
         .parallelism = 0,
-    }};
+    },
+    // a name must come before any name it is a prefix of
+    SIMD_MEMLOAD("read", "1:0 rd:wr - vector sum, isa is picked at runtime"),
+    SIMD_MEMLOAD("write", "0:1 rd:wr - vector fill"),
+    SIMD_MEMLOAD("write-nt", "0:1 rd:wr - vector fill, nontemporal stores"),
+    SIMD_MEMLOAD("copy", "1:1 rd:wr - vector copy"),
+    SIMD_MEMLOAD("copy-nt", "1:1 rd:wr - vector copy, nontemporal stores"),
+    SIMD_MEMLOAD("triad", "2:1 rd:wr - vector a[i]=b[i]+c[i]"),
+    SIMD_MEMLOAD("triad-nt",
+                 "2:1 rd:wr - vector a[i]=b[i]+c[i], nontemporal stores"),
+    {
+        .fn = load_mix,
+        .base_object_size = sizeof(void *),
+        .name = "mix",
+        .usage1 = "mix[:args]",
+        .usage2 = "N:M rd:wr - args rd=N,wr=M,width=B,stride=B,nt",
+        .requires_arg = 0,
+        .optional_arg = 1,
+        .parallelism = 0,
+    },
+    {
+        .fn = load_gups,
+        .base_object_size = sizeof(void *),
+        .name = "gups",
+        .usage1 = "gups[:args]",
+        .usage2 = "random 64 byte reads/updates - args upd=P,batch=N,depth=N",
+        .requires_arg = 0,
+        .optional_arg = 1,
+        .parallelism = 0,
+    },
+};
 
 static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
 static size_t nr_to_startup;
 static int set_thread_affinity = 1;
+static bool use_placement;
+static struct placement placement;  // -C
+static bool use_perf_events;
+static struct perf_event_list perf_events;  // -e
+static bool use_workers;
+static struct worker_list workers;        // -w
+static const struct worker *self_worker;  // the worker this process is
+static pthread_barrier_t *start_barrier;  // of the threads of every worker
+
+static const char *chase_image_path;
+static char chase_image_config[CHASE_IMAGE_CONFIG_LEN];
+static bool chase_image_loaded;
+static void **chase_heads;  // cycle[] of every thread, for chase images
+static size_t nr_chase_heads;
+static pthread_barrier_t chase_image_barrier;
+
+// generate chases for this thread and apply any chase specific fixups.
+static void build_chases(per_thread_t *args) {
+  // generate chases -- using a different mixer index for every
+  // thread and for every parallel chase within a thread
+  unsigned parallelism = args->x.chase->parallelism;
+  for (unsigned par = 0; par < parallelism; ++par) {
+    if (args->x.genchase_args->pattern) {
+      args->x.cycle[par] = generate_chase_pattern(
+          args->x.genchase_args, parallelism * args->x.thread_num + par,
+          parallelism * args->x.nr_chase_threads);
+    } else if (args->x.use_longer_chase) {
+      args->x.cycle[par] = generate_chase_long(
+          args->x.genchase_args, parallelism * args->x.thread_num + par,
+          parallelism * args->x.nr_chase_threads);
+    } else {
+      args->x.cycle[par] = generate_chase(
+          args->x.genchase_args, parallelism * args->x.thread_num + par);
+    }
+  }
+  // handle critword2 chases
+  if (strcmp(args->x.chase->name, "critword2") == 0) {
+    size_t offset = strtoul(args->x.extra_args, 0, 0);
+    char *p = args->x.cycle[0];
+    char *q = p;
+    do {
+      char *next = *(char **)p;
+      *(void **)(p + offset) = next + offset;
+      p = next;
+    } while (p != q);
+  }
+  // handle critword chases
+  if (strcmp(args->x.chase->name, "critword") == 0) {
+    size_t offset = strtoul(args->x.extra_args, 0, 0);
+    char *p = args->x.cycle[0];
+    char *q = p;
+    do {
+      char *next = *(char **)p;
+      *(void **)(p + offset) = next;
+      *(void **)p = p + offset;
+      p = next;
+    } while (p != q);
+  }
+}
+
+static void load_chase_heads(per_thread_t *args) {
+  unsigned parallelism = args->x.chase->parallelism;
+  for (unsigned par = 0; par < parallelism; ++par) {
+    args->x.cycle[par] = chase_heads[parallelism * args->x.thread_num + par];
+  }
+}
+
+// once every chase thread has built its chases, one of them saves the arena.
+static void save_chase_image(per_thread_t *args) {
+  const struct generate_chase_common_args *genchase_args =
+      args->x.genchase_args;
+  unsigned parallelism = args->x.chase->parallelism;
+  for (unsigned par = 0; par < parallelism; ++par) {
+    chase_heads[parallelism * args->x.thread_num + par] = args->x.cycle[par];
+  }
+  if (pthread_barrier_wait(&chase_image_barrier) ==
+      PTHREAD_BARRIER_SERIAL_THREAD) {
+    chase_image_save(chase_image_path, chase_image_config,
+                     genchase_args->arena, genchase_args->total_memory,
+                     chase_heads, nr_chase_heads);
+  }
+  pthread_barrier_wait(&chase_image_barrier);
+}
+
+// the cpu a thread runs on: the placement's (-C) for its role or the n-th cpu
+// we are allowed to run on.  -1 if there are not enough cpus.
+static int thread_cpu(const per_thread_t *args) {
+  if (use_placement) {
+    if (args->x.run_test_type == RUN_CHASE) {
+      return placement_cpu(&placement, "chase", args->x.thread_num,
+                           args->x.thread_num);
+    }
+    return placement_cpu(&placement, "load",
+                         args->x.thread_num - args->x.nr_chase_threads,
+                         args->x.thread_num);
+  }
+  cpu_set_t cpus;
+  if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  int my_cpu;
+  unsigned num = args->x.thread_num;
+  // a worker in a cgroup has the cpus of the cgroup to itself
+  if (self_worker && self_worker->cgroup) num -= self_worker->first_thread;
+  for (my_cpu = 0; my_cpu < CPU_SETSIZE; ++my_cpu) {
+    if (!CPU_ISSET(my_cpu, &cpus)) continue;
+    if (num == 0) break;
+    --num;
+  }
+  return my_cpu == CPU_SETSIZE ? -1 : my_cpu;
+}
 
 static void *thread_start(void *data) {
   per_thread_t *args = data;
 
+  args->x.tid = syscall(SYS_gettid);
   // ensure every thread has a different RNG
   rng_init(args->x.thread_num);
 
   if (set_thread_affinity) {
-    // find out which cpus we can run on and move us to an appropriate cpu
-    cpu_set_t cpus;
-    if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
-      perror("sched_getaffinity");
-      exit(1);
-    }
-    int my_cpu;
-    unsigned num = args->x.thread_num;
-    for (my_cpu = 0; my_cpu < CPU_SETSIZE; ++my_cpu) {
-      if (!CPU_ISSET(my_cpu, &cpus)) continue;
-      if (num == 0) break;
-      --num;
-    }
-    if (my_cpu == CPU_SETSIZE) {
+    // move us to an appropriate cpu
+    int my_cpu = thread_cpu(args);
+    if (my_cpu < 0) {
       fprintf(stderr, "error: more threads than cpus available\n");
       exit(1);
     }
+    cpu_set_t cpus;
     CPU_ZERO(&cpus);
     CPU_SET(my_cpu, &cpus);
     if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
@@ -764,41 +1470,11 @@ static void *thread_start(void *data) {
     }
   }
   if (args->x.run_test_type == RUN_CHASE) {
-    // generate chases -- using a different mixer index for every
-    // thread and for every parallel chase within a thread
-    unsigned parallelism = args->x.chase->parallelism;
-    for (unsigned par = 0; par < parallelism; ++par) {
-      if (args->x.use_longer_chase) {
-        args->x.cycle[par] = generate_chase_long(
-            args->x.genchase_args, parallelism * args->x.thread_num + par,
-            parallelism);
-      } else {
-        args->x.cycle[par] = generate_chase(
-            args->x.genchase_args, parallelism * args->x.thread_num + par);
-      }
-    }
-    // handle critword2 chases
-    if (strcmp(args->x.chase->name, "critword2") == 0) {
-      size_t offset = strtoul(args->x.extra_args, 0, 0);
-      char *p = args->x.cycle[0];
-      char *q = p;
-      do {
-        char *next = *(char **)p;
-        *(void **)(p + offset) = next + offset;
-        p = next;
-      } while (p != q);
-    }
-    // handle critword chases
-    if (strcmp(args->x.chase->name, "critword") == 0) {
-      size_t offset = strtoul(args->x.extra_args, 0, 0);
-      char *p = args->x.cycle[0];
-      char *q = p;
-      do {
-        char *next = *(char **)p;
-        *(void **)(p + offset) = next;
-        *(void **)p = p + offset;
-        p = next;
-      } while (p != q);
+    if (chase_image_loaded) {
+      load_chase_heads(args);
+    } else {
+      build_chases(args);
+      if (chase_image_path) save_chase_image(args);
     }
     // now flush our caches
     if (args->x.cache_flush_size) {
@@ -820,26 +1496,47 @@ static void *thread_start(void *data) {
                              page_size, use_thp,
                              args->x.load_total_memory + args->x.load_offset,
                              -1) + args->x.load_offset;
-    memset(args->x.load_arena, 1,
-           args->x.load_total_memory);  // ensure pages are mapped
+    if (args->x.load_policy) {
+      // place the buffer before touching it
+      size_t len = (args->x.load_total_memory + args->x.load_offset +
+                    page_size - 1) & ~(page_size - 1);
+      arena_mbind_policy(args->x.load_arena - args->x.load_offset, len,
+                         args->x.load_policy);
+    }
+    // ensure pages are mapped, from this thread so on its node
+    arena_prefault(args->x.load_arena - args->x.load_offset,
+                   args->x.load_total_memory + args->x.load_offset, page_size,
+                   false);
+    if (verbosity > 1 && args->x.load_policy) {
+      printf("ML(%d) load buffer starts on node %d\n", args->x.thread_num,
+             arena_page_node(args->x.load_arena));
+    }
   }
 
   if (verbosity > 2)
     printf("thread_start(%d) wait and/or wake up everyone\n",
            args->x.thread_num);
   // wait and/or wake up everyone if we're all ready
-  pthread_mutex_lock(&wait_mutex);
-  --nr_to_startup;
-  if (nr_to_startup) {
-    pthread_cond_wait(&wait_cond, &wait_mutex);
+  if (start_barrier) {
+    pthread_barrier_wait(start_barrier);
   } else {
-    pthread_cond_broadcast(&wait_cond);
+    pthread_mutex_lock(&wait_mutex);
+    --nr_to_startup;
+    if (nr_to_startup) {
+      pthread_cond_wait(&wait_cond, &wait_mutex);
+    } else {
+      pthread_cond_broadcast(&wait_cond);
+    }
+    pthread_mutex_unlock(&wait_mutex);
   }
-  pthread_mutex_unlock(&wait_mutex);
 
   if (args->x.run_test_type == RUN_CHASE) {
     if (verbosity > 2) printf("thread_start: C(%d)\n", args->x.thread_num);
-    args->x.chase->fn(data);
+    if (args->x.hist) {
+      args->x.chase->hist_fn(data);
+    } else {
+      args->x.chase->fn(data);
+    }
   } else {
     if (verbosity > 2) printf("thread_start: M(%d)\n", args->x.thread_num);
     args->x.memload->fn(data);
@@ -847,6 +1544,31 @@ static void *thread_start(void *data) {
   return NULL;
 }
 
+// the time spent in every startup phase, reported by -v and -J
+static struct {
+  uint64_t alloc;    // mapping (and -W placing) the arenas
+  uint64_t fault;    // faulting in the chase and flush arenas
+  uint64_t mixer;    // generating the mixer
+  uint64_t threads;  // starting the threads until every chase is built and
+                     // every load buffer faulted in
+} phase_ns;
+
+static void report_phases(void) {
+  if (json_output) {
+    json_record("multiload", "phases");
+    json_uint("alloc_ns", phase_ns.alloc);
+    json_uint("fault_ns", phase_ns.fault);
+    json_uint("mixer_ns", phase_ns.mixer);
+    json_uint("threads_ns", phase_ns.threads);
+    json_end_record();
+  } else if (verbosity > 0) {
+    printf("startup: alloc %.1f ms, fault %.1f ms, mixer %.1f ms, "
+           "threads %.1f ms\n",
+           phase_ns.alloc / 1e6, phase_ns.fault / 1e6, phase_ns.mixer / 1e6,
+           phase_ns.threads / 1e6);
+  }
+}
+
 static void timestamp(void) {
   if (!print_timestamp) return;
   struct timeval tv;
@@ -854,39 +1576,872 @@ static void timestamp(void) {
   printf("%.6f ", tv.tv_sec + tv.tv_usec / 1000000.);
 }
 
-int main(int argc, char **argv) {
-  char *p;
-  int c;
-  size_t i;
-  size_t nr_threads = DEF_NR_THREADS;
-  size_t nr_samples = DEF_NR_SAMPLES;
-  size_t cache_flush_size = DEF_CACHE_FLUSH;
-  size_t delay = DEF_DELAY;
-  size_t offset = DEF_OFFSET;
-  bool use_longer_chase = false;
-  int print_average = 0;
-  const char *extra_args = NULL;
-  const char *chase_optarg = chases[0].name;
-  const chase_t *chase = &chases[0];
-  const char *memload_optarg = memloads[0].name;
-  const chase_t *memload = &memloads[0];
-  test_type_t run_test_type =
-      RUN_CHASE;  // RUN_CHASE, RUN_BANDWIDTH, RUN_CHASE_LOADED
-  struct generate_chase_common_args genchase_args;
+// the chase and load statistics of one measurement
+struct load_result {
+  double chase_ns;  // best (or geometric mean) latency of the chase threads
+  double chase_mibps;
+  double chase_dev;
+  double load_max_mibps;
+  double load_avg_mibps;
+  double load_dev;
+  double *thread_ns;  // latency of every chase thread, unless NULL
+  double *thread_mibps;  // average bandwidth of every load thread, or NULL
+  double chase_ci;       // 95% confidence intervals relative to the mean
+  double load_ci;
+  size_t nr_samples;  // samples taken, after dropping the first
+};
 
-  default_page_size = page_size = get_native_page_size();
+// -A: the confidence interval to reach, and the most time to take
+static double ci_target;
+static double ci_max_secs;
+// bytes the load threads count per random access (gups), 0 for streams,
+// and the share of the accesses that are updates
+static size_t load_access_bytes;
+static double load_update_share;
+
+// million random accesses per second of a load bandwidth
+static double load_maccesses(double mibps) {
+  return mibps * 1024 * 1024 / load_access_bytes / 1e6;
+}
+// -R: MiB/s of every load thread or of all of them, or a percentage of what
+// they reach unthrottled
+static const char *rate_optarg;
+static double rate_target;
+static bool rate_pct;
+static bool rate_total;
+
+// ask the threads for nr_samples samples (after dropping one) and summarize
+// them.  the threads keep running, so this can be called again, e.g. after
+// changing their injection delay.
+static void sample_threads(per_thread_t *thread_data, size_t nr_threads,
+                           size_t nr_chase_threads, size_t nr_load_threads,
+                           size_t nr_samples, int print_average,
+                           struct load_result *r) {
+  size_t i;
 
-  genchase_args.total_memory = DEF_TOTAL_MEMORY;
-  genchase_args.stride = DEF_STRIDE;
-  genchase_args.tlb_locality = DEF_TLB_LOCALITY * default_page_size;
-  genchase_args.gen_permutation = gen_random_permutation;
+  if (verbosity > 2) printf("main: start sampling thread progress\n");
+  // now start sampling their progress
+  nr_samples = nr_samples + 1;  // we drop the first sample
+  double *cur_samples = alloca(nr_threads * sizeof(*cur_samples));
+  uint64_t last_sample_time, cur_sample_time;
+  double chase_min = 1. / 0., chase_max = 0.;
+  double chase_running_sum = 0., load_running_sum = 0.,
+         chase_running_geosum = 0.;
+  double load_max_mibps = 0, load_min_mibps = 1. / 0.;
+  double chase_thd_sum = 0, load_thd_sum = 0;
+  size_t nr_used = 0;
+  // of the chase latency (of its logarithm for the geometric mean) and of
+  // the total load bandwidth
+  struct sample_ci chase_ci = {0}, load_ci = {0};
+  double *thread_load_sum = alloca(nr_threads * sizeof(*thread_load_sum));
+  uint64_t time_delta = 0;
+  int ready;
+  // the load thread progress each sample is measured from
+  uint64_t *last_bytes = alloca(nr_threads * sizeof(*last_bytes));
+  uint64_t *last_nsec = alloca(nr_threads * sizeof(*last_nsec));
+  uint64_t bytes, nsec;
+  // lines moved by the load threads in this sample, for the perf events
+  double *sample_lines = alloca(nr_threads * sizeof(*sample_lines));
+  // per thread counts of every perf event of the current sample
+  struct perf_counters *counters = NULL;
+  double *deltas = NULL;
+  if (use_perf_events) {
+    counters = alloca(nr_threads * sizeof(*counters));
+    deltas = alloca(nr_threads * perf_events.nr * sizeof(*deltas));
+    for (i = 0; i < nr_threads; ++i) {
+      perf_counters_open(&counters[i], &perf_events, thread_data[i].x.tid);
+    }
+  }
+  double *thread_min = alloca(nr_chase_threads * sizeof(*thread_min));
+  double *thread_geosum = alloca(nr_chase_threads * sizeof(*thread_geosum));
+  for (i = 0; i < nr_chase_threads; ++i) {
+    thread_min[i] = 1. / 0.;
+    thread_geosum[i] = 0.;
+  }
+  for (i = 0; i < nr_threads; ++i) thread_load_sum[i] = 0.;
 
-  setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+  for (i = 0; i < nr_threads; ++i) {
+    if (thread_data[i].x.run_test_type == RUN_CHASE) {
+      __sync_lock_test_and_set(&thread_data[i].x.count, 0);
+    } else {
+      read_progress(&thread_data[i].x.progress, &last_bytes[i],
+                    &last_nsec[i]);
+    }
+  }
+  last_sample_time = now_nsec();
+  uint64_t start_time = last_sample_time;
+  for (size_t sample_no = 0; nr_samples == 1 || sample_no < nr_samples;
+       ++sample_no) {
+    if (verbosity > 0) printf("main: sample_no=%ld ", sample_no);
+    usleep(sample_interval_usecs);
 
-  while ((c = getopt(argc, argv, "ac:d:l:F:p:HLm:n:oO:S:s:T:t:vXyW:")) != -1) {
-    switch (c) {
-      case 'a':
-        print_average = 1;
+    chase_thd_sum = 0.;
+    load_thd_sum = 0.;
+    for (i = 0; i < nr_threads; ++i) {
+      if (verbosity > 2) printf("-");
+      if (thread_data[i].x.run_test_type != RUN_CHASE) {
+        // the load threads publish their progress continuously, wait only
+        // if one hasn't finished a chunk since the last sample
+        read_progress(&thread_data[i].x.progress, &bytes, &nsec);
+        while (nsec == last_nsec[i]) {
+          if (verbosity > 2) printf("*");
+          usleep(LOAD_DELAY_SAMPLE_uS);
+          read_progress(&thread_data[i].x.progress, &bytes, &nsec);
+        }
+        cur_samples[i] = (bytes - last_bytes[i]) * 1000000000.0 /
+                         ((nsec - last_nsec[i]) * 1024. * 1024.);
+        sample_lines[i] = (double)(bytes - last_bytes[i]) / DEF_CACHELINE;
+        last_bytes[i] = bytes;
+        last_nsec[i] = nsec;
+        continue;
+      }
+      ready = 0;
+      while (ready == 0) {
+        cur_samples[i] =
+            (double)__sync_lock_test_and_set(&thread_data[i].x.count, 0);
+        if (cur_samples[i] != 0) {
+          // Chase threads start at thread 0 and should always be ready,
+          // therefore we read chase timestamp as soon as finished reading the
+          // last chase thread. Load threads carry their own timestamps so
+          // don't use this timer
+          if ((i + 1) == nr_chase_threads) {
+            cur_sample_time = now_nsec();
+            time_delta = cur_sample_time - last_sample_time;
+            last_sample_time = cur_sample_time;
+          }
+          ready = 1;
+        } else {
+          if (verbosity > 2) printf("*");
+          usleep(LOAD_DELAY_SAMPLE_uS);
+        }
+      }
+    }
+    for (i = 0; counters && i < nr_threads; ++i) {
+      perf_counters_sample(&counters[i], &perf_events,
+                           deltas + i * perf_events.nr);
+    }
+
+    for (i = 0; i < nr_threads; ++i) {
+      // printf("main: thread[%d], run_mode=%i\n", t->x.thread_num,
+      // t->x.run_test_type);
+      if (thread_data[i].x.run_test_type == RUN_CHASE) {
+        chase_thd_sum += (double)cur_samples[i];
+        if (verbosity > 1) {
+          double z = time_delta / (double)cur_samples[i];
+          double mibps = sizeof(void *) / (z / 1000000000.0) / (1024 * 1024);
+          printf(" MC(%ld)%.3f, %6.1f(ns), %.3f(MiB/s)", i, cur_samples[i], z,
+                 mibps);
+        }
+      } else {
+        load_thd_sum += (double)cur_samples[i];
+        if (verbosity > 1) {
+          printf(" ML(%ld)%.0f(MiB/s)", i, cur_samples[i]);
+        }
+      }
+    }
+
+    // we drop the first sample because it's fairly likely one
+    // thread had some advantage initially due to still having
+    // portions of the chase in a cache.
+    if (sample_no == 0) {
+      if (verbosity > 0) printf("\n");
+      __atomic_store_n(&hist_recording, 1, __ATOMIC_RELEASE);
+      continue;
+    }
+
+    for (i = 0; counters && !json_output && i < nr_threads; ++i) {
+      if (verbosity > 0 && i == 0) printf("\n");
+      if (thread_data[i].x.run_test_type == RUN_CHASE) {
+        printf("MC(%zu) %.1f ns/load", i, time_delta / cur_samples[i]);
+        print_perf_deltas(&perf_events, deltas + i * perf_events.nr,
+                          cur_samples[i], "load");
+      } else {
+        printf("ML(%zu) %.0f MiB/s", i, cur_samples[i]);
+        print_perf_deltas(&perf_events, deltas + i * perf_events.nr,
+                          sample_lines[i], "line");
+      }
+      printf("\n");
+    }
+
+    if (json_output) {
+      json_record("multiload", "sample");
+      json_uint("sample", sample_no);
+      json_uint("delay", thread_data[0].x.delay);
+      if (nr_chase_threads) {
+        json_uint("duration_ns", time_delta);
+        json_array("chase_ns_per_load");
+        for (i = 0; i < nr_chase_threads; ++i) {
+          json_double(NULL, time_delta / cur_samples[i]);
+        }
+        json_end();
+        json_double("chase_ns", time_delta / chase_thd_sum * nr_chase_threads);
+      }
+      if (nr_load_threads) {
+        json_doubles("load_mibps", cur_samples + nr_chase_threads,
+                     nr_load_threads);
+        json_double("load_total_mibps", load_thd_sum);
+      }
+      if (counters) {
+        // per load of the chase threads, per line of the load threads
+        double *per = alloca(nr_threads * sizeof(*per));
+        for (i = 0; i < nr_threads; ++i) {
+          per[i] = i < nr_chase_threads ? cur_samples[i] : sample_lines[i];
+        }
+        json_perf_deltas("thread_events", &perf_events, deltas, per,
+                         nr_threads);
+      }
+      json_end_record();
+    }
+
+    // Calcuate chase per thread and overall thread stats.
+    ++nr_used;
+    for (i = 0; i < nr_chase_threads; ++i) {
+      double z = time_delta / cur_samples[i];
+      if (z < thread_min[i]) thread_min[i] = z;
+      thread_geosum[i] += log(z);
+    }
+    if (chase_thd_sum != 0) {
+      double t = time_delta / (double)chase_thd_sum;
+      chase_running_sum += t;
+      chase_running_geosum += log(t);
+      sample_ci_add(&chase_ci, print_average ? log(t) : t);
+      if (t < chase_min) chase_min = t;
+      if (t > chase_max) chase_max = t;
+      if (verbosity > 0) {
+        double z = t * nr_chase_threads;
+        printf(" avg=%.1f(ns)\n", z);
+      }
+    }
+
+    // Calculate memory load overall thread stats
+    for (i = nr_chase_threads; i < nr_threads; ++i) {
+      thread_load_sum[i] += cur_samples[i];
+    }
+    if (load_thd_sum != 0) {
+      if (load_thd_sum > load_max_mibps) load_max_mibps = load_thd_sum;
+      if (load_thd_sum < load_min_mibps) load_min_mibps = load_thd_sum;
+      load_running_sum += load_thd_sum;
+      sample_ci_add(&load_ci, load_thd_sum);
+      if (verbosity > 0) {
+        printf(" main: threads=%ld, Total(MiB/s)=%.*f, PerThread=%.f\n",
+               nr_load_threads, load_thd_sum < 100. ? 3 : 1, load_thd_sum,
+               load_thd_sum / nr_load_threads);
+      }
+    }
+
+    r->chase_ci = print_average ? expm1(sample_ci_half_width(&chase_ci))
+                                : sample_ci_half_width(&chase_ci) /
+                                      chase_ci.mean;
+    r->load_ci = sample_ci_half_width(&load_ci) / load_ci.mean;
+    if (ci_target > 0. && nr_used >= CI_MIN_SAMPLES &&
+        (!nr_chase_threads || r->chase_ci <= ci_target) &&
+        (!nr_load_threads || r->load_ci <= ci_target)) {
+      break;
+    }
+    if (ci_target > 0. && now_nsec() - start_time > ci_max_secs * 1e9) break;
+  }
+  for (i = 0; counters && i < nr_threads; ++i) {
+    perf_counters_close(&counters[i], &perf_events);
+  }
+  r->nr_samples = nr_used;
+
+  double ChasNS = 0, ChasDEV = 0, ChasBEST = 0, ChasWORST = 0, ChasAVG = 0,
+         ChasMibs = 0, ChasGEO = 0;
+  double LdAvgMibs = 0, LdMibsDEV = 0;
+
+  if (nr_chase_threads != 0) {
+    ChasAVG = chase_running_sum * nr_chase_threads / nr_used;
+    ChasGEO =
+        nr_chase_threads * exp(chase_running_geosum / nr_used);
+    ChasBEST = chase_min * nr_chase_threads;
+    ChasWORST = chase_max * nr_chase_threads;
+    ChasDEV = ((ChasWORST - ChasBEST) / ChasAVG);
+    if (verbosity > 0) {
+      printf(
+          "ChasAVG=%-8f, ChasGEO=%-8f, ChasBEST=%-8f, ChasWORST=%-8f, "
+          "ChasDEV=%-8.3f\n",
+          ChasAVG, ChasGEO, ChasBEST, ChasWORST, ChasDEV);
+    }
+    // if (print_average) ChasNS = ChasAVG;
+    if (print_average)
+      ChasNS = ChasGEO;
+    else
+      ChasNS = ChasBEST;
+    ChasMibs = nr_chase_threads *
+               (sizeof(void *) / (ChasNS / 1000000000.0) / (1024 * 1024));
+    for (i = 0; r->thread_ns && i < nr_chase_threads; ++i) {
+      if (print_average)
+        r->thread_ns[i] = exp(thread_geosum[i] / nr_used);
+      else
+        r->thread_ns[i] = thread_min[i];
+    }
+  }
+
+  if (nr_load_threads != 0) {
+    LdAvgMibs = load_running_sum / nr_used;
+    LdMibsDEV = ((load_max_mibps - load_min_mibps) / LdAvgMibs);
+    for (i = 0; r->thread_mibps && i < nr_load_threads; ++i) {
+      r->thread_mibps[i] =
+          thread_load_sum[nr_chase_threads + i] / nr_used;
+    }
+    if (verbosity > 0) {
+      printf(
+          "LdAvgMibs=%-8f, LdMaxMibs=%-8f, LdMinMibs=%-8f, LdDevMibs=%-8.3f\n",
+          LdAvgMibs, load_max_mibps, load_min_mibps, LdMibsDEV);
+    }
+  }
+
+  r->chase_ns = ChasNS;
+  r->chase_mibps = ChasMibs;
+  r->chase_dev = ChasDEV;
+  r->load_max_mibps = load_max_mibps;
+  r->load_avg_mibps = LdAvgMibs;
+  r->load_dev = LdMibsDEV;
+}
+
+// the columns of the summary table
+static void json_result(const struct load_result *r, size_t nr_chase_threads,
+                        size_t nr_load_threads) {
+  json_uint("chase_threads", nr_chase_threads);
+  if (nr_chase_threads) {
+    json_double("chase_ns", r->chase_ns);
+    json_double("chase_mibps", r->chase_mibps);
+    json_double("chase_deviation", r->chase_dev);
+    if (r->thread_ns) json_doubles("chase_ns_per_thread", r->thread_ns,
+                                   nr_chase_threads);
+  }
+  json_uint("load_threads", nr_load_threads);
+  if (nr_load_threads) {
+    json_double("load_max_mibps", r->load_max_mibps);
+    json_double("load_avg_mibps", r->load_avg_mibps);
+    json_double("load_deviation", r->load_dev);
+    if (load_access_bytes) {
+      double maccesses = load_maccesses(r->load_avg_mibps);
+      json_double("load_maccesses", maccesses);
+      json_double("load_mups", maccesses * load_update_share);
+    }
+  }
+  if (ci_target > 0.) {
+    if (nr_chase_threads) json_double("chase_ci", r->chase_ci);
+    if (nr_load_threads) json_double("load_ci", r->load_ci);
+  }
+}
+
+// -R: set the rate of every pacer, measuring the unthrottled rates first for
+// a percentage.  returns the total target.
+static double set_load_rates(per_thread_t *thread_data, size_t nr_threads,
+                             size_t nr_chase_threads, size_t nr_load_threads,
+                             double *peak_mibps) {
+  struct load_result peak;
+  double mibps, total = 0.;
+  size_t i;
+
+  if (rate_pct) {
+    peak.thread_ns = NULL;
+    peak.thread_mibps = alloca(nr_load_threads * sizeof(*peak.thread_mibps));
+    sample_threads(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                   RATE_PEAK_SAMPLES, 0, &peak);
+    *peak_mibps = peak.load_avg_mibps;
+    if (verbosity > 0) {
+      printf("rate: unthrottled %.f MiB/s, holding %.f%%\n",
+             peak.load_avg_mibps, rate_target);
+    }
+  }
+  for (i = nr_chase_threads; i < nr_threads; ++i) {
+    if (rate_total && i > nr_chase_threads) break;
+    if (!rate_pct) {
+      mibps = rate_target;
+    } else if (rate_total) {
+      mibps = peak.load_avg_mibps * rate_target / 100.;
+    } else {
+      mibps = peak.thread_mibps[i - nr_chase_threads] * rate_target / 100.;
+    }
+    thread_data[i].x.pace.ns_per_byte = 1e9 / (mibps * 1024 * 1024);
+    total += mibps;
+  }
+  return total;
+}
+
+// stop the chase threads (threads 0 .. nr_chase_threads-1) at the end of
+// their block, the join orders their last histogram_add() before our reads.
+static void stop_chase_threads(per_thread_t *thread_data,
+                               size_t nr_chase_threads) {
+  size_t i;
+
+  __atomic_store_n(&hist_recording, 0, __ATOMIC_RELEASE);
+  for (i = 0; i < nr_chase_threads; ++i) {
+    __atomic_store_n(&thread_data[i].x.stop, 1, __ATOMIC_RELEASE);
+  }
+  for (i = 0; i < nr_chase_threads; ++i) {
+    pthread_join(thread_data[i].x.thread, NULL);
+  }
+}
+
+//--------------------------------------------------------------------------------------------------------
+// -D: a resident probe.  the threads keep their chases and buffers and are
+// parked in a signal handler between probes, so they use no cpu while the
+// main thread waits for the next probe and answers scrapes.
+#define PARK_SIGNAL SIGUSR1
+#define DEF_PROBE_EVERY 60.
+#define DEF_PROBE_CPU_PCT 1.
+#define DEF_PROBE_MEM ((size_t)1 << 30)
+
+struct probe_args {
+  double every;        // seconds from one probe to the next
+  const char *listen;  // port or unix socket path of the metrics, or NULL
+  double cpu_pct;      // budget: percent of a cpu the probes may take
+  size_t mem;          // budget: bytes of the arenas and load buffers
+};
+
+static volatile sig_atomic_t threads_parked;
+// listening from the start, so a bad listen= fails before the setup
+static struct metrics_server probe_server = {.fd = -1};
+
+static void park_handler(int sig) {
+  sigset_t mask;
+
+  // wait with the park signal unblocked, it also wakes us
+  pthread_sigmask(SIG_SETMASK, NULL, &mask);
+  sigdelset(&mask, PARK_SIGNAL);
+  while (threads_parked) sigsuspend(&mask);
+}
+
+static void park_threads(per_thread_t *thread_data, size_t nr_threads,
+                         int park) {
+  size_t i;
+
+  threads_parked = park;
+  for (i = 0; i < nr_threads; ++i) {
+    pthread_kill(thread_data[i].x.thread, PARK_SIGNAL);
+  }
+}
+
+// parse "every=SECS,listen=[ADDR:]PORT|PATH,cpu=PCT,mem=SIZE", every field is
+// optional
+static int parse_probe_args(const char *str, struct probe_args *a) {
+  char *copy = strdup(str);
+  char *tok, *save = NULL, *val, *end;
+  int rc = 0;
+
+  a->every = DEF_PROBE_EVERY;
+  a->listen = NULL;
+  a->cpu_pct = DEF_PROBE_CPU_PCT;
+  a->mem = DEF_PROBE_MEM;
+  for (tok = strtok_r(copy, ",", &save); tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    val = strchr(tok, '=');
+    if (val) *val++ = 0;
+    if (val == NULL || *val == 0) {
+      rc = -1;
+    } else if (strcmp(tok, "every") == 0) {
+      a->every = strtod(val, &end);
+      rc = *end || !(a->every > 0.) ? -1 : 0;
+    } else if (strcmp(tok, "listen") == 0) {
+      a->listen = strdup(val);
+    } else if (strcmp(tok, "cpu") == 0) {
+      a->cpu_pct = strtod(val, &end);
+      rc = *end || !(a->cpu_pct > 0.) ? -1 : 0;
+    } else if (strcmp(tok, "mem") == 0) {
+      rc = parse_mem_arg(val, &a->mem);
+    } else {
+      rc = -1;
+    }
+  }
+  free(copy);
+  return rc;
+}
+
+static double cpu_seconds(void) {
+  struct rusage ru;
+
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+         (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// the latest probe in the prometheus text format
+static char *probe_metrics(const struct load_result *r, size_t nr_chase_threads,
+                           size_t nr_load_threads, const char *chase_name,
+                           const char *load_name, uint64_t nr_probes,
+                           double cpu_secs, size_t mem) {
+  char *text = NULL;
+  size_t len;
+  FILE *f = open_memstream(&text, &len);
+
+  if (f == NULL) {
+    perror("open_memstream");
+    exit(1);
+  }
+  if (nr_chase_threads) {
+    fprintf(f,
+            "# HELP multiload_chase_ns Latency of the probe chase, ns per "
+            "load.\n"
+            "# TYPE multiload_chase_ns gauge\n"
+            "multiload_chase_ns{chase=\"%s\",threads=\"%zu\"} %.3f\n",
+            chase_name, nr_chase_threads, r->chase_ns);
+  }
+  if (nr_load_threads) {
+    fprintf(f,
+            "# HELP multiload_load_mibps Bandwidth of the probe load threads, "
+            "MiB/s.\n"
+            "# TYPE multiload_load_mibps gauge\n"
+            "multiload_load_mibps{load=\"%s\",threads=\"%zu\"} %.1f\n",
+            load_name, nr_load_threads, r->load_avg_mibps);
+  }
+  fprintf(f,
+          "# HELP multiload_probe_samples Samples of the latest probe.\n"
+          "# TYPE multiload_probe_samples gauge\n"
+          "multiload_probe_samples %zu\n"
+          "# HELP multiload_probe_timestamp_seconds When the latest probe "
+          "ended.\n"
+          "# TYPE multiload_probe_timestamp_seconds gauge\n"
+          "multiload_probe_timestamp_seconds %ld\n"
+          "# HELP multiload_probes_total Probes taken.\n"
+          "# TYPE multiload_probes_total counter\n"
+          "multiload_probes_total %" PRIu64 "\n"
+          "# HELP multiload_cpu_seconds_total Cpu time of the prober.\n"
+          "# TYPE multiload_cpu_seconds_total counter\n"
+          "multiload_cpu_seconds_total %.3f\n"
+          "# HELP multiload_probe_memory_bytes Arenas and buffers kept "
+          "resident.\n"
+          "# TYPE multiload_probe_memory_bytes gauge\n"
+          "multiload_probe_memory_bytes %zu\n",
+          r->nr_samples, (long)time(NULL), nr_probes, cpu_secs, mem);
+  fclose(f);
+  return text;
+}
+
+// take a probe every a->every seconds, forever
+static void __attribute__((noreturn))
+run_probes(per_thread_t *thread_data, size_t nr_threads,
+           size_t nr_chase_threads, size_t nr_load_threads, size_t nr_samples,
+           int print_average, const struct probe_args *a,
+           const char *chase_name, const char *load_name, size_t mem) {
+  struct load_result r;
+  uint64_t next = now_nsec(), nr_probes;
+  char *text = NULL;
+
+  r.thread_ns = alloca(nr_chase_threads * sizeof(*r.thread_ns));
+  r.thread_mibps = alloca(nr_load_threads * sizeof(*r.thread_mibps));
+  // the threads are running since they started, the first probe is now
+  for (nr_probes = 1;; ++nr_probes) {
+    if (nr_probes > 1) park_threads(thread_data, nr_threads, 0);
+    sample_threads(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                   nr_samples, print_average, &r);
+    park_threads(thread_data, nr_threads, 1);
+
+    double cpu_secs = cpu_seconds();
+    free(text);
+    text = probe_metrics(&r, nr_chase_threads, nr_load_threads, chase_name,
+                         load_name, nr_probes, cpu_secs, mem);
+    if (json_output) {
+      json_record("multiload", "probe");
+      json_uint("probe", nr_probes);
+      json_uint("nr_samples", r.nr_samples);
+      json_result(&r, nr_chase_threads, nr_load_threads);
+      json_double("cpu_seconds", cpu_secs);
+      json_end_record();
+    } else {
+      printf("probe %" PRIu64 ":", nr_probes);
+      if (nr_chase_threads) printf(" ChaseNS=%.3f", r.chase_ns);
+      if (nr_load_threads) printf(" LdAvgMibs=%.f", r.load_avg_mibps);
+      printf(" Samples=%zu CpuSecs=%.3f\n", r.nr_samples, cpu_secs);
+    }
+    fflush(stdout);
+
+    // skip the probes we are late for rather than bunching them up
+    next += a->every * 1e9;
+    if (next < now_nsec()) next = now_nsec();
+    if (probe_server.fd >= 0) {
+      metrics_serve(&probe_server, text, next);
+    } else {
+      uint64_t now;
+      while ((now = now_nsec()) < next) usleep((next - now) / 1000);
+    }
+  }
+}
+
+// reject a probe that would take more than its share of cpu or memory
+static void check_probe_budget(const struct probe_args *a, size_t nr_threads,
+                               size_t nr_samples, size_t mem) {
+  // every thread runs through the dropped sample and the nr_samples
+  double busy_secs = (ci_target > 0. ? ci_max_secs
+                                     : (nr_samples + 1) *
+                                           (sample_interval_usecs / 1e6)) *
+                     nr_threads;
+  double pct = busy_secs / a->every * 100.;
+
+  if (nr_samples == 0 && ci_target == 0.) {
+    fprintf(stderr, "Error: -D needs a finite number of samples (-n)\n");
+    exit(1);
+  }
+  if (pct > a->cpu_pct) {
+    fprintf(stderr,
+            "Error: %zu threads sampling for %.3fs every %gs take %.2f%% of a "
+            "cpu, over the\n"
+            "-D cpu=%g budget (lower -n, -i or -t, or raise every)\n",
+            nr_threads, busy_secs / nr_threads, a->every, pct, a->cpu_pct);
+    exit(1);
+  }
+  if (mem > a->mem) {
+    fprintf(stderr,
+            "Error: the arenas and buffers take %zu bytes, over the -D mem=%zu "
+            "budget\n",
+            mem, a->mem);
+    exit(1);
+  }
+}
+
+struct delay_point {
+  size_t delay;
+  struct load_result r;
+};
+
+static void measure_delay(per_thread_t *thread_data, size_t nr_threads,
+                          size_t nr_chase_threads, size_t nr_load_threads,
+                          size_t nr_samples, int print_average, size_t delay,
+                          struct delay_point *point) {
+  size_t i;
+
+  for (i = 0; i < nr_threads; ++i) {
+    thread_data[i].x.delay = delay;
+  }
+  point->delay = delay;
+  sample_threads(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                 nr_samples, print_average, &point->r);
+  if (verbosity > 0) {
+    printf("delay=%zu, ChaseNS=%.3f, LdAvgMibs=%.f\n", delay,
+           point->r.chase_ns, point->r.load_avg_mibps);
+  }
+}
+
+// how much the latency and bandwidth differ between two points of the curve
+static double curve_distance(const struct delay_point *a,
+                             const struct delay_point *b) {
+  double dist = 0.;
+  if (a->r.chase_ns > 0. && b->r.chase_ns > 0.) {
+    dist += fabs(log(a->r.chase_ns / b->r.chase_ns));
+  }
+  if (a->r.load_avg_mibps > 0. && b->r.load_avg_mibps > 0.) {
+    dist += fabs(log(a->r.load_avg_mibps / b->r.load_avg_mibps));
+  }
+  return dist;
+}
+
+// measure every injection delay of the sweep while the chase and the load
+// threads keep running, then add up to MAX_KNEE_POINTS delays in between
+// the neighbours which differ the most.  prints the curve from the lightest
+// to the heaviest load.
+static void sweep_delays(per_thread_t *thread_data, size_t nr_threads,
+                         size_t nr_chase_threads, size_t nr_load_threads,
+                         const struct mem_sweep *sweep, size_t nr_samples,
+                         int print_average) {
+  size_t nr_points = 0, max_points = MAX_KNEE_POINTS;
+  size_t delay, i;
+
+  for (delay = sweep->low; delay <= sweep->high;
+       delay = mem_sweep_next(sweep, delay)) {
+    ++max_points;
+  }
+  // calloc leaves every point's thread_ns NULL
+  struct delay_point *points = calloc(max_points, sizeof(*points));
+  if (points == NULL) {
+    fprintf(stderr, "Error: could not allocate the delay sweep\n");
+    exit(1);
+  }
+
+  for (delay = sweep->low; delay <= sweep->high;
+       delay = mem_sweep_next(sweep, delay)) {
+    measure_delay(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                  nr_samples, print_average, delay, &points[nr_points++]);
+  }
+
+  // densify the curve around its knee
+  while (nr_points < max_points) {
+    size_t best = nr_points;
+    double best_dist = KNEE_MIN_DISTANCE;
+    for (i = 0; i + 1 < nr_points; ++i) {
+      if (points[i + 1].delay - points[i].delay < 2) continue;
+      double dist = curve_distance(&points[i], &points[i + 1]);
+      if (dist > best_dist) {
+        best = i;
+        best_dist = dist;
+      }
+    }
+    if (best == nr_points) break;
+
+    size_t lo = points[best].delay, hi = points[best + 1].delay;
+    delay = lo ? (size_t)sqrt((double)lo * hi) : hi / 2;
+    if (delay <= lo) delay = lo + 1;
+    if (delay >= hi) delay = hi - 1;
+    memmove(&points[best + 2], &points[best + 1],
+            (nr_points - best - 1) * sizeof(*points));
+    measure_delay(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                  nr_samples, print_average, delay, &points[best + 1]);
+    ++nr_points;
+  }
+
+  if (json_output) {
+    for (i = nr_points; i-- > 0;) {
+      json_record("multiload", "delay");
+      json_uint("delay", points[i].delay);
+      if (ci_target > 0.) json_uint("nr_samples", points[i].r.nr_samples);
+      json_result(&points[i].r, nr_chase_threads, nr_load_threads);
+      json_end_record();
+    }
+    free(points);
+    return;
+  }
+
+  printf(
+      "Delay\t, ChaseThds\t, ChaseNS\t, ChaseMibs\t, ChDeviate\t, LoadThds\t, "
+      "LdMaxMibs\t, LdAvgMibs\t, LdDeviate\n");
+  for (i = nr_points; i-- > 0;) {
+    const struct load_result *r = &points[i].r;
+    printf(
+        "%-8zu\t, %-8zu\t, %-8.3f\t, %-8.f\t, %-8.3f\t, %-8zu\t, %-8.f\t, "
+        "%-8.f\t, %-8.3f\n",
+        points[i].delay, nr_chase_threads, r->chase_ns, r->chase_mibps,
+        r->chase_dev, nr_load_threads, r->load_max_mibps, r->load_avg_mibps,
+        r->load_dev);
+  }
+  free(points);
+}
+
+// the threads of every worker (-w): the average latency of its chase threads
+// and the total bandwidth of its load threads
+static void report_workers(size_t nr_chase_threads,
+                           const struct load_result *r) {
+  size_t i, j;
+
+  for (i = 0; i < workers.nr; ++i) {
+    const struct worker *w = &workers.worker[i];
+    size_t nr_chase = 0, nr_load = 0;
+    double chase_ns = 0., load_mibps = 0.;
+    for (j = w->first_thread; j < w->first_thread + w->nr_threads; ++j) {
+      if (j < nr_chase_threads) {
+        chase_ns += r->thread_ns[j];
+        ++nr_chase;
+      } else {
+        load_mibps += r->thread_mibps[j - nr_chase_threads];
+        ++nr_load;
+      }
+    }
+    if (nr_chase) chase_ns /= nr_chase;
+    if (json_output) {
+      json_record("multiload", "worker");
+      json_uint("worker", i);
+      json_int("pid", w->pid);
+      json_uint("first_thread", w->first_thread);
+      json_uint("nr_threads", w->nr_threads);
+      if (w->cgroup) json_string("cgroup", w->cgroup);
+      json_uint("chase_threads", nr_chase);
+      if (nr_chase) json_double("chase_ns", chase_ns);
+      json_uint("load_threads", nr_load);
+      if (nr_load) json_double("load_mibps", load_mibps);
+      json_end_record();
+      continue;
+    }
+    printf("W(%zu) pid=%d threads=%zu-%zu", i, (int)w->pid, w->first_thread,
+           w->first_thread + w->nr_threads - 1);
+    if (w->cgroup) printf(" cgroup=%s", w->cgroup);
+    if (nr_chase) printf(" ChaseThds=%zu ChaseNS=%.3f", nr_chase, chase_ns);
+    if (nr_load) printf(" LoadThds=%zu LdMibs=%.f", nr_load, load_mibps);
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  char *p;
+  int c;
+  size_t i;
+  size_t nr_threads = DEF_NR_THREADS;
+  size_t nr_samples = DEF_NR_SAMPLES;
+  size_t cache_flush_size = DEF_CACHE_FLUSH;
+  size_t delay = DEF_DELAY;
+  struct mem_sweep delay_sweep = {0};  // high == 0 unless sweeping
+  size_t offset = DEF_OFFSET;
+  size_t nr_chase_workers = DEF_NR_CHASE_WORKERS;
+  size_t nr_loaded_chase_threads = 1;  // chase threads in RUN_CHASE_LOADED
+  bool use_longer_chase = false;
+  int print_average = 0;
+  bool use_histogram = false;
+  const char *extra_args = NULL;
+  const char *memload_args = NULL;  // isa of simd-*, fields of mix
+  struct mix_args mix_args;
+  struct gups_args gups_args;
+  const char *probe_optarg = NULL;
+  struct probe_args probe_args;
+  size_t probe_mem = 0;
+  const struct simd_kernel *simd_kernel = NULL;
+  char memload_desc[64];
+  const char *placement_optarg = NULL;
+  const char *pattern_optarg = NULL;
+  struct chase_pattern pattern;
+  struct mem_policy *load_policies = NULL;  // -B, one per load thread in turn
+  size_t nr_load_policies = 0;
+  const char *chase_optarg = chases[0].name;
+  const chase_t *chase = &chases[0];
+  const char *memload_optarg = memloads[0].name;
+  const chase_t *memload = &memloads[0];
+  test_type_t run_test_type =
+      RUN_CHASE;  // RUN_CHASE, RUN_BANDWIDTH, RUN_CHASE_LOADED
+  struct generate_chase_common_args genchase_args;
+
+  default_page_size = page_size = get_native_page_size();
+
+  genchase_args.total_memory = DEF_TOTAL_MEMORY;
+  genchase_args.stride = DEF_STRIDE;
+  genchase_args.tlb_locality = DEF_TLB_LOCALITY * default_page_size;
+  genchase_args.gen_permutation = gen_random_permutation;
+  genchase_args.keyed = false;
+  genchase_args.pattern = NULL;
+  rng_seed = DEF_SEED;
+
+  setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+
+  timer_init();
+
+  while ((c = getopt(argc, argv, "aA:B:C:c:D:d:e:i:I:Jj:kl:F:p:HLm:n:oO:PR:r:S:s:T:t:vXyz:W:w:")) != -1) {
+    switch (c) {
+      case 'a':
+        print_average = 1;
+        break;
+      case 'A':
+        if (parse_ci_arg(optarg, &ci_target, &ci_max_secs)) {
+          fprintf(stderr, "Error: -A needs pct[:secs], both positive\n");
+          exit(1);
+        }
+        break;
+      case 'B':
+        nr_load_policies = 1;
+        for (p = optarg; *p; ++p) {
+          if (*p == '/') ++nr_load_policies;
+        }
+        load_policies = calloc(nr_load_policies, sizeof(*load_policies));
+        if (load_policies == NULL) {
+          fprintf(stderr, "Error: could not allocate load policies\n");
+          exit(1);
+        }
+        char *policy_saveptr = NULL;
+        nr_load_policies = 0;
+        for (char *tok = strtok_r(optarg, "/", &policy_saveptr); tok;
+             tok = strtok_r(NULL, "/", &policy_saveptr)) {
+          if (parse_mem_policy(tok, &load_policies[nr_load_policies++])) {
+            fprintf(stderr,
+                    "Error: a load policy must be local, N, bind:LIST or "
+                    "interleave:LIST: %s\n",
+                    tok);
+            exit(1);
+          }
+        }
+        if (nr_load_policies == 0) {
+          fprintf(stderr, "Error: -B needs at least one load policy\n");
+          exit(1);
+        }
+        break;
+      case 'C':
+        placement_optarg = optarg;
         break;
       case 'c':
         chase_optarg = optarg;
@@ -904,6 +2459,19 @@ int main(int argc, char **argv) {
         chase = &chases[i];
         if (strncmp("chaseload", chases[i].name, 12) == 0) {
           run_test_type = RUN_CHASE_LOADED;
+          if (*p == ':') {
+            nr_loaded_chase_threads = strtoul(p + 1, &p, 0);
+            if (*p || nr_loaded_chase_threads == 0) {
+              fprintf(stderr,
+                      "Error: chaseload:N needs a positive number of chase "
+                      "threads\n");
+              exit(1);
+            }
+          } else if (*p != 0) {
+            fprintf(stderr, "Error: not a recognized chase name: %s\n",
+                    optarg);
+            goto usage;
+          }
           if (verbosity > 0) {
             fprintf(stdout,
                     "Info: Loaded Latency chase selected. A -l memload can be "
@@ -932,7 +2500,27 @@ int main(int argc, char **argv) {
           exit(1);
         }
         break;
+      case 'D':
+        probe_optarg = optarg;
+        if (parse_probe_args(optarg, &probe_args)) {
+          fprintf(stderr,
+                  "Error: -D takes every=SECS,listen=[ADDR:]PORT|PATH,cpu=PCT,"
+                  "mem=SIZE\n");
+          exit(1);
+        }
+        break;
       case 'd':
+        if (strchr(optarg, ':')) {
+          if (parse_mem_sweep_arg(optarg, &delay_sweep) ||
+              delay_sweep.high == 0) {
+            fprintf(stderr,
+                    "Error: a delay sweep must be low:high:xF or low:high:+N "
+                    "(high > 0, F > 1)\n");
+            exit(1);
+          }
+          delay = delay_sweep.low;
+          break;
+        }
         delay = strtoul(optarg, &p, 0);
         if (*p) {
           fprintf(stderr, "Error: delay must be a non-negative integer\n");
@@ -958,8 +2546,44 @@ int main(int argc, char **argv) {
       case 'H':
         use_thp = true;
         break;
+      case 'e':
+        if (parse_perf_events(optarg, &perf_events)) {
+          fprintf(stderr,
+                  "Error: not a list of at most %d perf events: %s\nknown "
+                  "events: %s\n",
+                  MAX_PERF_EVENTS, optarg, perf_event_names());
+          exit(1);
+        }
+        use_perf_events = true;
+        break;
+      case 'i':
+        sample_interval_usecs = strtoul(optarg, &p, 0) * 1000;
+        if (*p || sample_interval_usecs == 0) {
+          fprintf(stderr,
+                  "Error: sample interval must be a positive number of "
+                  "milliseconds\n");
+          exit(1);
+        }
+        break;
+      case 'I':
+        chase_image_path = optarg;
+        break;
+      case 'J':
+        json_output = true;
+        break;
+      case 'j':
+        nr_chase_workers = strtoul(optarg, &p, 0);
+        if (*p || nr_chase_workers == 0) {
+          fprintf(stderr, "Error: nr_chase_workers must be a positive integer\n");
+          exit(1);
+        }
+        break;
+      case 'k':
+        genchase_args.keyed = true;
+        break;
       case 'l':
         memload_optarg = optarg;
+        memload_args = NULL;
         p = strchr(optarg, ':');
         if (p == NULL) p = optarg + strlen(optarg);
         for (i = 0; i < sizeof(memloads) / sizeof(memloads[0]); ++i) {
@@ -988,6 +2612,8 @@ int main(int argc, char **argv) {
             exit(1);
           }
           extra_args = p + 1;
+        } else if (memload->optional_arg && p[0] == ':' && p[1] != 0) {
+          memload_args = p + 1;
         } else if (*p != 0) {
           fprintf(stderr,
                   "Error: that memload does not take an argument:\n-c %s\t%s\n",
@@ -1025,6 +2651,28 @@ int main(int argc, char **argv) {
       case 'o':
         genchase_args.gen_permutation = gen_ordered_permutation;
         break;
+      case 'P':
+        use_histogram = true;
+        break;
+      case 'R':
+        rate_optarg = optarg;
+        rate_target = strtod(optarg, &p);
+        rate_pct = *p == '%';
+        if (rate_pct) ++p;
+        rate_total = strcmp(p, ":total") == 0;
+        if ((*p && !rate_total) || !(rate_target > 0.) ||
+            (rate_pct && rate_target > 100.)) {
+          fprintf(stderr, "Error: -R needs mibps[%%][:total], 0 < %% <= 100\n");
+          exit(1);
+        }
+        break;
+      case 'r':
+        rng_seed = strtoull(optarg, &p, 0);
+        if (*p) {
+          fprintf(stderr, "Error: seed must be a non-negative integer\n");
+          exit(1);
+        }
+        break;
       case 's':
         if (parse_mem_arg(optarg, &genchase_args.stride)) {
           fprintf(stderr,
@@ -1072,12 +2720,32 @@ int main(int argc, char **argv) {
           tok = strtok_r(NULL, ",", &saveptr);
         }
         break;
+      case 'w':
+        if (parse_workers(optarg, &workers)) {
+          fprintf(stderr,
+                  "Error: workers must be a list of N[@cgroup], at most %d\n",
+                  MAX_WORKERS);
+          exit(1);
+        }
+        use_workers = true;
+        break;
       case 'X':
         set_thread_affinity = 0;
         break;
       case 'y':
         print_timestamp = 1;
         break;
+      case 'z':
+        if (parse_chase_pattern(optarg, &pattern)) {
+          fprintf(stderr,
+                  "Error: pattern must be uniform, zipf or hot, optionally "
+                  "followed by\n"
+                  ":skew=S (> 0), frac=F (0-1), p=P (0-1) and run=N (> 0)\n");
+          exit(1);
+        }
+        pattern_optarg = optarg;
+        genchase_args.pattern = &pattern;
+        break;
       default:
         goto usage;
     }
@@ -1100,6 +2768,33 @@ int main(int argc, char **argv) {
             "used\n");
     fprintf(stderr,
             "-a       print average latency (default is best latency)\n");
+    fprintf(stderr,
+            "-A pct[:secs]  sample until the 95%% confidence intervals of "
+            "the chase latency\n"
+            "         and the load bandwidth are within pct%% of them (at "
+            "least %d samples)\n"
+            "         or for secs (default %.0f), replacing -n\n",
+            CI_MIN_SAMPLES, CI_DEF_MAX_SECS);
+    fprintf(stderr,
+            "-B policy/...  memory policy of each load thread's buffer, load "
+            "thread k uses\n"
+            "         policy k modulo the number of policies: local, a node N, "
+            "bind:LIST\n"
+            "         or interleave:LIST of nodes (e.g. 0-1,3), independent "
+            "of -W and -C\n");
+    fprintf(stderr,
+            "-C placement   cpus for the threads, either one list for all of "
+            "them or\n"
+            "         chase=list/load=list, e.g. chase=node0.core0/load=node1."
+            "cores\n"
+            "         a list is all, nodeN, packageN or cpus (0-3,8), "
+            "optionally\n"
+            "         .cores .llcs .packages .nodes (or .coreK etc.) to take "
+            "the first\n"
+            "         cpu of each (or the K-th), joined with +.  cpus used by "
+            "one role\n"
+            "         are not used by the other, a missing role gets the "
+            "remaining cpus\n");
     fprintf(stderr, "-c chase       select one of several different chases:\n");
     for (i = 0; i < sizeof(chases) / sizeof(chases[0]); ++i) {
       fprintf(stderr, "   %-12s%s\n", chases[i].usage1, chases[i].usage2);
@@ -1111,10 +2806,38 @@ int main(int argc, char **argv) {
       fprintf(stderr, "   %-12s%s\n", memloads[i].usage1, memloads[i].usage2);
     }
     fprintf(stderr, "         default: %s\n", memloads[0].name);
+    fprintf(stderr,
+            "         simd-*:isa forces one of: %s (default: the best the "
+            "cpu supports)\n",
+            simd_kernel_isas());
     fprintf(stderr,
             "-d delay  delay used between loads; only effecitve if used with "
             "load pattern with suffix injection_delay. (default %zu)\n",
             DEF_DELAY);
+    fprintf(stderr,
+            "-d low:high:xF sweep the delay from low to high, multiplying by F "
+            "(or adding N\n"
+            "         with +N), reusing the running threads for every delay, "
+            "and print the\n"
+            "         latency/bandwidth curve\n");
+    fprintf(stderr,
+            "-D every=SECS,listen=[ADDR:]PORT|PATH,cpu=PCT,mem=SIZE  keep "
+            "running and probe\n"
+            "         every "
+            "SECS (default %.0f) with parked threads in between, serving "
+            "the latest\n"
+            "         probe as prometheus metrics on a tcp port (every address "
+            "or ADDR) or a\n"
+            "         unix socket.  the probes must fit in PCT%% of a cpu "
+            "(default %.0f) and the\n"
+            "         arenas in SIZE (default 1g)\n",
+            DEF_PROBE_EVERY, DEF_PROBE_CPU_PCT);
+    fprintf(stderr,
+            "-e events      count these perf events in every sample, per load "
+            "of a chase thread\n"
+            "         and per 64 byte line of a load thread, one of:\n"
+            "         %s\n",
+            perf_event_names());
     fprintf(stderr,
             "-F nnnn[kmg]   amount of memory to use to flush the caches after "
             "constructing\n"
@@ -1135,9 +2858,16 @@ int main(int argc, char **argv) {
     fprintf(stderr,
             "-L             use longer chase\n");
     fprintf(stderr,
-            "-n nr_samples  nr of 0.5 second samples to use (default %zu, 0 = "
+            "-n nr_samples  nr of samples to use (default %zu, 0 = "
             "infinite)\n",
             DEF_NR_SAMPLES);
+    fprintf(stderr,
+            "-i msecs       interval between samples (default %d)\n",
+            LOAD_DELAY_RUN_uS / 1000);
+    fprintf(stderr,
+            "-P             time each block of loads and print per thread "
+            "latency\n"
+            "         percentiles (simple, critword and parallel chases)\n");
     fprintf(stderr,
             "-o       perform an ordered traversal (rather than random)\n");
     fprintf(
@@ -1152,20 +2882,99 @@ int main(int argc, char **argv) {
             "stride\n");
     fprintf(stderr, "-t nr_threads  number of threads (default %zu)\n",
             DEF_NR_THREADS);
+    fprintf(stderr,
+            "-I file        load the chase from this image if it was saved "
+            "with the same\n"
+            "         settings, otherwise build it and save it there\n");
+    fprintf(stderr,
+            "-j nr_workers  number of threads used to build each chase "
+            "(default %zu)\n"
+            "         the workers first touch the chase, use -W or numactl to "
+            "control placement\n",
+            DEF_NR_CHASE_WORKERS);
+    fprintf(stderr,
+            "-J             print JSON lines: the host, the configuration, "
+            "every sample\n"
+            "         and the result as one object per line\n");
+    fprintf(stderr,
+            "-k             walk a keyed bijection instead of storing the "
+            "permutation\n"
+            "         needs no memory beyond the arena, but takes longer to "
+            "build\n");
+    fprintf(stderr,
+            "-r seed        seed for the chase and mixer generator "
+            "(default %" PRIu64 ")\n",
+            DEF_SEED);
+    fprintf(stderr,
+            "-R mibps[%%][:total]  hold every load thread (or all of them "
+            "together) at this\n"
+            "         rate, or at this percentage of the rate it reaches "
+            "unthrottled\n");
     fprintf(stderr, "-v       verbose output (default %u)\n", verbosity);
     fprintf(
         stderr,
         "-W mbind list  list of node:weight,... pairs for allocating memory\n"
         "         has no effect if -H flag is specified\n"
-        "         0:10,1:90 weights it as 10%% on 0 and 90%% on 1\n");
+        "         0:10,1:90 weights it as 10%% on 0 and 90%% on 1\n"
+        "         weighted interleave is used if the system wide node "
+        "weights\n"
+        "         already have this ratio, they are never changed\n");
+    fprintf(stderr,
+            "-w N[@cgroup],...  run the threads in worker processes, each "
+            "taking the next N\n"
+            "         threads (replacing -t) and joining the cgroup (below "
+            "/sys/fs/cgroup\n"
+            "         unless absolute).  the arena is shared and built once, "
+            "the workers\n"
+            "         start together and every thread is sampled as usual\n");
     fprintf(stderr, "-X       do not set thread affinity (default %u)\n",
             set_thread_affinity);
     fprintf(stderr,
             "-y       print timestamp in front of each line (default %u)\n",
             print_timestamp);
+    fprintf(stderr,
+            "-z pattern  draw the chase from an access pattern instead of a "
+            "permutation:\n"
+            "         uniform, zipf or hot with optional :skew=S (default "
+            "0.99), frac=F of\n"
+            "         the elements hot (default 0.1), p=P of the loads to "
+            "them (default 0.9)\n"
+            "         and run=N elements read in order per draw\n");
+    exit(1);
+  }
+
+  if (genchase_args.pattern &&
+      (genchase_args.keyed || use_longer_chase ||
+       genchase_args.gen_permutation == gen_ordered_permutation)) {
+    fprintf(stderr, "Error: -z can not be combined with -k, -L or -o\n");
+    exit(1);
+  }
+
+  if (!strcmp(chase->name, "dirty") &&
+      (strtoul(extra_args, &p, 0) > 100 || *p)) {
+    fprintf(stderr, "Error: dirty:N needs 0 <= N <= 100\n");
     exit(1);
   }
 
+  if (use_workers) {
+    // the histograms and the chase image barrier are private to a process
+    if (use_histogram || chase_image_path) {
+      fprintf(stderr, "Error: -w can not be combined with -P or -I\n");
+      exit(1);
+    }
+    nr_threads = workers.nr_threads;
+  }
+
+  if (placement_optarg) {
+    static const char *const roles[] = {"chase", "load", NULL};
+    if (!set_thread_affinity) {
+      fprintf(stderr, "Error: -C can not be combined with -X\n");
+      exit(1);
+    }
+    if (parse_placement(placement_optarg, roles, &placement)) exit(1);
+    use_placement = true;
+  }
+
   if (genchase_args.stride < sizeof(void *)) {
     fprintf(stderr, "stride must be at least %zu\n", sizeof(void *));
     exit(1);
@@ -1192,26 +3001,206 @@ int main(int argc, char **argv) {
         genchase_args.total_memory % genchase_args.tlb_locality;
   }
 
+  size_t nr_chase_threads = 0, nr_load_threads = 0;
+  switch (run_test_type) {
+    case RUN_CHASE:
+      nr_chase_threads = nr_threads;
+      break;
+    case RUN_CHASE_LOADED:
+      if (nr_loaded_chase_threads > nr_threads) {
+        fprintf(stderr,
+                "Error: chaseload:%zu needs at least %zu threads (-t)\n",
+                nr_loaded_chase_threads, nr_loaded_chase_threads);
+        exit(1);
+      }
+      nr_chase_threads = nr_loaded_chase_threads;
+      break;
+    default:
+      break;
+  }
+
   genchase_args.nr_mixer_indices =
       genchase_args.stride / chase->base_object_size;
-  if ((run_test_type == RUN_CHASE) &&
-      (genchase_args.nr_mixer_indices < nr_threads * chase->parallelism)) {
+  if (genchase_args.nr_mixer_indices < nr_chase_threads * chase->parallelism) {
     fprintf(stderr,
             "the stride is too small to interleave that many threads, need at "
             "least %zu bytes\n",
-            nr_threads * chase->parallelism * chase->base_object_size);
+            nr_chase_threads * chase->parallelism * chase->base_object_size);
+    exit(1);
+  }
+
+  if (load_policies && run_test_type == RUN_CHASE) {
+    fprintf(stderr, "Error: -B only applies to the load threads (-l)\n");
+    exit(1);
+  }
+
+  if (rate_optarg) {
+    if (run_test_type == RUN_CHASE) {
+      fprintf(stderr, "Error: -R only applies to the load threads (-l)\n");
+      exit(1);
+    }
+    load_chunk_bytes = LOAD_PACED_CHUNK_BYTES;
+  }
+
+  if (run_test_type != RUN_CHASE && memload->fn == load_mix) {
+    if (parse_mix_args(memload_args, &mix_args)) {
+      fprintf(stderr,
+              "Error: mix takes rd=N,wr=N,width=B,stride=B,nt with width one "
+              "of 8, 16, 32, 64 and stride a multiple of 8 >= width\n");
+      exit(1);
+    }
+#if defined(__aarch64__)
+    // stnp stores a pair of registers, there is no 8 byte nontemporal store.
+    if (mix_args.nt && mix_args.width == 8) {
+      fprintf(stderr, "Error: mix nt needs width=16 or more on arm64\n");
+      exit(1);
+    }
+#elif !defined(__x86_64__)
+    if (mix_args.nt) {
+      fprintf(stderr, "Error: mix nt is not supported on this arch\n");
+      exit(1);
+    }
+#endif
+    if (genchase_args.total_memory <
+        mix_args.stride * (mix_args.rd + mix_args.wr)) {
+      fprintf(stderr, "Error: -m is too small for one round of the mix\n");
+      exit(1);
+    }
+  }
+
+  if (run_test_type != RUN_CHASE && memload->fn == load_gups) {
+    if (parse_gups_args(memload_args, &gups_args)) {
+      fprintf(stderr,
+              "Error: gups takes upd=P,batch=N,depth=N with P <= 100, 1 <= "
+              "batch <= %d and depth <= %d\n",
+              GUPS_MAX_BATCH, GUPS_MAX_DEPTH);
+      exit(1);
+    }
+    if (genchase_args.total_memory < DEF_CACHELINE) {
+      fprintf(stderr, "Error: -m is too small for the gups load\n");
+      exit(1);
+    }
+    load_access_bytes = DEF_CACHELINE;
+    load_update_share = gups_args.upd / 100.;
+  }
+
+  if (run_test_type != RUN_CHASE && memload->fn == load_simd) {
+    simd_kernel =
+        select_simd_kernel(memload->name + strlen("simd-"), memload_args);
+    if (simd_kernel == NULL) {
+      fprintf(stderr,
+              "Error: no %s kernel for %s on this cpu (built in isas: %s)\n",
+              memload->name, memload_args ? memload_args : "any isa",
+              simd_kernel_isas());
+      exit(1);
+    }
+    // report the kernel that actually runs
+    snprintf(memload_desc, sizeof(memload_desc), "%s:%s", memload->name,
+             simd_kernel->isa);
+    memload_optarg = memload_desc;
+  }
+
+  if (delay_sweep.high) {
+    if (run_test_type == RUN_CHASE ||
+        strcmp(memload->name, "stream-triad-nontemporal-injection-delay")) {
+      fprintf(stderr,
+              "Error: a delay sweep needs -l "
+              "stream-triad-nontemporal-injection-delay\n");
+      exit(1);
+    }
+    if (nr_samples == 0 || use_histogram) {
+      fprintf(stderr,
+              "Error: a delay sweep needs a finite number of samples and can "
+              "not be used with -P\n");
+      exit(1);
+    }
+  }
+  // sample until the confidence intervals are met (or ci_max_secs passed)
+  if (ci_target > 0.) nr_samples = 0;
+
+  if (probe_optarg) {
+    // the chase, the flush arena and every load buffer stay resident
+    size_t mem = cache_flush_size +
+                 (nr_threads - nr_chase_threads) *
+                     (genchase_args.total_memory + offset);
+    if (run_test_type != RUN_BANDWIDTH) {
+      mem += genchase_args.total_memory + offset;
+    }
+    if (use_workers || delay_sweep.high) {
+      fprintf(stderr,
+              "Error: -D can not be combined with -w or a delay sweep\n");
+      exit(1);
+    }
+    check_probe_budget(&probe_args, nr_threads, nr_samples, mem);
+    if (probe_args.listen && metrics_listen(probe_args.listen, &probe_server)) {
+      exit(1);
+    }
+    probe_mem = mem;
+    struct sigaction sa = {.sa_handler = park_handler, .sa_flags = SA_RESTART};
+    sigemptyset(&sa.sa_mask);
+    sigaction(PARK_SIGNAL, &sa, NULL);
+  }
+
+  if (use_perf_events) check_perf_events(&perf_events);
+
+  if (json_output && (verbosity > 0 || print_timestamp)) {
+    fprintf(stderr, "Error: -J can not be combined with -v or -y\n");
+    exit(1);
+  }
+
+  if (use_histogram && run_test_type != RUN_BANDWIDTH && !chase->hist_fn) {
+    fprintf(stderr, "Error: -P is not supported by the %s chase\n",
+            chase->usage1);
     exit(1);
   }
 
   if (verbosity > 0) {
     printf("nr_threads = %zu\n", nr_threads);
+    printf("nr_chase_threads = %zu\n", nr_chase_threads);
     print_page_size(page_size, use_thp);
+    printf("timer = %s", timer_source());
+    if (timer_ghz() > 0.) printf(" (%.3f GHz)", timer_ghz());
+    printf("\n");
     printf("total_memory = %zu (%.1f MiB)\n", genchase_args.total_memory,
            genchase_args.total_memory / (1024. * 1024.));
     printf("stride = %zu\n", genchase_args.stride);
     printf("tlb_locality = %zu\n", genchase_args.tlb_locality);
+    printf("seed = %" PRIu64 "\n", rng_seed);
+    printf("nr_chase_workers = %zu\n", nr_chase_workers);
+    printf("sample_interval = %" PRIu64 " ms\n",
+           sample_interval_usecs / 1000);
+    if (genchase_args.keyed) printf("keyed chase\n");
+    if (pattern_optarg) printf("pattern = %s\n", pattern_optarg);
+    if (chase_image_path) printf("chase image = %s\n", chase_image_path);
+    if (use_placement) print_placement(&placement);
+    if (use_workers) print_workers(&workers);
+    if (use_perf_events) {
+      printf("perf events =");
+      for (i = 0; i < perf_events.nr; ++i) {
+        printf(" %s", perf_events.event[i].name);
+      }
+      printf("\n");
+    }
+    if (load_policies) {
+      printf("load policies =");
+      for (i = 0; i < nr_load_policies; ++i) {
+        printf(" ");
+        print_mem_policy(&load_policies[i]);
+      }
+      printf("\n");
+    }
     printf("chase = %s\n", chase_optarg);
     printf("memload = %s\n", memload_optarg);
+    if (run_test_type != RUN_CHASE && memload->fn == load_mix) {
+      printf("mix = %zu:%zu rd:wr, width %zu, stride %zu%s\n", mix_args.rd,
+             mix_args.wr, mix_args.width, mix_args.stride,
+             mix_args.nt ? ", nontemporal stores" : "");
+    }
+    if (run_test_type != RUN_CHASE && memload->fn == load_gups) {
+      printf("gups = %zu%% updates, batch %zu, depth %zu%s\n",
+             gups_args.upd, gups_args.batch, gups_args.depth,
+             gups_args.depth ? "" : " (independent addresses)");
+    }
     if (run_test_type == RUN_CHASE) printf("run_test_type = RUN_CHASE\n");
     if (run_test_type == RUN_BANDWIDTH)
       printf("run_test_type = RUN_BANDWIDTH\n");
@@ -1219,261 +3208,353 @@ int main(int argc, char **argv) {
       printf("run_test_type = RUN_CHASE_LOADED\n");
   }
 
+  if (json_output) {
+    static const char *const test_types[] = {
+        [RUN_CHASE] = "chase",
+        [RUN_BANDWIDTH] = "bandwidth",
+        [RUN_CHASE_LOADED] = "loaded_chase",
+    };
+    // the default chase name is padded for the summary table
+    char chase_name[64];
+    snprintf(chase_name, sizeof(chase_name), "%s", chase_optarg);
+    for (p = chase_name + strlen(chase_name); p > chase_name && p[-1] == ' ';)
+      *--p = 0;
+    json_host_record("multiload");
+    json_record("multiload", "config");
+    json_string("test", test_types[run_test_type]);
+    if (run_test_type != RUN_BANDWIDTH) json_string("chase", chase_name);
+    if (run_test_type != RUN_CHASE) json_string("memload", memload_optarg);
+    json_uint("nr_threads", nr_threads);
+    json_uint("nr_chase_threads", nr_chase_threads);
+    json_uint("total_memory", genchase_args.total_memory);
+    json_uint("stride", genchase_args.stride);
+    json_uint("tlb_locality", genchase_args.tlb_locality);
+    json_uint("page_size", page_size);
+    json_bool("thp", use_thp);
+    json_bool("ordered",
+              genchase_args.gen_permutation == gen_ordered_permutation);
+    json_bool("keyed", genchase_args.keyed);
+    json_bool("longer_chase", use_longer_chase);
+    if (pattern_optarg) json_string("pattern", pattern_optarg);
+    json_uint("seed", rng_seed);
+    json_uint("offset", offset);
+    json_uint("cache_flush_size", cache_flush_size);
+    json_uint("nr_samples", nr_samples);
+    json_uint("sample_ns", sample_interval_usecs * 1000);
+    if (ci_target > 0.) {
+      json_double("ci_target", ci_target);
+      json_double("ci_max_secs", ci_max_secs);
+    }
+    if (rate_optarg) json_string("load_rate", rate_optarg);
+    if (probe_optarg) json_string("probe", probe_optarg);
+    if (delay_sweep.high) {
+      json_uint("delay_low", delay_sweep.low);
+      json_uint("delay_high", delay_sweep.high);
+    } else {
+      json_uint("delay", delay);
+    }
+    json_bool("affinity", set_thread_affinity);
+    if (placement_optarg) json_string("placement", placement_optarg);
+    if (use_workers) {
+      json_array("workers");
+      for (i = 0; i < workers.nr; ++i) {
+        json_object(NULL);
+        json_uint("first_thread", workers.worker[i].first_thread);
+        json_uint("nr_threads", workers.worker[i].nr_threads);
+        if (workers.worker[i].cgroup) {
+          json_string("cgroup", workers.worker[i].cgroup);
+        }
+        json_end();
+      }
+      json_end();
+    }
+    if (chase_image_path) json_string("chase_image", chase_image_path);
+    if (use_perf_events) {
+      json_array("perf_events");
+      for (i = 0; i < perf_events.nr; ++i) {
+        json_string(NULL, perf_events.event[i].name);
+      }
+      json_end();
+    }
+    json_end_record();
+  }
+
+  set_chase_workers(nr_chase_workers);
   rng_init(1);
 
+  uint64_t phase_start;
   if (run_test_type != RUN_BANDWIDTH) {
+    phase_start = now_nsec();
     generate_chase_mixer(&genchase_args, nr_threads * chase->parallelism);
+    phase_ns.mixer = now_nsec() - phase_start;
 
     // generate the chases by launching multiple threads
     if (verbosity > 2) printf("allocate genchase_args.arena\n");
+    phase_start = now_nsec();
     genchase_args.arena =
         (char *)alloc_arena_mmap(page_size, use_thp,
-                                 genchase_args.total_memory + offset, -1) +
+                                 genchase_args.total_memory + offset,
+                                 use_workers ? ARENA_SHARED : -1) +
         offset;
+    phase_ns.alloc = now_nsec() - phase_start;
+    // with a single chase worker the pinned chase threads first touch their
+    // chases, as the load threads do their buffers
+    if (nr_chase_workers > 1) {
+      phase_start = now_nsec();
+      arena_prefault(genchase_args.arena - offset,
+                     genchase_args.total_memory + offset, page_size, true);
+      phase_ns.fault = now_nsec() - phase_start;
+    }
+    if (chase_image_path) {
+      // only the chase threads build (and save) chases
+      snprintf(chase_image_config, sizeof(chase_image_config),
+               "multiload c=%s m=%zu s=%zu T=%zu t=%zu r=%" PRIu64
+               " k=%d L=%d o=%d z=%s",
+               chase_optarg, genchase_args.total_memory, genchase_args.stride,
+               genchase_args.tlb_locality, nr_threads, rng_seed,
+               genchase_args.keyed, use_longer_chase,
+               genchase_args.gen_permutation == gen_ordered_permutation,
+               pattern_optarg ? pattern_optarg : "");
+      nr_chase_heads = nr_threads * chase->parallelism;
+      chase_heads = calloc(nr_chase_heads, sizeof(*chase_heads));
+      if (chase_heads == NULL) {
+        fprintf(stderr, "Could not allocate chase heads\n");
+        exit(1);
+      }
+      chase_image_loaded = chase_image_load(
+          chase_image_path, chase_image_config, genchase_args.arena,
+          genchase_args.total_memory, chase_heads, nr_chase_heads);
+      if (!chase_image_loaded &&
+          pthread_barrier_init(&chase_image_barrier, NULL, nr_chase_threads)) {
+        perror("pthread_barrier_init");
+        exit(1);
+      }
+    }
   }
-  per_thread_t *thread_data = alloc_arena_mmap(
-      default_page_size, false, nr_threads * sizeof(per_thread_t), -1);
+  phase_start = now_nsec();
+  per_thread_t *thread_data =
+      alloc_arena_mmap(default_page_size, false,
+                       nr_threads * sizeof(per_thread_t),
+                       use_workers ? ARENA_SHARED : -1);
   void *flush_arena = NULL;
   if (verbosity > 2) printf("allocate cache flush\n");
   if (cache_flush_size) {
     flush_arena = alloc_arena_mmap(default_page_size, false, cache_flush_size,
                                    -1);
-    memset(flush_arena, 1, cache_flush_size);  // ensure pages are mapped
+  }
+  phase_ns.alloc += now_nsec() - phase_start;
+  if (cache_flush_size) {
+    phase_start = now_nsec();
+    arena_prefault(flush_arena, cache_flush_size, default_page_size, true);
+    phase_ns.fault += now_nsec() - phase_start;
   }
 
   pthread_t thread;
-  size_t nr_chase_threads = 0, nr_load_threads = 0;
+  nr_load_threads = nr_threads - nr_chase_threads;
   nr_to_startup = nr_threads;
   for (i = 0; i < nr_threads; ++i) {
     thread_data[i].x.genchase_args = &genchase_args;
     thread_data[i].x.nr_threads = nr_threads;
+    thread_data[i].x.nr_chase_threads = nr_chase_threads;
     thread_data[i].x.thread_num = i;
     thread_data[i].x.extra_args = extra_args;
     thread_data[i].x.chase = chase;
     thread_data[i].x.flush_arena = flush_arena;
     thread_data[i].x.cache_flush_size = cache_flush_size;
     thread_data[i].x.memload = memload;
+    thread_data[i].x.simd_kernel = simd_kernel;
+    thread_data[i].x.mix = &mix_args;
+    thread_data[i].x.gups = &gups_args;
     thread_data[i].x.load_arena = NULL;  // memory buffer used by this thread
     thread_data[i].x.load_total_memory =
         genchase_args.total_memory;         // size of the arena
     thread_data[i].x.load_offset = offset;  // memory buffer offset
+    thread_data[i].x.load_policy =
+        load_policies && i >= nr_chase_threads
+            ? &load_policies[(i - nr_chase_threads) % nr_load_policies]
+            : NULL;
     thread_data[i].x.delay = delay;
     thread_data[i].x.use_longer_chase = use_longer_chase;
-
-    if (run_test_type == RUN_CHASE_LOADED) {
-      if (i == 0) {
-        thread_data[i].x.run_test_type = RUN_CHASE;
-        nr_chase_threads++;
-        if (verbosity > 2) printf("main: Starting C[%ld]\n", i);
-        if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
-          perror("pthread_create");
-          exit(1);
-        }
-      } else {
-        thread_data[i].x.run_test_type = RUN_BANDWIDTH;
-        nr_load_threads++;
-        if (verbosity > 2) printf("main: Starting M[%ld]\n", i);
-        if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
-          perror("pthread_create");
-          exit(1);
-        }
-      }
-
-    } else if (run_test_type == RUN_CHASE) {
+    thread_data[i].x.hist = NULL;
+    thread_data[i].x.stop = 0;
+    thread_data[i].x.pace.next_ns = 0;
+    thread_data[i].x.pace.ns_per_byte = 0.;
+    thread_data[i].x.pacer = NULL;
+    if (rate_optarg && i >= nr_chase_threads) {
+      thread_data[i].x.pacer = rate_total
+                                   ? &thread_data[nr_chase_threads].x.pace
+                                   : &thread_data[i].x.pace;
+    }
+    if (i < nr_chase_threads) {
       thread_data[i].x.run_test_type = RUN_CHASE;
-      nr_chase_threads++;
-      if (verbosity > 2) printf("main: Starting C[%ld]\n", i);
-      if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
-        perror("pthread_create");
-        exit(1);
-      }
+      if (use_histogram) thread_data[i].x.hist = histogram_alloc();
     } else {
-      nr_load_threads++;
       thread_data[i].x.run_test_type = RUN_BANDWIDTH;
-      if (verbosity > 2) printf("main: Starting M[%ld]\n", i);
-      if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
-        perror("pthread_create");
-        exit(1);
-      }
     }
   }
 
+  // with -w every worker starts its own threads, the coordinator none
+  phase_start = now_nsec();
+  size_t first_thread = 0, end_thread = nr_threads;
+  if (use_workers) {
+    start_barrier = alloc_shared_barrier(nr_threads + 1);
+    self_worker = start_workers(&workers);
+    first_thread = self_worker ? self_worker->first_thread : 0;
+    end_thread = self_worker ? first_thread + self_worker->nr_threads : 0;
+  }
+  for (i = first_thread; i < end_thread; ++i) {
+    if (verbosity > 2) {
+      printf("main: Starting %c[%ld]\n",
+             thread_data[i].x.run_test_type == RUN_CHASE ? 'C' : 'M', i);
+    }
+    if (pthread_create(&thread, NULL, thread_start, &thread_data[i])) {
+      perror("pthread_create");
+      exit(1);
+    }
+    thread_data[i].x.thread = thread;
+  }
+  if (self_worker) {
+    // the coordinator samples our threads until it kills us
+    for (;;) pause();
+  }
+
   // now wait for them all to finish generating their chases/memloads and start
   // testing
   if (verbosity > 2) printf("main: waiting for threads to initialize\n");
-  pthread_mutex_lock(&wait_mutex);
-  if (nr_to_startup) {
-    pthread_cond_wait(&wait_cond, &wait_mutex);
+  if (start_barrier) {
+    pthread_barrier_wait(start_barrier);
+  } else {
+    pthread_mutex_lock(&wait_mutex);
+    if (nr_to_startup) {
+      pthread_cond_wait(&wait_cond, &wait_mutex);
+    }
+    pthread_mutex_unlock(&wait_mutex);
   }
-  pthread_mutex_unlock(&wait_mutex);
+  phase_ns.threads = now_nsec() - phase_start;
+  report_phases();
   usleep(LOAD_DELAY_WARMUP_uS);  // Give OS scheduler thread migrations time to
                                  // settle down.
 
-  if (verbosity > 2) printf("main: start sampling thread progress\n");
-  // now start sampling their progress
-  nr_samples = nr_samples + 1;  // we drop the first sample
-  double *cur_samples = alloca(nr_threads * sizeof(*cur_samples));
-  uint64_t last_sample_time, cur_sample_time;
-  double chase_min = 1. / 0., chase_max = 0.;
-  double chase_running_sum = 0., load_running_sum = 0.,
-         chase_running_geosum = 0.;
-  double load_max_mibps = 0, load_min_mibps = 1. / 0.;
-  double chase_thd_sum = 0, load_thd_sum = 0;
-  uint64_t time_delta = 0;
-  int ready;
-
-  last_sample_time = now_nsec();
-  for (size_t sample_no = 0; nr_samples == 1 || sample_no < nr_samples;
-       ++sample_no) {
-    if (verbosity > 0) printf("main: sample_no=%ld ", sample_no);
-    usleep(LOAD_DELAY_RUN_uS);
-    // Request threads to update their sample
-    for (i = 0; i < nr_threads; ++i) {
-      thread_data[i].x.sample_no = sample_no;
-    }
-
-    chase_thd_sum = 0.;
-    load_thd_sum = 0.;
-    usleep(LOAD_DELAY_SAMPLE_uS);  // Give load threads time to update sample
-                                   // count. Chase threads are always updating
-    for (i = 0; i < nr_threads; ++i) {
-      if (verbosity > 2) printf("-");
-      ready = 0;
-      while (ready == 0) {
-        cur_samples[i] =
-            (double)__sync_lock_test_and_set(&thread_data[i].x.count, 0);
-        if (cur_samples[i] != 0) {
-          // Chase threads start at thread 0 and should always be ready,
-          // therefore we read chase timestamp as soon as finished reading the
-          // last chase thread Load threads return pre-calculated MiB/s so don't
-          // use this timer
-          if ((i + 1) == nr_chase_threads) {
-            cur_sample_time = now_nsec();
-            time_delta = cur_sample_time - last_sample_time;
-            last_sample_time = cur_sample_time;
-          }
-          ready = 1;
-        } else {
-          if (verbosity > 2) printf("*");
-          usleep(LOAD_DELAY_SAMPLE_uS);
-        }
-      }
-    }
-
-    for (i = 0; i < nr_threads; ++i) {
-      // printf("main: thread[%d], run_mode=%i\n", t->x.thread_num,
-      // t->x.run_test_type);
-      if (thread_data[i].x.run_test_type == RUN_CHASE) {
-        chase_thd_sum += (double)cur_samples[i];
-        if (verbosity > 1) {
-          double z = time_delta / (double)cur_samples[i];
-          double mibps = sizeof(void *) / (z / 1000000000.0) / (1024 * 1024);
-          printf(" MC(%ld)%.3f, %6.1f(ns), %.3f(MiB/s)", i, cur_samples[i], z,
-                 mibps);
-        }
-      } else {
-        load_thd_sum += (double)cur_samples[i];
-        if (verbosity > 1) {
-          printf(" ML(%ld)%.0f(MiB/s)", i, cur_samples[i]);
-        }
-      }
-    }
-
-    // we drop the first sample because it's fairly likely one
-    // thread had some advantage initially due to still having
-    // portions of the chase in a cache.
-    if (sample_no == 0) {
-      if (verbosity > 0) printf("\n");
-      continue;
-    }
-
-    // Calcuate chase overall thread stats.
-    if (chase_thd_sum != 0) {
-      double t = time_delta / (double)chase_thd_sum;
-      chase_running_sum += t;
-      chase_running_geosum += log(t);
-      if (t < chase_min) chase_min = t;
-      if (t > chase_max) chase_max = t;
-      if (verbosity > 0) {
-        double z = t * nr_chase_threads;
-        printf(" avg=%.1f(ns)\n", z);
-      }
-    }
-
-    // Calculate memory load overall thread stats
-    if (load_thd_sum != 0) {
-      if (load_thd_sum > load_max_mibps) load_max_mibps = load_thd_sum;
-      if (load_thd_sum < load_min_mibps) load_min_mibps = load_thd_sum;
-      load_running_sum += load_thd_sum;
-      if (verbosity > 0) {
-        printf(" main: threads=%ld, Total(MiB/s)=%.*f, PerThread=%.f\n",
-               nr_load_threads, load_thd_sum < 100. ? 3 : 1, load_thd_sum,
-               load_thd_sum / nr_load_threads);
-      }
-    }
+  double load_peak_mibps = 0., load_target_mibps = 0.;
+  if (rate_optarg) {
+    load_target_mibps =
+        set_load_rates(thread_data, nr_threads, nr_chase_threads,
+                       nr_load_threads, &load_peak_mibps);
   }
 
-  // printf("sample_sum=%.f\n", sample_sum);
-  // printf("main: float=%li, void*=%li, size_t=%li, uint64_t=%li, double=%li,
-  // long=%li, int=%li\n",
-  //       sizeof(float), sizeof(void*), sizeof(size_t), sizeof(uint64_t),
-  //       sizeof(double), sizeof(long), sizeof(int) );
-  double ChasNS = 0, ChasDEV = 0, ChasBEST = 0, ChasWORST = 0, ChasAVG = 0,
-         ChasMibs = 0, ChasGEO = 0;
-  double LdAvgMibs = 0, LdMibsDEV = 0;
+  if (probe_optarg) {
+    char chase_name[64];
+    snprintf(chase_name, sizeof(chase_name), "%s", chase_optarg);
+    for (p = chase_name + strlen(chase_name); p > chase_name && p[-1] == ' ';)
+      *--p = 0;
+    run_probes(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+               nr_samples, print_average, &probe_args, chase_name,
+               memload_optarg, probe_mem);
+  }
 
-  if (nr_chase_threads != 0) {
-    ChasAVG = chase_running_sum * nr_chase_threads / (nr_samples - 1);
-    ChasGEO =
-        nr_chase_threads * exp(chase_running_geosum / ((double)nr_samples - 1));
-    ChasBEST = chase_min * nr_chase_threads;
-    ChasWORST = chase_max * nr_chase_threads;
-    ChasDEV = ((ChasWORST - ChasBEST) / ChasAVG);
-    if (verbosity > 0) {
-      printf(
-          "ChasAVG=%-8f, ChasGEO=%-8f, ChasBEST=%-8f, ChasWORST=%-8f, "
-          "ChasDEV=%-8.3f\n",
-          ChasAVG, ChasGEO, ChasBEST, ChasWORST, ChasDEV);
-    }
-    // if (print_average) ChasNS = ChasAVG;
-    if (print_average)
-      ChasNS = ChasGEO;
-    else
-      ChasNS = ChasBEST;
-    ChasMibs = nr_chase_threads *
-               (sizeof(void *) / (ChasNS / 1000000000.0) / (1024 * 1024));
+  if (delay_sweep.high) {
+    sweep_delays(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                 &delay_sweep, nr_samples, print_average);
+    timestamp();
+    exit(0);
   }
 
-  if (nr_load_threads != 0) {
-    LdAvgMibs = load_running_sum / (nr_samples - 1);
-    LdMibsDEV = ((load_max_mibps - load_min_mibps) / LdAvgMibs);
-    if (verbosity > 0) {
-      printf(
-          "LdAvgMibs=%-8f, LdMaxMibs=%-8f, LdMinMibs=%-8f, LdDevMibs=%-8.3f\n",
-          LdAvgMibs, load_max_mibps, load_min_mibps, LdMibsDEV);
+  struct load_result r;
+  r.thread_ns = alloca(nr_chase_threads * sizeof(*r.thread_ns));
+  r.thread_mibps = alloca(nr_load_threads * sizeof(*r.thread_mibps));
+  sample_threads(thread_data, nr_threads, nr_chase_threads, nr_load_threads,
+                 nr_samples, print_average, &r);
+  if (use_histogram) stop_chase_threads(thread_data, nr_chase_threads);
+
+  if (json_output) {
+    json_record("multiload", "result");
+    json_uint("nr_samples", ci_target > 0. ? r.nr_samples : nr_samples);
+    json_uint("bytes_per_thread", thread_data[0].x.load_total_memory);
+    json_result(&r, nr_chase_threads, nr_load_threads);
+    json_string("statistic", print_average ? "geomean" : "best");
+    if (rate_optarg) {
+      json_double("load_target_mibps", load_target_mibps);
+      if (rate_pct) json_double("load_peak_mibps", load_peak_mibps);
     }
+    if (use_histogram && nr_chase_threads) {
+      json_array("chase_ns_per_load_percentiles");
+      for (i = 0; i < nr_chase_threads; ++i) {
+        if (thread_data[i].x.hist) {
+          histogram_json(NULL, thread_data[i].x.hist, 1000.);
+        }
+      }
+      json_end();
+    }
+    json_end_record();
+    if (use_workers) report_workers(nr_chase_threads, &r);
+    exit(0);
   }
 
   const char *not_used = "--------";
   printf(
       "Samples\t, Byte/thd\t, ChaseThds\t, ChaseNS\t, ChaseMibs\t, "
       "ChDeviate\t, LoadThds\t, LdMaxMibs\t, LdAvgMibs\t, LdDeviate\t, "
-      "ChaseArg\t, MemLdArg\n");
+      "ChaseArg\t, MemLdArg%s\n",
+      ci_target > 0. ? "\t, ChaseCI\t, LoadCI" : "");
   printf(
       "%-6ld\t, %-11ld\t, %-8ld\t, %-8.3f\t, %-8.f\t, %-8.3f\t, %-8.f\t, "
       "%-8.f\t, %-8.f\t, %-8.3f",
-      nr_samples - 1, thread_data[0].x.load_total_memory, nr_chase_threads,
-      ChasNS, ChasMibs, ChasDEV, (double)nr_load_threads, load_max_mibps,
-      LdAvgMibs, LdMibsDEV);
+      ci_target > 0. ? r.nr_samples : nr_samples,
+      thread_data[0].x.load_total_memory, nr_chase_threads,
+      r.chase_ns, r.chase_mibps, r.chase_dev, (double)nr_load_threads,
+      r.load_max_mibps, r.load_avg_mibps, r.load_dev);
   switch (run_test_type) {
     case RUN_CHASE_LOADED:
-      printf("\t, %s\t, %s\n", chase_optarg, memload_optarg);
+      printf("\t, %s\t, %s", chase_optarg, memload_optarg);
       break;
     case RUN_BANDWIDTH:
-      printf("\t, %s\t, %s\n", not_used, memload_optarg);
+      printf("\t, %s\t, %s", not_used, memload_optarg);
       break;
     default:
-      printf("\t, %s\t, %s\n", chase_optarg, not_used);
+      printf("\t, %s\t, %s", chase_optarg, not_used);
+  }
+  if (ci_target > 0.) {
+    // in percent of the mean, like -A takes them
+    if (nr_chase_threads)
+      printf("\t, %-8.2f", r.chase_ci * 100.);
+    else
+      printf("\t, %s", not_used);
+    if (nr_load_threads)
+      printf("\t, %-8.2f", r.load_ci * 100.);
+    else
+      printf("\t, %s", not_used);
+  }
+  printf("\n");
+
+  // the gups load in million accesses and million updates per second
+  if (load_access_bytes && nr_load_threads) {
+    printf("LdAvgMaccs=%.3f LdMaxMups=%.3f LdAvgMups=%.3f\n",
+           load_maccesses(r.load_avg_mibps),
+           load_maccesses(r.load_max_mibps) * load_update_share,
+           load_maccesses(r.load_avg_mibps) * load_update_share);
+  }
+
+  // -R: what the loads were held to
+  if (rate_optarg) {
+    if (rate_pct) printf("LdPeakMibs=%.f ", load_peak_mibps);
+    printf("LdTargetMibs=%.f\n", load_target_mibps);
+  }
+
+  // with several loaded chase threads, report each of them as well
+  if (run_test_type == RUN_CHASE_LOADED && nr_chase_threads > 1) {
+    for (i = 0; i < nr_chase_threads; ++i) {
+      printf("MC(%zu) ChaseNS=%.3f\n", i, r.thread_ns[i]);
+    }
+  }
+  if (use_workers) report_workers(nr_chase_threads, &r);
+
+  if (use_histogram && nr_chase_threads) {
+    for (i = 0; i < nr_threads; ++i) {
+      if (!thread_data[i].x.hist) continue;
+      printf("MC(%zu) ns/load:", i);
+      histogram_print_percentiles(stdout, thread_data[i].x.hist, 1000.);
+      printf("\n");
+    }
   }
 
   timestamp();
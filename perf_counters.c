@@ -0,0 +1,210 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "perf_counters.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "json_out.h"
+
+#define HW_CACHE(cache, op, result)                                  \
+  (PERF_COUNT_HW_CACHE_##cache | (PERF_COUNT_HW_CACHE_OP_##op << 8) | \
+   (PERF_COUNT_HW_CACHE_RESULT_##result << 16))
+
+static const struct {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} event_names[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"l1d-misses", PERF_TYPE_HW_CACHE, HW_CACHE(L1D, READ, MISS)},
+    {"llc-misses", PERF_TYPE_HW_CACHE, HW_CACHE(LL, READ, MISS)},
+    {"dtlb-misses", PERF_TYPE_HW_CACHE, HW_CACHE(DTLB, READ, MISS)},
+    {"l1d-prefetches", PERF_TYPE_HW_CACHE, HW_CACHE(L1D, PREFETCH, ACCESS)},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+const char *perf_event_names(void) {
+  return "cycles, instructions, cache-misses, l1d-misses, llc-misses, "
+         "dtlb-misses, l1d-prefetches, task-clock, page-faults, "
+         "context-switches, rNNNN (raw, hex)";
+}
+
+int parse_perf_events(const char *str, struct perf_event_list *list) {
+  char *copy = strdup(str);
+  char *tok, *save = NULL, *end;
+  size_t i;
+  int rc = 0;
+
+  list->nr = 0;
+  for (tok = strtok_r(copy, ",", &save); tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    if (list->nr == MAX_PERF_EVENTS ||
+        strlen(tok) >= sizeof(list->event[0].name)) {
+      rc = -1;
+      break;
+    }
+    for (i = 0; i < sizeof(event_names) / sizeof(event_names[0]); ++i) {
+      if (strcmp(tok, event_names[i].name) == 0) break;
+    }
+    if (i < sizeof(event_names) / sizeof(event_names[0])) {
+      list->event[list->nr].type = event_names[i].type;
+      list->event[list->nr].config = event_names[i].config;
+    } else if (tok[0] == 'r' && tok[1] != 0) {
+      list->event[list->nr].type = PERF_TYPE_RAW;
+      list->event[list->nr].config = strtoull(tok + 1, &end, 16);
+      if (*end) rc = -1;
+    } else {
+      rc = -1;
+    }
+    strcpy(list->event[list->nr].name, tok);
+    ++list->nr;
+  }
+  free(copy);
+  if (list->nr == 0) return -1;
+  return rc;
+}
+
+static int open_event(const struct perf_event_list *list, size_t i,
+                      pid_t tid) {
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = list->event[i].type;
+  attr.config = list->event[i].config;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  // user space only, which is all an unprivileged user may count and all
+  // the chases and loads do anyway.  software events happen in the kernel.
+  if (attr.type != PERF_TYPE_SOFTWARE) {
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+  }
+  return syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0);
+}
+
+void check_perf_events(const struct perf_event_list *list) {
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    int fd = open_event(list, i, 0);
+    if (fd < 0) {
+      fprintf(stderr, "perf event %s is not available (%s), reporting n/a\n",
+              list->event[i].name, strerror(errno));
+    } else {
+      close(fd);
+    }
+  }
+}
+
+static void read_event(struct perf_counters *pc, size_t i, uint64_t *value,
+                       uint64_t *enabled, uint64_t *running) {
+  uint64_t buf[3] = {0, 0, 0};
+
+  if (read(pc->fd[i], buf, sizeof(buf)) != sizeof(buf)) {
+    buf[0] = buf[1] = buf[2] = 0;
+  }
+  *value = buf[0];
+  *enabled = buf[1];
+  *running = buf[2];
+}
+
+void perf_counters_open(struct perf_counters *pc,
+                        const struct perf_event_list *list, pid_t tid) {
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    pc->fd[i] = open_event(list, i, tid);
+    if (pc->fd[i] >= 0) {
+      read_event(pc, i, &pc->value[i], &pc->enabled[i], &pc->running[i]);
+    }
+  }
+}
+
+void perf_counters_close(struct perf_counters *pc,
+                         const struct perf_event_list *list) {
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    if (pc->fd[i] >= 0) close(pc->fd[i]);
+    pc->fd[i] = -1;
+  }
+}
+
+void perf_counters_sample(struct perf_counters *pc,
+                          const struct perf_event_list *list, double *delta) {
+  uint64_t value, enabled, running;
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    if (pc->fd[i] < 0) {
+      delta[i] = NAN;
+      continue;
+    }
+    read_event(pc, i, &value, &enabled, &running);
+    if (running == pc->running[i]) {
+      // never got a counter during this sample
+      delta[i] = enabled == pc->enabled[i] ? 0. : NAN;
+    } else {
+      delta[i] = (double)(value - pc->value[i]) *
+                 (enabled - pc->enabled[i]) / (running - pc->running[i]);
+    }
+    pc->value[i] = value;
+    pc->enabled[i] = enabled;
+    pc->running[i] = running;
+  }
+}
+
+void print_perf_deltas(const struct perf_event_list *list, const double *delta,
+                       double per, const char *unit) {
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    if (isnan(delta[i]) || per == 0.) {
+      printf(" %s=n/a", list->event[i].name);
+    } else {
+      double z = delta[i] / per;
+      printf(" %s=%.*f/%s", list->event[i].name, z < 100. ? 3 : 1, z, unit);
+    }
+  }
+}
+
+void json_perf_deltas(const char *key, const struct perf_event_list *list,
+                      const double *delta, const double *per, size_t n) {
+  size_t i, j;
+
+  json_object(key);
+  for (i = 0; i < list->nr; ++i) {
+    if (n > 1) json_array(list->event[i].name);
+    for (j = 0; j < n; ++j) {
+      double d = delta[j * list->nr + i];
+      json_double(n > 1 ? NULL : list->event[i].name,
+                  per[j] == 0. ? NAN : d / per[j]);
+    }
+    if (n > 1) json_end();
+  }
+  json_end();
+}
@@ -0,0 +1,70 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef PERF_COUNTERS_H_INCLUDED
+#define PERF_COUNTERS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define MAX_PERF_EVENTS 8
+
+// events given as a comma separated list of names (see perf_event_names())
+// or raw events "rNNNN" with a hex config, e.g. for prefetch or offcore
+// events of a particular cpu.
+struct perf_event_list {
+  size_t nr;
+  struct {
+    char name[32];
+    uint32_t type;
+    uint64_t config;
+  } event[MAX_PERF_EVENTS];
+};
+
+// the counters of one thread.  an event the kernel or cpu doesn't support
+// has fd -1 and reads as NAN.
+struct perf_counters {
+  int fd[MAX_PERF_EVENTS];
+  uint64_t value[MAX_PERF_EVENTS];
+  uint64_t enabled[MAX_PERF_EVENTS];
+  uint64_t running[MAX_PERF_EVENTS];
+};
+
+int parse_perf_events(const char *str, struct perf_event_list *list);
+const char *perf_event_names(void);
+
+// warn about the events which can't be counted here.
+void check_perf_events(const struct perf_event_list *list);
+
+// count the user space events of thread tid.
+void perf_counters_open(struct perf_counters *pc,
+                        const struct perf_event_list *list, pid_t tid);
+void perf_counters_close(struct perf_counters *pc,
+                         const struct perf_event_list *list);
+
+// the count of every event since the last sample (or the open), scaled up
+// if the kernel had to multiplex the counters.
+void perf_counters_sample(struct perf_counters *pc,
+                          const struct perf_event_list *list, double *delta);
+
+// print " name=N/unit" for every event, with the counts divided by per.
+void print_perf_deltas(const struct perf_event_list *list, const double *delta,
+                       double per, const char *unit);
+
+// a json object of every event divided by per, with n > 1 rows of deltas
+// (e.g. one per thread) giving an array per event.
+void json_perf_deltas(const char *key, const struct perf_event_list *list,
+                      const double *delta, const double *per, size_t n);
+
+#endif
@@ -11,10 +11,14 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#define _GNU_SOURCE
 #include "permutation.h"
 
 #include <assert.h>
 #include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -33,8 +37,91 @@
 // XXX: declare this somewhere
 extern int verbosity;
 
-__thread char *rng_buf;  // buf size (32 for now) determines the "randomness"
-__thread struct random_data *rand_state;  // per_thread state for random_r
+uint64_t rng_seed = 1;
+__thread uint64_t rng_state[4];
+
+//============================================================================
+// chase construction is split across worker threads.  every piece of work
+// seeds its own rng stream, so the result doesn't depend on how the work was
+// divided up.
+
+static size_t nr_chase_workers = 1;
+static cpu_set_t chase_worker_cpus;
+
+void set_chase_workers(size_t nr_workers) {
+  if (sched_getaffinity(0, sizeof(chase_worker_cpus), &chase_worker_cpus)) {
+    perror("sched_getaffinity");
+    exit(1);
+  }
+  nr_chase_workers = nr_workers ? nr_workers : 1;
+}
+
+struct chase_worker {
+  pthread_t thread;
+  range_fn_t fn;
+  void *ctx;
+  size_t begin;
+  size_t end;
+};
+
+static void *chase_worker_start(void *data) {
+  struct chase_worker *w = data;
+
+  if (sched_setaffinity(0, sizeof(chase_worker_cpus), &chase_worker_cpus)) {
+    perror("sched_setaffinity");
+    exit(1);
+  }
+  w->fn(w->ctx, w->begin, w->end);
+  return NULL;
+}
+
+// the caller does the first range itself.
+void chase_parallel_for(size_t n, range_fn_t fn, void *ctx) {
+  size_t nr = nr_chase_workers < n ? nr_chase_workers : n;
+  struct chase_worker *w;
+  size_t i;
+
+  if (nr <= 1) {
+    fn(ctx, 0, n);
+    return;
+  }
+  w = calloc(nr, sizeof(*w));
+  if (w == NULL) {
+    fprintf(stderr, "Could not allocate %zu chase workers\n", nr);
+    exit(1);
+  }
+  for (i = 0; i < nr; ++i) {
+    w[i].fn = fn;
+    w[i].ctx = ctx;
+    w[i].begin = n / nr * i + (i < n % nr ? i : n % nr);
+    w[i].end = w[i].begin + n / nr + (i < n % nr);
+  }
+  for (i = 1; i < nr; ++i) {
+    if (pthread_create(&w[i].thread, NULL, chase_worker_start, &w[i])) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+  fn(ctx, w[0].begin, w[0].end);
+  for (i = 1; i < nr; ++i) {
+    if (pthread_join(w[i].thread, NULL)) {
+      perror("pthread_join");
+      exit(1);
+    }
+  }
+  free(w);
+}
+
+// the rng stream for one piece of a chase: group 0 orders the tlb groups of
+// (mixer_idx, iteration), group g + 1 permutes the elements of tlb group g.
+#define RNG_STREAM_MIXER (~(uint64_t)0)
+static uint64_t chase_stream(size_t mixer_idx, size_t iteration,
+                             size_t group) {
+  uint64_t x = mixer_idx;
+  uint64_t h = rng_splitmix64(&x) ^ iteration;
+
+  return rng_splitmix64(&h) ^ group;
+}
 
 //============================================================================
 // a random permutation generator.  i think this algorithm is from Knuth.
@@ -121,6 +208,7 @@ void generate_chase_mixer(struct generate_chase_common_args *args,
 
   // we arrange r in a transposed manner so that all of the
   // data for a particular mixer_idx is packed together.
+  rng_init(RNG_STREAM_MIXER);
   for (i = 0; i < args->nr_mixers; ++i) {
     gen_permutation(t, nr_mixer_indices, 0);
     for (j = 0; j < nr_mixer_indices; ++j) {
@@ -132,64 +220,318 @@ void generate_chase_mixer(struct generate_chase_common_args *args,
   args->mixer = r;
 }
 
-// Generate a pointer chasing sequence according to chase args. 
+// shared state for building the pieces of one chase in parallel.
+struct chase_build {
+  char *arena;
+  size_t stride;
+  size_t nr_mixers;
+  size_t mixer_scale;
+  const perm_t *mixer;
+  void (*gen_permutation)(perm_t *, size_t, size_t);
+  size_t mixer_idx;
+  size_t iteration;
+  size_t nr_iteration;  // number of permutations chained by a longer chase
+  size_t nr_elts;
+  size_t nr_elts_per_tlb;
+  size_t base;  // first element number of the permutation being built
+  const perm_t *tlb_perm;
+  perm_t *perm;
+  perm_t *perm_inverse;
+};
+
+// permute the elements within tlb groups [begin, end)
+static void build_tlb_groups(void *data, size_t begin, size_t end) {
+  const struct chase_build *b = data;
+  size_t nr_elts_per_tlb = b->nr_elts_per_tlb;
+  size_t i;
+
+  for (i = begin; i < end; ++i) {
+    rng_init(chase_stream(b->mixer_idx, b->iteration, i + 1));
+    b->gen_permutation(&b->perm[i * nr_elts_per_tlb], nr_elts_per_tlb,
+                       b->base + b->tlb_perm[i] * nr_elts_per_tlb);
+  }
+}
+
+// generate the permutation of b->nr_elts elements starting at b->perm,
+// keeping each tlb group together.
+static void build_permutation(struct chase_build *b, size_t nr_tlb_groups) {
+  perm_t *tlb_perm = malloc(nr_tlb_groups * sizeof(*tlb_perm));
+
+  if (tlb_perm == NULL) {
+    fprintf(stderr, "Could not allocate %lu bytes\n",
+            nr_tlb_groups * sizeof(*tlb_perm));
+    exit(1);
+  }
+  rng_init(chase_stream(b->mixer_idx, b->iteration, 0));
+  b->gen_permutation(tlb_perm, nr_tlb_groups, 0);
+  b->tlb_perm = tlb_perm;
+  chase_parallel_for(nr_tlb_groups, build_tlb_groups, b);
+  b->tlb_perm = NULL;
+  free(tlb_perm);
+}
+
+static void build_inverse(void *data, size_t begin, size_t end) {
+  const struct chase_build *b = data;
+  size_t i;
+
+  for (i = begin; i < end; ++i) {
+    b->perm_inverse[b->perm[i]] = i;
+  }
+}
+
+#define MIXED(x) ((x)*stride + mixer[(x) & (nr_mixers - 1)] * mixer_scale)
+
+static void thread_chase(void *data, size_t begin, size_t end) {
+  const struct chase_build *b = data;
+  char *arena = b->arena;
+  size_t stride = b->stride;
+  size_t nr_mixers = b->nr_mixers;
+  size_t mixer_scale = b->mixer_scale;
+  const perm_t *mixer = b->mixer;
+  const perm_t *perm = b->perm;
+  const perm_t *perm_inverse = b->perm_inverse;
+  size_t nr_elts = b->nr_elts;
+  size_t i;
+
+  for (i = begin; i < end; ++i) {
+    size_t next;
+    dassert(perm[perm_inverse[i]] == i);
+    next = perm_inverse[i] + 1;
+    next = (next == nr_elts) ? 0 : next;
+    *(void **)(arena + MIXED(i)) = (void *)(arena + MIXED(perm[next]));
+  }
+}
+
+//============================================================================
+// keyed chases walk a pseudo-random bijection over the element numbers
+// instead of storing perm and perm_inverse, so they need O(1) extra memory.
+//
+// the bijection is a balanced feistel network over the smallest even number
+// of bits covering the domain; values which land outside the domain are fed
+// through the network again (cycle walking) until they land inside it.  one
+// bijection orders the tlb groups and another, keyed per group, orders the
+// elements within each group, which keeps the tlb locality of the
+// permutation based chases.
+
+#define FEISTEL_ROUNDS 4
+
+struct keyed_perm {
+  uint64_t n;          // size of the domain
+  unsigned half_bits;  // width of each feistel half
+  uint64_t half_mask;
+  uint64_t key;
+  bool ordered;        // identity, for ordered traversals
+};
+
+static void keyed_perm_init(struct keyed_perm *kp, uint64_t n, uint64_t key,
+                            bool ordered) {
+  unsigned bits = 0;
+
+  while (bits < 63 && ((uint64_t)1 << bits) < n) ++bits;
+  kp->n = n;
+  kp->half_bits = bits > 1 ? (bits + 1) / 2 : 1;
+  kp->half_mask = ((uint64_t)1 << kp->half_bits) - 1;
+  kp->key = key;
+  kp->ordered = ordered;
+}
+
+static uint64_t keyed_perm_apply(const struct keyed_perm *kp, uint64_t x) {
+  if (kp->ordered || kp->n <= 1) return x;
+  do {
+    uint64_t l = x >> kp->half_bits;
+    uint64_t r = x & kp->half_mask;
+    for (unsigned round = 0; round < FEISTEL_ROUNDS; ++round) {
+      uint64_t z = kp->key ^ ((uint64_t)round << 56) ^ r;
+      uint64_t t = l ^ (rng_splitmix64(&z) & kp->half_mask);
+      l = r;
+      r = t;
+    }
+    x = (l << kp->half_bits) | r;
+  } while (x >= kp->n);
+  return x;
+}
+
+// the element visited at each position of a keyed chase.  positions
+// [j * nr_elts, (j + 1) * nr_elts) belong to iteration j of a longer chase.
+struct keyed_walk {
+  const struct chase_build *b;
+  size_t nr_tlb_groups;
+  size_t row;    // iteration the cached bijections belong to
+  size_t group;  // position group the cached in-group bijection belongs to
+  struct keyed_perm tlb_perm;
+  struct keyed_perm group_perm;
+};
+
+static size_t keyed_element(struct keyed_walk *w, size_t pos) {
+  const struct chase_build *b = w->b;
+  bool ordered = b->gen_permutation == gen_ordered_permutation;
+  size_t row = pos / b->nr_elts;
+  size_t group = pos % b->nr_elts / b->nr_elts_per_tlb;
+
+  if (row != w->row) {
+    keyed_perm_init(&w->tlb_perm, w->nr_tlb_groups,
+                    chase_stream(b->mixer_idx, row, 0), ordered);
+    w->row = row;
+    w->group = -1;
+  }
+  if (group != w->group) {
+    keyed_perm_init(&w->group_perm, b->nr_elts_per_tlb,
+                    chase_stream(b->mixer_idx, row, group + 1), ordered);
+    w->group = group;
+  }
+  return keyed_perm_apply(&w->tlb_perm, group) * b->nr_elts_per_tlb +
+         keyed_perm_apply(&w->group_perm, pos % b->nr_elts_per_tlb);
+}
+
+// offset of element x of iteration row in the arena
+static size_t keyed_offset(const struct chase_build *b, size_t row, size_t x) {
+  const perm_t *mixer = b->mixer + row * b->nr_mixers;
+
+  return x * b->stride + mixer[x & (b->nr_mixers - 1)] * b->mixer_scale;
+}
+
+static void thread_chase_keyed(void *data, size_t begin, size_t end) {
+  const struct chase_build *b = data;
+  size_t total = b->nr_elts * b->nr_iteration;
+  struct keyed_walk cur = {
+      .b = b,
+      .nr_tlb_groups = b->nr_elts / b->nr_elts_per_tlb,
+      .row = -1,
+  };
+  struct keyed_walk nxt = cur;
+  size_t from = keyed_element(&cur, begin);
+  size_t pos;
+
+  for (pos = begin; pos < end; ++pos) {
+    size_t next_pos = (pos + 1 == total) ? 0 : pos + 1;
+    size_t to = keyed_element(&nxt, next_pos);
+    *(void **)(b->arena + keyed_offset(b, pos / b->nr_elts, from)) =
+        b->arena + keyed_offset(b, next_pos / b->nr_elts, to);
+    from = to;
+  }
+}
+
+static void *generate_chase_keyed(struct chase_build *b) {
+  struct keyed_walk w = {
+      .b = b,
+      .nr_tlb_groups = b->nr_elts / b->nr_elts_per_tlb,
+      .row = -1,
+  };
+
+  if (verbosity > 1)
+    printf("threading the keyed chase (mixer_idx = %zu)\n", b->mixer_idx);
+  chase_parallel_for(b->nr_elts * b->nr_iteration, thread_chase_keyed, b);
+  return b->arena + keyed_offset(b, 0, keyed_element(&w, 0));
+}
+
+// Generate a pointer chasing sequence according to chase args.
 void *generate_chase(const struct generate_chase_common_args *args,
                      size_t mixer_idx) {
-  char *arena = args->arena;
   size_t total_memory = args->total_memory;
   size_t stride = args->stride;
   size_t tlb_locality = args->tlb_locality;
-  void (*gen_permutation)(perm_t *, size_t, size_t) = args->gen_permutation;
   const perm_t *mixer = args->mixer + mixer_idx * args->nr_mixers;
+  size_t nr_mixers = args->nr_mixers;
   size_t nr_mixer_indices = args->nr_mixer_indices;
 
   size_t nr_tlb_groups = total_memory / tlb_locality;
-  size_t nr_elts_per_tlb = tlb_locality / stride;
   size_t nr_elts = total_memory / stride;
-  perm_t *tlb_perm;
-  perm_t *perm;
-  size_t i;
-  perm_t *perm_inverse;
   size_t mixer_scale = stride / nr_mixer_indices;
+  struct chase_build b = {
+      .arena = args->arena,
+      .stride = stride,
+      .nr_mixers = nr_mixers,
+      .mixer_scale = mixer_scale,
+      .mixer = mixer,
+      .gen_permutation = args->gen_permutation,
+      .mixer_idx = mixer_idx,
+      .iteration = 0,
+      .nr_iteration = 1,
+      .nr_elts = nr_elts,
+      .nr_elts_per_tlb = tlb_locality / stride,
+      .base = 0,
+  };
+
+  if (args->keyed) return generate_chase_keyed(&b);
 
   if (verbosity > 1)
     printf("generating permutation of %zu elements (in %zu TLB groups)\n",
            nr_elts, nr_tlb_groups);
-  tlb_perm = malloc(nr_tlb_groups * sizeof(*tlb_perm));
-  gen_permutation(tlb_perm, nr_tlb_groups, 0);
-  perm = malloc(nr_elts * sizeof(*perm));
-  for (i = 0; i < nr_tlb_groups; ++i) {
-    gen_permutation(&perm[i * nr_elts_per_tlb], nr_elts_per_tlb,
-                    tlb_perm[i] * nr_elts_per_tlb);
+  b.perm = malloc(nr_elts * sizeof(*b.perm));
+  if (b.perm == NULL) {
+    fprintf(stderr, "Could not allocate %lu bytes\n",
+            nr_elts * sizeof(*b.perm));
+    exit(1);
   }
-  free(tlb_perm);
+  build_permutation(&b, nr_tlb_groups);
 
-  dassert(is_a_permutation(perm, nr_elts));
+  dassert(is_a_permutation(b.perm, nr_elts));
 
   if (verbosity > 1) printf("generating inverse permtuation\n");
-  perm_inverse = malloc(nr_elts * sizeof(*perm));
-  for (i = 0; i < nr_elts; ++i) {
-    perm_inverse[perm[i]] = i;
+  b.perm_inverse = malloc(nr_elts * sizeof(*b.perm_inverse));
+  if (b.perm_inverse == NULL) {
+    fprintf(stderr, "Could not allocate %lu bytes\n",
+            nr_elts * sizeof(*b.perm_inverse));
+    exit(1);
   }
+  chase_parallel_for(nr_elts, build_inverse, &b);
 
-  dassert(is_a_permutation(perm_inverse, nr_elts));
-
-#define MIXED(x) ((x)*stride + mixer[(x) & (args->nr_mixers - 1)] * mixer_scale)
+  dassert(is_a_permutation(b.perm_inverse, nr_elts));
 
   if (verbosity > 1)
     printf("threading the chase (mixer_idx = %zu)\n", mixer_idx);
-  for (i = 0; i < nr_elts; ++i) {
+  chase_parallel_for(nr_elts, thread_chase, &b);
+
+  free(b.perm);
+  free(b.perm_inverse);
+
+  return args->arena + MIXED(0);
+}
+
+#undef MIXED
+
+// Get the [(x mod NR_MIXER)th element in the jth row of mixer]th element
+// in the xth stride of the array.
+#define MIXED_2(x,j,n) ((x)*stride + (mixer + j*n)[(x) & (n-1)] * mixer_scale)
+
+// Generate the final permutation, which connects nr_iteration * nr_elts
+// number of permutations together into one.
+static void thread_chase_long(void *data, size_t begin, size_t end) {
+  const struct chase_build *b = data;
+  char *arena = b->arena;
+  size_t stride = b->stride;
+  size_t nr_mixers = b->nr_mixers;
+  size_t mixer_scale = b->mixer_scale;
+  const perm_t *mixer = b->mixer;
+  const perm_t *perm = b->perm;
+  const perm_t *perm_inverse = b->perm_inverse;
+  size_t nr_elts = b->nr_elts;
+  size_t nr_iteration = b->nr_iteration;
+  size_t i;
+
+  for (i = begin; i < end; ++i) {
     size_t next;
     dassert(perm[perm_inverse[i]] == i);
+    assert(*(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, nr_mixers)) == NULL);
     next = perm_inverse[i] + 1;
-    next = (next == nr_elts) ? 0 : next;
-    *(void **)(arena + MIXED(i)) = (void *)(arena + MIXED(perm[next]));
-  }
-
-  free(perm);
-  free(perm_inverse);
+    // If next is the position representing the start of a new iteration of
+    // permutation, set next to be the position representing the start of
+    // current iteration, because we want to finish current permutation before
+    // proceeding to the next.
+    next = (next%nr_elts == 0 && next/nr_elts > i/nr_elts) ? i/nr_elts*nr_elts : next;
 
-  return arena + MIXED(0);
+    if (perm[next]%nr_elts == 0) {
+      // If current iteration of permutation is finished,
+      // new position is the start of next iteration.
+      size_t new = (i/nr_elts + 1) * nr_elts;
+      new = (new == nr_iteration * nr_elts) ? 0 : new;
+      *(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, nr_mixers)) =
+        (void *)(arena + MIXED_2(new%nr_elts,new/nr_elts, nr_mixers));
+    } else {
+      *(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, nr_mixers)) =
+        (void *)(arena + MIXED_2(perm[next]%nr_elts,perm[next]/nr_elts, nr_mixers));
+    }
+  }
 }
 
 // Generates nr_mixer_indices/total_par number of permutations and switch to
@@ -197,25 +539,33 @@ void *generate_chase(const struct generate_chase_common_args *args,
 // This modification is effective in getting around CMC prefetcher.
 void *generate_chase_long(const struct generate_chase_common_args *args,
                      size_t mixer_idx, size_t total_par) {
-  char *arena = args->arena;
   size_t total_memory = args->total_memory;
   size_t stride = args->stride;
   size_t tlb_locality = args->tlb_locality;
-  void (*gen_permutation)(perm_t *, size_t, size_t) = args->gen_permutation;
   size_t nr_mixer_indices = args->nr_mixer_indices;
   size_t nr_iteration = nr_mixer_indices / total_par;
   const perm_t *mixer = args->mixer + mixer_idx * nr_iteration * args->nr_mixers;
+  size_t nr_mixers = args->nr_mixers;
 
   size_t nr_tlb_groups = total_memory / tlb_locality;
-  size_t nr_elts_per_tlb = tlb_locality / stride;
   size_t nr_elts = total_memory / stride;
-  perm_t *tlb_perm;
   perm_t *perm;
-  size_t i;
   size_t j;
-  size_t base;
-  perm_t *perm_inverse;
   size_t mixer_scale = stride / nr_mixer_indices;
+  struct chase_build b = {
+      .arena = args->arena,
+      .stride = stride,
+      .nr_mixers = nr_mixers,
+      .mixer_scale = mixer_scale,
+      .mixer = mixer,
+      .gen_permutation = args->gen_permutation,
+      .mixer_idx = mixer_idx,
+      .nr_iteration = nr_iteration,
+      .nr_elts = nr_elts,
+      .nr_elts_per_tlb = tlb_locality / stride,
+  };
+
+  if (args->keyed) return generate_chase_keyed(&b);
 
   if (verbosity > 1)
     printf("generating permutation of %zu elements (in %zu TLB groups)\n",
@@ -230,22 +580,10 @@ void *generate_chase_long(const struct generate_chase_common_args *args,
 
   // Generate nr_iteration number of permutations.
   for (j = 0; j < nr_iteration; j++) {
-    base = j * nr_elts;
-
-    tlb_perm = malloc(nr_tlb_groups * sizeof(*tlb_perm));
-    if (tlb_perm == NULL) {
-      fprintf(stderr, "Could not allocate %lu bytes\n",
-              nr_tlb_groups * sizeof(*tlb_perm));
-      exit(1);
-    }
-
-    gen_permutation(tlb_perm, nr_tlb_groups, 0);
-
-    for (i = 0; i < nr_tlb_groups; ++i) {
-      gen_permutation(&perm[j * nr_elts + i * nr_elts_per_tlb], nr_elts_per_tlb,
-                    base + tlb_perm[i] * nr_elts_per_tlb);
-    }
-    free(tlb_perm);
+    b.iteration = j;
+    b.base = j * nr_elts;
+    b.perm = &perm[j * nr_elts];
+    build_permutation(&b, nr_tlb_groups);
 
     dassert(is_a_permutation(perm, nr_elts));
     if (verbosity > 1)
@@ -254,54 +592,244 @@ void *generate_chase_long(const struct generate_chase_common_args *args,
 
   dassert(is_a_permutation(perm, nr_iteration * nr_elts));
 
-  perm_inverse = malloc(nr_iteration * nr_elts * sizeof(*perm_inverse));
-  if (perm_inverse == NULL) {
+  b.perm = perm;
+  b.perm_inverse = malloc(nr_iteration * nr_elts * sizeof(*b.perm_inverse));
+  if (b.perm_inverse == NULL) {
     fprintf(stderr, "Could not allocate %lu bytes\n",
-            nr_iteration * nr_elts * sizeof(*perm_inverse));
+            nr_iteration * nr_elts * sizeof(*b.perm_inverse));
     exit(1);
   }
+  chase_parallel_for(nr_iteration * nr_elts, build_inverse, &b);
 
-  for (i = 0; i < nr_iteration * nr_elts; ++i) {
-    perm_inverse[perm[i]] = i;
-  }
-
-  dassert(is_a_permutation(perm_inverse, nr_iteration, nr_elts));
-
-// Get the [(x mod NR_MIXER)th element in the jth row of mixer]th element
-// in the xth stride of the array.
-#define MIXED_2(x,j,n) ((x)*stride + (mixer + j*n)[(x) & (n-1)] * mixer_scale)
+  dassert(is_a_permutation(b.perm_inverse, nr_iteration, nr_elts));
 
   if (verbosity > 1)
     printf("threading the chase (mixer_idx = %zu)\n", mixer_idx);
 
-  // Generate the final permutation, which connects nr_iteration * nr_elts
-  // number of permutations together into one.
-  for (i = 0; i < nr_elts * nr_iteration; ++i) {
-    size_t next;
-    dassert(perm[perm_inverse[i]] == i);
-    assert(*(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, args->nr_mixers)) == NULL);
-    next = perm_inverse[i] + 1;
-    // If next is the position representing the start of a new iteration of
-    // permutation, set next to be the position representing the start of
-    // current iteration, because we want to finish current permutation before
-    // proceeding to the next.
-    next = (next%nr_elts == 0 && next/nr_elts > i/nr_elts) ? i/nr_elts*nr_elts : next;
+  chase_parallel_for(nr_elts * nr_iteration, thread_chase_long, &b);
 
-    if (perm[next]%nr_elts == 0) {
-      // If current iteration of permutation is finished,
-      // new position is the start of next iteration.
-      size_t new = (i/nr_elts + 1) * nr_elts;
-      new = (new == nr_iteration * nr_elts) ? 0 : new;
-      *(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, args->nr_mixers)) =
-        (void *)(arena + MIXED_2(new%nr_elts,new/nr_elts, args->nr_mixers));
+  free(b.perm);
+  free(b.perm_inverse);
+
+  return args->arena + MIXED_2(0,0, nr_mixers);
+}
+
+//============================================================================
+// pattern chases are a sequence of draws of runs rather than a permutation,
+// so hot runs are visited many times per lap and cold ones maybe never.  the
+// j-th visit of a chain to an element uses the row mixer_idx * cap + j of
+// the mixer, like the iterations of a longer chase.
+
+int parse_chase_pattern(const char *str, struct chase_pattern *pattern) {
+  static const char *const kinds[] = {"uniform", "zipf", "hot"};
+  char *copy = strdup(str);
+  char *args = strchr(copy, ':');
+  char *tok, *save = NULL, *val, *end;
+  int rc = 0;
+  size_t i;
+
+  if (args) *args++ = 0;
+  for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); ++i) {
+    if (strcmp(copy, kinds[i]) == 0) break;
+  }
+  if (i == sizeof(kinds) / sizeof(kinds[0])) rc = -1;
+  pattern->kind = i;
+  pattern->skew = 0.99;
+  pattern->hot_fraction = 0.1;
+  pattern->hot_probability = 0.9;
+  pattern->run = 1;
+  for (tok = args ? strtok_r(args, ",", &save) : NULL; tok && rc == 0;
+       tok = strtok_r(NULL, ",", &save)) {
+    val = strchr(tok, '=');
+    if (val == NULL || val[1] == 0) {
+      rc = -1;
+      break;
+    }
+    *val++ = 0;
+    if (strcmp(tok, "run") == 0) {
+      pattern->run = strtoul(val, &end, 0);
+    } else if (strcmp(tok, "skew") == 0) {
+      pattern->skew = strtod(val, &end);
+    } else if (strcmp(tok, "frac") == 0) {
+      pattern->hot_fraction = strtod(val, &end);
+    } else if (strcmp(tok, "p") == 0) {
+      pattern->hot_probability = strtod(val, &end);
     } else {
-      *(void **)(arena + MIXED_2(i%nr_elts,i/nr_elts, args->nr_mixers)) =
-        (void *)(arena + MIXED_2(perm[next]%nr_elts,perm[next]/nr_elts, args->nr_mixers));
+      end = val;
+    }
+    if (*end) rc = -1;
+  }
+  free(copy);
+  if (rc || pattern->run == 0 || !(pattern->skew > 0.) ||
+      !(pattern->hot_fraction > 0. && pattern->hot_fraction <= 1.) ||
+      !(pattern->hot_probability >= 0. && pattern->hot_probability <= 1.)) {
+    return -1;
+  }
+  return 0;
+}
+
+static double rng_double(void) { return (rng_next() >> 11) * 0x1.0p-53; }
+
+// zipf ranks in [1, n] by rejection-inversion (Hormann and Derflinger), which
+// needs no table of the distribution.
+struct zipf {
+  double n;
+  double skew;
+  double h_x1;  // h_integral(1.5) - 1
+  double h_n;   // h_integral(n + 0.5)
+  double s;
+};
+
+static double zipf_helper1(double x) {
+  return fabs(x) > 1e-8 ? log1p(x) / x
+                        : 1. - x * (0.5 - x * (1. / 3 - 0.25 * x));
+}
+
+static double zipf_helper2(double x) {
+  return fabs(x) > 1e-8 ? expm1(x) / x
+                        : 1. + x * 0.5 * (1. + x / 3 * (1. + 0.25 * x));
+}
+
+static double zipf_h(const struct zipf *z, double x) {
+  return exp(-z->skew * log(x));
+}
+
+static double zipf_h_integral(const struct zipf *z, double x) {
+  double log_x = log(x);
+  return zipf_helper2((1. - z->skew) * log_x) * log_x;
+}
+
+static double zipf_h_integral_inverse(const struct zipf *z, double x) {
+  double t = x * (1. - z->skew);
+  if (t < -1.) t = -1.;
+  return exp(zipf_helper1(t) * x);
+}
+
+static void zipf_init(struct zipf *z, size_t n, double skew) {
+  z->n = n;
+  z->skew = skew;
+  z->h_x1 = zipf_h_integral(z, 1.5) - 1.;
+  z->h_n = zipf_h_integral(z, n + 0.5);
+  z->s = 2. - zipf_h_integral_inverse(z, zipf_h_integral(z, 2.5) -
+                                              zipf_h(z, 2.));
+}
+
+static size_t zipf_rank(const struct zipf *z) {
+  for (;;) {
+    double u = z->h_n + rng_double() * (z->h_x1 - z->h_n);
+    double x = zipf_h_integral_inverse(z, u);
+    double k = floor(x + 0.5);
+    if (k < 1.) k = 1.;
+    if (k > z->n) k = z->n;
+    if (k - x <= z->s || u >= zipf_h_integral(z, k + 0.5) - zipf_h(z, k)) {
+      return k - 1;
+    }
+  }
+}
+
+// the first rank at or after r (wrapping) with a visit left
+static size_t free_rank(perm_t *next_free, size_t r) {
+  size_t root = r;
+
+  while (next_free[root] != root) root = next_free[root];
+  while (next_free[r] != root) {
+    size_t next = next_free[r];
+    next_free[r] = root;
+    r = next;
+  }
+  return root;
+}
+
+#define RNG_STREAM_PATTERN (~(uint64_t)1)
+
+void *generate_chase_pattern(const struct generate_chase_common_args *args,
+                             size_t mixer_idx, size_t total_par) {
+  const struct chase_pattern *pattern = args->pattern;
+  size_t stride = args->stride;
+  size_t nr_mixers = args->nr_mixers;
+  size_t mixer_scale = stride / args->nr_mixer_indices;
+  size_t cap = args->nr_mixer_indices / total_par;
+  size_t run = pattern->run;
+  size_t nr_runs = args->total_memory / stride / run;
+  size_t nr_hot = pattern->hot_fraction * nr_runs;
+  perm_t *draw, *next_free;
+  uint32_t *visits;
+  struct keyed_perm ranking;
+  struct zipf zipf;
+  size_t d, k, r, touched = 0;
+  void **prev = NULL, *first = NULL;
+
+  if (nr_runs == 0) {
+    fprintf(stderr, "the arena is smaller than one run of the pattern\n");
+    exit(1);
+  }
+  if (nr_hot == 0) nr_hot = 1;
+  draw = malloc(nr_runs * sizeof(*draw));
+  next_free = malloc(nr_runs * sizeof(*next_free));
+  visits = calloc(nr_runs, sizeof(*visits));
+  if (draw == NULL || next_free == NULL || visits == NULL) {
+    fprintf(stderr, "Could not allocate %lu bytes\n",
+            nr_runs * (2 * sizeof(*draw) + sizeof(*visits)));
+    exit(1);
+  }
+  for (r = 0; r < nr_runs; ++r) next_free[r] = r;
+  zipf_init(&zipf, nr_runs, pattern->skew);
+  // every chain draws its own sequence from the same ranking, so the
+  // threads share their hot set
+  keyed_perm_init(&ranking, nr_runs, chase_stream(RNG_STREAM_PATTERN, 0, 0),
+                  false);
+  rng_init(chase_stream(mixer_idx, 0, 0));
+
+  if (verbosity > 1)
+    printf("drawing %zu runs of %zu elements (mixer_idx = %zu)\n", nr_runs,
+           run, mixer_idx);
+  for (d = 0; d < nr_runs; ++d) {
+    switch (pattern->kind) {
+      case PATTERN_ZIPF:
+        r = zipf_rank(&zipf);
+        break;
+      case PATTERN_HOT:
+        if (nr_hot == nr_runs || rng_double() < pattern->hot_probability) {
+          r = rng_int(nr_hot - 1);
+        } else {
+          r = nr_hot + rng_int(nr_runs - nr_hot - 1);
+        }
+        break;
+      default:
+        r = rng_int(nr_runs - 1);
+        break;
     }
+    r = free_rank(next_free, r);
+    if (++visits[r] == cap) next_free[r] = (r + 1) % nr_runs;
+    draw[d] = r;
   }
 
-  free(perm);
-  free(perm_inverse);
+  // thread the visits in the order they were drawn
+  for (r = 0; r < nr_runs; ++r) {
+    touched += visits[r] != 0;
+    visits[r] = 0;
+  }
+  for (d = 0; d < nr_runs; ++d) {
+    size_t row = mixer_idx * cap + visits[draw[d]]++;
+    const perm_t *mixer = args->mixer + row * nr_mixers;
+    size_t x = keyed_perm_apply(&ranking, draw[d]) * run;
+    for (k = 0; k < run; ++k, ++x) {
+      void **p = (void **)(args->arena + x * stride +
+                           mixer[x & (nr_mixers - 1)] * mixer_scale);
+      if (prev) {
+        *prev = p;
+      } else {
+        first = p;
+      }
+      prev = p;
+    }
+  }
+  *prev = first;
+  if (verbosity > 1)
+    printf("the pattern touches %zu of %zu runs\n", touched, nr_runs);
 
-  return arena + MIXED_2(0,0, args->nr_mixers);
+  free(draw);
+  free(next_free);
+  free(visits);
+  return first;
 }
@@ -15,6 +15,7 @@
 #define PERMUTATION_H_INCLUDED
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -42,6 +43,29 @@ int is_a_permutation(const perm_t *perm, size_t nr_elts);
 // low bits of the element number.  the details are private to the
 // implementation.
 
+// access patterns (-z) other than a permutation of every element.  each
+// draw from the distribution picks a run of consecutive elements, and the
+// runs are ranked by a random bijection so the hot ones are spread over the
+// arena.  a chain can visit an element once per object it owns there
+// (nr_mixer_indices / total_par), which flattens the head of a skewed
+// distribution: a larger stride allows more skew.
+enum chase_pattern_kind {
+  PATTERN_UNIFORM,  // every run equally likely
+  PATTERN_ZIPF,     // the run of rank r with probability ~ 1 / r^skew
+  PATTERN_HOT,      // hot_probability of the draws in hot_fraction of runs
+};
+
+struct chase_pattern {
+  enum chase_pattern_kind kind;
+  double skew;
+  double hot_fraction;
+  double hot_probability;
+  size_t run;  // elements visited in order by every draw
+};
+
+// parse "uniform|zipf|hot[:skew=S,frac=F,p=P,run=N]".
+int parse_chase_pattern(const char *str, struct chase_pattern *pattern);
+
 // these are the common args required for generating all chases (and the mixer).
 struct generate_chase_common_args {
   char *arena;          // memory used for all chases
@@ -58,8 +82,20 @@ struct generate_chase_common_args {
   size_t nr_mixer_indices;          // number of mixer indices
                                     // typically stride/sizeof(void*)
   const perm_t *mixer;              // the mixer function itself
+  bool keyed;                       // walk a keyed bijection rather than
+                                    // storing the permutation (O(1) memory)
+  const struct chase_pattern *pattern;  // NULL unless -z
 };
 
+// set the number of worker threads used to build each chase.  the workers run
+// on the cpus this process may use at the time of the call, so call it before
+// any thread pins itself.  the chase does not depend on the number of workers.
+void set_chase_workers(size_t nr_workers);
+
+// run fn over [0, n) split into one contiguous range per chase worker.
+typedef void (*range_fn_t)(void *ctx, size_t begin, size_t end);
+void chase_parallel_for(size_t n, range_fn_t fn, void *ctx);
+
 // create the mixer table
 void generate_chase_mixer(struct generate_chase_common_args *args,
                           size_t nr_mixers);
@@ -73,47 +109,70 @@ void *generate_chase(const struct generate_chase_common_args *args,
 void *generate_chase_long(const struct generate_chase_common_args *args,
                           size_t mixer_idx, size_t total_par);
 
+// create a chase of total_memory / stride draws from args->pattern for the
+// given mixer_idx and total_par and return its first pointer
+void *generate_chase_pattern(const struct generate_chase_common_args *args,
+                             size_t mixer_idx, size_t total_par);
+
 //============================================================================
 // Modern multicore CPUs have increasingly large caches, so the LCRNG code
-// that was previously used is not sufficiently random anymore.
-// Now using glibc's reentrant random number generator "random_r"
-// still reproducible on the same platform, although not across systems/libs.
-
-// RNG_BUF_SIZE sets the size of rng_buf below, which is used by initstate_r
-// to decide how sophisticated a random number generator it should use: the
-// larger the state array, the better the random numbers will be.
-// 32 bytes was deemed to generate sufficient entropy.
-#define RNG_BUF_SIZE 32
-extern __thread char *rng_buf;
-extern __thread struct random_data *rand_state;
-
-static inline void rng_init(unsigned thread_num) {
-  rng_buf = (char *)calloc(1, RNG_BUF_SIZE);
-  rand_state = (struct random_data *)calloc(1, sizeof(struct random_data));
-  assert(rand_state);
-  if (initstate_r(thread_num, rng_buf, RNG_BUF_SIZE, rand_state) != 0) {
-    perror("initstate_r");
-    exit(1);
+// that was previously used is not sufficiently random anymore.  glibc's
+// random_r was used for a while, but it is slow (we needed four calls per
+// 64-bit number) and its output is only reproducible with the same libc.
+//
+// Now using xoshiro256** seeded through splitmix64.  The generator state is
+// per thread, and every independent piece of a chase is generated from its own
+// stream derived from rng_seed, so a chase comes out identical no matter how
+// many threads were used to build it or which system it was built on.
+extern uint64_t rng_seed;
+extern __thread uint64_t rng_state[4];
+
+static inline uint64_t rng_splitmix64(uint64_t *x) {
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+// select the stream used by this thread's subsequent rng_int() calls
+static inline void rng_init(uint64_t stream) {
+  uint64_t x = stream;
+  uint64_t z = rng_seed ^ rng_splitmix64(&x);
+
+  for (int i = 0; i < 4; ++i) {
+    rng_state[i] = rng_splitmix64(&z);
   }
 }
 
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(void) {
+  uint64_t *s = rng_state;
+  uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rng_rotl(s[3], 45);
+  return result;
+}
+
+// return a random number in [0, limit]
 static inline perm_t rng_int(perm_t limit) {
-  int r1, r2, r3, r4;
-  uint64_t r;
+  uint64_t r = rng_next();
 
-  if (random_r(rand_state, &r1) || random_r(rand_state, &r2)
-    || random_r(rand_state, &r3) || random_r(rand_state, &r4)) {
-    perror("random_r");
-    exit(1);
-  }
-  // Assume that RAND_MAX is at least 16-bit long
-  _Static_assert (RAND_MAX >= (1ul << 16), "RAND_MAX is too small");
-  r = (((uint64_t)r1 <<  0) & 0x000000000000FFFFull) |
-      (((uint64_t)r2 << 16) & 0x00000000FFFF0000ull) |
-      (((uint64_t)r3 << 32) & 0x0000FFFF00000000ull) |
-      (((uint64_t)r4 << 48) & 0xFFFF000000000000ull);
-
-  return r % (limit + 1);
+  if (limit == (perm_t)-1) return r;
+#ifdef __SIZEOF_INT128__
+  // multiply-shift range reduction, avoids a division per call
+  return ((unsigned __int128)r * ((uint64_t)limit + 1)) >> 64;
+#else
+  return r % ((uint64_t)limit + 1);
+#endif
 }
 
 #endif
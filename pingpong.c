@@ -18,49 +18,96 @@
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "cpu_util.h"
+#include "json_out.h"
 #include "timer.h"
+#include "topology.h"
 
 #define NR_SAMPLES (5)
 #define SAMPLE_US (250000)
+#define SPSC_SLOTS (64)
+#define SPSC_PROBE_INTERVAL (1024)
 
 static size_t nr_relax = 10;
 static size_t nr_tested_cores = ~0;
 
 typedef unsigned atomic_t;
 
-// this points to the mutex which will be pingponged back and forth
-// from core to core.  it is allocated with mmap by the even thread
-// so that it should be local to at least one of the two cores (and
-// won't have any false sharing issues).
-static atomic_t *pingpong_mutex;
-
 // try avoid false sharing by padding out the atomic_t
 typedef union {
   atomic_t x;
   char pad[AVOID_FALSE_SHARING];
 } big_atomic_t __attribute__((aligned(AVOID_FALSE_SHARING)));
-static big_atomic_t nr_pingpongs;
 
 // an array we optionally modify to examine the effect of passing
 // more dirty data between caches.
 size_t nr_array_elts = 0;
-size_t *communication_array;
+
+// the payload of every message of the spsc ring (0 unless -q), and the
+// size of its slots, rounded up to whole lines
+static size_t payload_bytes;
+static size_t slot_bytes;
+
+// a single producer single consumer ring: the producer (even thread) owns
+// head, the consumer (odd thread) owns tail.
+struct spsc_ring {
+  union {
+    uint64_t head;
+    char pad[AVOID_FALSE_SHARING];
+  } p;
+  union {
+    uint64_t tail;
+    char pad[AVOID_FALSE_SHARING];
+  } c;
+  char slots[];
+};
+
+static size_t spsc_ring_bytes(void) {
+  return sizeof(struct spsc_ring) + SPSC_SLOTS * slot_bytes;
+}
+
+static volatile uint64_t spsc_sink;
 
 //
 static volatile int stop_loops;
 
+struct pair;
+
 typedef struct {
   cpu_set_t cpus;
   atomic_t me;
   atomic_t buddy;
+  struct pair *pair;
 } thread_args_t;
 
+// everything one pair of threads shares.  pairs which are measured at the
+// same time have nothing in common but stop_loops.
+typedef struct pair {
+  big_atomic_t nr_pingpongs;
+  // this points to the mutex which will be pingponged back and forth
+  // from core to core.  it is allocated with mmap by the even thread
+  // so that it should be local to at least one of the two cores (and
+  // won't have any false sharing issues).
+  atomic_t *pingpong_mutex;
+  size_t *communication_array;
+  struct spsc_ring *ring;  // -q only, allocated like pingpong_mutex
+  pthread_barrier_t ready;
+  thread_args_t even, odd;
+  pthread_t even_thread, odd_thread;
+  double *samples;  // NR_SAMPLES ns per handoff (or message)
+  // -q: the one way latency of the probe messages, summed by the consumer
+  uint64_t latency_ns, nr_latencies;
+  double *latency_samples;  // NR_SAMPLES average ns of the probes
+} pair_t;
+
 static void common_setup(thread_args_t *args) {
+  pair_t *pair = args->pair;
+
   // move to our target cpu
   if (sched_setaffinity(0, sizeof(cpu_set_t), &args->cpus)) {
     perror("sched_setaffinity");
@@ -69,29 +116,26 @@ static void common_setup(thread_args_t *args) {
 
   // test if we're supposed to allocate the pingpong_mutex memory
   if (args->me == 0) {
-    pingpong_mutex = mmap(0, getpagesize(), PROT_READ | PROT_WRITE,
-                          MAP_ANON | MAP_PRIVATE, -1, 0);
-    if (pingpong_mutex == MAP_FAILED) {
+    pair->pingpong_mutex = mmap(0, getpagesize(), PROT_READ | PROT_WRITE,
+                                MAP_ANON | MAP_PRIVATE, -1, 0);
+    if (pair->pingpong_mutex == MAP_FAILED) {
       perror("mmap");
       exit(1);
     }
-    *pingpong_mutex = args->me;
+    *pair->pingpong_mutex = args->me;
+    if (payload_bytes) {
+      pair->ring = mmap(0, spsc_ring_bytes(), PROT_READ | PROT_WRITE,
+                        MAP_ANON | MAP_PRIVATE, -1, 0);
+      if (pair->ring == MAP_FAILED) {
+        perror("mmap");
+        exit(1);
+      }
+    }
   }
 
   // ensure both threads are ready before we leave -- so that
   // both threads have a copy of pingpong_mutex.
-  static pthread_mutex_t wait_mutex = PTHREAD_MUTEX_INITIALIZER;
-  static pthread_cond_t wait_cond = PTHREAD_COND_INITIALIZER;
-  static int wait_for_buddy = 1;
-  pthread_mutex_lock(&wait_mutex);
-  if (wait_for_buddy) {
-    wait_for_buddy = 0;
-    pthread_cond_wait(&wait_cond, &wait_mutex);
-  } else {
-    wait_for_buddy = 1;  // for next invocation
-    pthread_cond_broadcast(&wait_cond);
-  }
-  pthread_mutex_unlock(&wait_mutex);
+  pthread_barrier_wait(&pair->ready);
 }
 
 #define template(name, xchg)                                          \
@@ -103,7 +147,9 @@ static void common_setup(thread_args_t *args) {
     atomic_t nr = 0;                                                  \
     atomic_t me = args->me;                                           \
     atomic_t buddy = args->buddy;                                     \
-    atomic_t *cache_pingpong_mutex = pingpong_mutex;                  \
+    pair_t *pair = args->pair;                                        \
+    atomic_t *cache_pingpong_mutex = pair->pingpong_mutex;            \
+    size_t *communication_array = pair->communication_array;          \
     while (1) {                                                       \
       if (stop_loops) {                                               \
         pthread_exit(0);                                              \
@@ -116,7 +162,7 @@ static void common_setup(thread_args_t *args) {
         /* don't do the atomic_add every time... it costs too much */ \
         ++nr;                                                         \
         if (nr == 10000 && me == 0) {                                 \
-          __sync_fetch_and_add(&nr_pingpongs.x, 2 * nr);              \
+          __sync_fetch_and_add(&pair->nr_pingpongs.x, 2 * nr);       \
           nr = 0;                                                     \
         }                                                             \
       }                                                               \
@@ -142,7 +188,8 @@ template(unlocked_loop, unlocked_xchg)
   thread_args_t *args = (thread_args_t *)data;
 
   common_setup(args);
-  uint64_t *xadder = (uint64_t *)pingpong_mutex;
+  pair_t *pair = args->pair;
+  uint64_t *xadder = (uint64_t *)pair->pingpong_mutex;
   atomic_t me = args->me;
   uint64_t add_amt = (me == 0) ? 1 : (1ull << 32);
   uint32_t last_lo = 0;
@@ -158,7 +205,7 @@ template(unlocked_loop, unlocked_xchg)
       last_lo = swap;
       ++nr;
       if (nr == 10000) {
-        __sync_fetch_and_add(&nr_pingpongs.x, 2 * nr);
+        __sync_fetch_and_add(&pair->nr_pingpongs.x, 2 * nr);
         nr = 0;
       }
     }
@@ -168,24 +215,338 @@ template(unlocked_loop, unlocked_xchg)
   }
 }
 
+// stream payload_bytes messages from the even to the odd thread.  the
+// producer writes every word of a slot, the consumer reads them all, and
+// both only look at the other's index when the ring seems full or empty.
+// every SPSC_PROBE_INTERVAL-th message is a latency probe: the producer
+// waits for the ring to drain, so the probe isn't queued behind others, and
+// stamps its first word with now_nsec() as it publishes it.  the consumer
+// takes the time from that stamp until it has read the whole message, the
+// counters now_nsec() uses are synchronized across cores.
+static void *spsc_loop(void *data) {
+  thread_args_t *args = (thread_args_t *)data;
+
+  common_setup(args);
+  pair_t *pair = args->pair;
+  struct spsc_ring *ring = pair->ring;
+  size_t nr_words = payload_bytes / sizeof(uint64_t);
+  uint64_t mine = 0, theirs = 0, sum = 0;
+  atomic_t nr = 0;
+
+  while (1) {
+    if (stop_loops) {
+      spsc_sink = sum;
+      pthread_exit(0);
+    }
+
+    if (args->me == 0) {
+      bool probe = mine % SPSC_PROBE_INTERVAL == 0;
+      if (probe ? theirs != mine : mine - theirs == SPSC_SLOTS) {
+        uint64_t last = theirs;
+        theirs = __atomic_load_n(&ring->c.tail, __ATOMIC_ACQUIRE);
+        if (theirs == last) cpu_relax();
+        continue;
+      }
+      uint64_t *slot =
+          (uint64_t *)(ring->slots + (mine % SPSC_SLOTS) * slot_bytes);
+      for (size_t w = 0; w < nr_words; ++w) slot[w] = mine;
+      if (probe) slot[0] = now_nsec();
+      __atomic_store_n(&ring->p.head, ++mine, __ATOMIC_RELEASE);
+    } else {
+      if (mine == theirs) {
+        theirs = __atomic_load_n(&ring->p.head, __ATOMIC_ACQUIRE);
+        if (mine == theirs) cpu_relax();
+        continue;
+      }
+      const uint64_t *slot =
+          (const uint64_t *)(ring->slots + (mine % SPSC_SLOTS) * slot_bytes);
+      for (size_t w = 0; w < nr_words; ++w) sum += slot[w];
+      if (mine % SPSC_PROBE_INTERVAL == 0) {
+        int64_t ns = now_nsec() - slot[0];
+        __sync_fetch_and_add(&pair->latency_ns, ns > 0 ? ns : 0);
+        __sync_fetch_and_add(&pair->nr_latencies, 1);
+      }
+      __atomic_store_n(&ring->c.tail, ++mine, __ATOMIC_RELEASE);
+      // messages are much slower than handoffs, count them more often
+      if (++nr == 1000) {
+        __sync_fetch_and_add(&pair->nr_pingpongs.x, nr);
+        nr = 0;
+      }
+    }
+  }
+}
+
+static void *(*thread_fn)(void *data);
+
+// the allowed cpus, and the samples of every pair (i, j), i < j, of them
+static size_t nr_cpus;
+static int cpu_list[CPU_SETSIZE];
+static double *pair_samples;
+static double *pair_latency_samples;  // -q only
+
+static double *samples_of(size_t i, size_t j) {
+  return pair_samples + (i * nr_cpus + j) * NR_SAMPLES;
+}
+
+static double *latency_samples_of(size_t i, size_t j) {
+  return pair_latency_samples + (i * nr_cpus + j) * NR_SAMPLES;
+}
+
+// measure the pairs at the same time.  the caller sets the cpus of each
+// pair's even and odd thread and where its samples go.
+static void measure_pairs(pair_t *pairs, size_t nr_pairs) {
+  uint64_t last_stamp[nr_pairs];
+  size_t k;
+
+  for (k = 0; k < nr_pairs; ++k) {
+    pair_t *pair = &pairs[k];
+    pair->even.me = 0;
+    pair->even.buddy = 1;
+    pair->even.pair = pair;
+    pair->odd.me = 1;
+    pair->odd.buddy = 0;
+    pair->odd.pair = pair;
+    __sync_lock_test_and_set(&pair->nr_pingpongs.x, 0);
+    __sync_lock_test_and_set(&pair->latency_ns, 0);
+    __sync_lock_test_and_set(&pair->nr_latencies, 0);
+    if (pthread_create(&pair->odd_thread, NULL, thread_fn, &pair->odd)) {
+      perror("pthread_create odd");
+      exit(1);
+    }
+    if (pthread_create(&pair->even_thread, NULL, thread_fn, &pair->even)) {
+      perror("pthread_create even");
+      exit(1);
+    }
+  }
+
+  for (k = 0; k < nr_pairs; ++k) last_stamp[k] = now_nsec();
+  for (size_t sample_no = 0; sample_no < NR_SAMPLES; ++sample_no) {
+    usleep(SAMPLE_US);
+    for (k = 0; k < nr_pairs; ++k) {
+      atomic_t s = __sync_lock_test_and_set(&pairs[k].nr_pingpongs.x, 0);
+      uint64_t time_stamp = now_nsec();
+      pairs[k].samples[sample_no] = (time_stamp - last_stamp[k]) / (double)s;
+      last_stamp[k] = time_stamp;
+      if (payload_bytes) {
+        // the sum and count may be a probe apart, which doesn't matter here
+        uint64_t ns = __sync_lock_test_and_set(&pairs[k].latency_ns, 0);
+        uint64_t nr = __sync_lock_test_and_set(&pairs[k].nr_latencies, 0);
+        pairs[k].latency_samples[sample_no] = nr ? ns / (double)nr : 1. / 0.;
+      }
+    }
+  }
+
+  stop_loops = 1;
+  for (k = 0; k < nr_pairs; ++k) {
+    if (pthread_join(pairs[k].odd_thread, NULL)) {
+      perror("pthread_join odd_thread");
+      exit(1);
+    }
+    if (pthread_join(pairs[k].even_thread, NULL)) {
+      perror("pthread_join even_thread");
+      exit(1);
+    }
+  }
+  stop_loops = 0;
+
+  for (k = 0; k < nr_pairs; ++k) {
+    if (munmap(pairs[k].pingpong_mutex, getpagesize())) {
+      perror("munmap");
+      exit(1);
+    }
+    pairs[k].pingpong_mutex = NULL;
+    if (pairs[k].ring && munmap(pairs[k].ring, spsc_ring_bytes())) {
+      perror("munmap");
+      exit(1);
+    }
+    pairs[k].ring = NULL;
+  }
+}
+
+static void set_pair(pair_t *pair, size_t i, size_t j) {
+  CPU_ZERO(&pair->even.cpus);
+  CPU_SET(cpu_list[i], &pair->even.cpus);
+  CPU_ZERO(&pair->odd.cpus);
+  CPU_SET(cpu_list[j], &pair->odd.cpus);
+  pair->samples = samples_of(i, j);
+  if (payload_bytes) pair->latency_samples = latency_samples_of(i, j);
+}
+
+// the last level cache of the i-th cpu, by its first cpu
+static int llc_of(size_t i) {
+  int llc = get_cpu_llc(cpu_list[i]);
+  return llc < 0 ? cpu_list[i] : llc;
+}
+
+// measure every pair with a round robin tournament: each of the
+// nr_cpus - 1 rounds pairs up every cpu once, and all the pairs of a round
+// run at the same time.  with exclusive_llc a round is split so no two
+// pairs running together touch the same last level cache.
+static void measure_tournament(pair_t *pairs, size_t nr_rows,
+                               bool exclusive_llc) {
+  size_t n = nr_cpus + (nr_cpus & 1);  // an odd cpu sits out each round
+  size_t *seat = calloc(n, sizeof(*seat));
+  size_t *todo_i = calloc(n / 2, sizeof(*todo_i));
+  size_t *todo_j = calloc(n / 2, sizeof(*todo_j));
+  bool *llc_used = calloc(MAX_CPUS, sizeof(*llc_used));
+  size_t k;
+
+  if (!seat || !todo_i || !todo_j || !llc_used) {
+    fprintf(stderr, "could not allocate the tournament\n");
+    exit(1);
+  }
+  for (k = 0; k < n; ++k) seat[k] = k;
+
+  for (size_t round = 0; round + 1 < n; ++round) {
+    size_t nr_todo = 0;
+    for (k = 0; k < n / 2; ++k) {
+      size_t i = seat[k], j = seat[n - 1 - k];
+      if (i > j) {
+        size_t t = i;
+        i = j;
+        j = t;
+      }
+      if (j >= nr_cpus || i >= nr_rows) continue;
+      todo_i[nr_todo] = i;
+      todo_j[nr_todo] = j;
+      ++nr_todo;
+    }
+
+    while (nr_todo) {
+      size_t nr_pairs = 0, left = 0;
+      memset(llc_used, 0, MAX_CPUS * sizeof(*llc_used));
+      for (k = 0; k < nr_todo; ++k) {
+        size_t i = todo_i[k], j = todo_j[k];
+        if (exclusive_llc) {
+          if (llc_used[llc_of(i)] || llc_used[llc_of(j)]) {
+            todo_i[left] = i;
+            todo_j[left] = j;
+            ++left;
+            continue;
+          }
+          llc_used[llc_of(i)] = llc_used[llc_of(j)] = true;
+        }
+        set_pair(&pairs[nr_pairs++], i, j);
+      }
+      measure_pairs(pairs, nr_pairs);
+      nr_todo = left;
+    }
+
+    // keep seat 0 and rotate the others by one
+    size_t last = seat[n - 1];
+    memmove(&seat[2], &seat[1], (n - 2) * sizeof(*seat));
+    seat[1] = last;
+  }
+  free(seat);
+  free(todo_i);
+  free(todo_j);
+  free(llc_used);
+}
+
+enum table {
+  TABLE_NS,       // ns per handoff
+  TABLE_GBPS,     // -q: bandwidth of the ring
+  TABLE_LATENCY,  // -q: one way latency of the probe messages
+};
+
+static double best_of(const double *samples) {
+  double best_sample = 1. / 0.;  // infinity
+
+  for (size_t sample_no = 0; sample_no < NR_SAMPLES; ++sample_no) {
+    if (samples[sample_no] < best_sample) best_sample = samples[sample_no];
+  }
+  return best_sample;
+}
+
+// print row i of a matrix.  a JSON record has all of them.
+static void print_row(size_t i, enum table table) {
+  const int col_width = 8;
+
+  if (!json_output) {
+    printf("%2d:", cpu_list[i]);
+    for (size_t j = 1; j <= i; ++j) printf("%*s", col_width, "");
+  }
+  for (size_t j = i + 1; j < nr_cpus; ++j) {
+    const double *samples = samples_of(i, j);
+    double best_sample = best_of(samples);
+    if (json_output) {
+      json_record("pingpong", "pair");
+      json_uint("cpu0", cpu_list[i]);
+      json_uint("cpu1", cpu_list[j]);
+      json_double("ns", best_sample);
+      json_doubles("samples_ns", samples, NR_SAMPLES);
+      if (payload_bytes) {
+        const double *latency = latency_samples_of(i, j);
+        json_double("gbps", payload_bytes / best_sample);
+        json_double("latency_ns", best_of(latency));
+        json_doubles("samples_latency_ns", latency, NR_SAMPLES);
+      }
+      json_end_record();
+    } else if (table == TABLE_GBPS) {
+      printf("%*.2f", col_width, payload_bytes / best_sample);
+    } else if (table == TABLE_LATENCY) {
+      printf("%*.1f", col_width, best_of(latency_samples_of(i, j)));
+    } else {
+      printf("%*.1f", col_width, best_sample);
+    }
+  }
+  if (!json_output) printf("\n");
+}
+
+static void print_header(void) {
+  printf("   ");
+  for (size_t j = 1; j < nr_cpus; ++j) printf("%8d", cpu_list[j]);
+  printf("\n");
+}
+
 int main(int argc, char **argv) {
-  void *(*thread_fn)(void *data) = NULL;
+  const char *mode = NULL;
+  bool parallel = false;
+  bool exclusive_llc = false;
   int c;
   char *p;
 
-  while ((c = getopt(argc, argv, "c:lur:xs:")) != -1) {
+  timer_init();
+
+  while ((c = getopt(argc, argv, "c:EJlpq:ur:xs:")) != -1) {
     switch (c) {
+      case 'E':
+        exclusive_llc = true;
+        break;
+      case 'J':
+        json_output = true;
+        break;
       case 'l':
         if (thread_fn) goto thread_fn_error;
         thread_fn = locked_loop;
+        mode = "locked";
+        break;
+      case 'p':
+        parallel = true;
+        break;
+      case 'q':
+        if (thread_fn) goto thread_fn_error;
+        thread_fn = spsc_loop;
+        mode = "spsc";
+        payload_bytes = strtoul(optarg, &p, 0);
+        if (*p || payload_bytes == 0 || payload_bytes % sizeof(uint64_t)) {
+          fprintf(stderr,
+                  "-q requires a payload size which is a multiple of %zu\n",
+                  sizeof(uint64_t));
+          exit(1);
+        }
+        slot_bytes =
+            (payload_bytes + CACHELINE_SIZE - 1) & ~(CACHELINE_SIZE - 1);
         break;
       case 'u':
         if (thread_fn) goto thread_fn_error;
         thread_fn = unlocked_loop;
+        mode = "unlocked";
         break;
       case 'x':
         if (thread_fn) goto thread_fn_error;
         thread_fn = xadd_loop;
+        mode = "xadd";
         break;
       case 'r':
         nr_relax = strtoul(optarg, &p, 0);
@@ -207,23 +568,34 @@ int main(int argc, char **argv) {
           fprintf(stderr, "-s requires a numeric argument\n");
           exit(1);
         }
-        if (posix_memalign((void **)&communication_array, 1ull << 21,
-                           nr_array_elts * sizeof(*communication_array))) {
-          fprintf(stderr, "posix_memalign failed\n");
-          exit(1);
-        }
         break;
       default:
         fprintf(stderr,
-                "usage: %s [-l | -u | -x] [-r nr_relax] [-s "
-                "nr_array_elts_to_dirty] [-c nr_tested_cores]\n",
+                "usage: %s [-l | -u | -x | -q payload_bytes] [-r nr_relax] "
+                "[-s nr_array_elts_to_dirty]\n"
+                "       [-c nr_tested_cores] [-p [-E]] [-J]\n"
+                "-q streams messages through a single producer single "
+                "consumer ring instead\n"
+                "   of handing off one line\n"
+                "-p measures disjoint pairs at the same time, one round of a "
+                "round robin\n"
+                "   tournament at a time, -E keeps pairs sharing a last level "
+                "cache apart\n",
                 argv[0]);
         exit(1);
     }
   }
   if (thread_fn == NULL) {
   thread_fn_error:
-    fprintf(stderr, "must specify exactly one of -u, -l or -x\n");
+    fprintf(stderr, "must specify exactly one of -u, -l, -x or -q\n");
+    exit(1);
+  }
+  if (payload_bytes && nr_array_elts) {
+    fprintf(stderr, "-s can not be combined with -q\n");
+    exit(1);
+  }
+  if (exclusive_llc && !parallel) {
+    fprintf(stderr, "-E only applies to -p\n");
     exit(1);
   }
 
@@ -235,102 +607,91 @@ int main(int argc, char **argv) {
     perror("sched_getaffinity");
     exit(1);
   }
-
-  printf(
-      "avg latency to communicate a modified line from one core to another\n");
-  printf("times are in ns\n\n");
-
-  // print top row header
-  const int col_width = 8;
-  size_t first_cpu = ~0;
-  size_t last_cpu = 0;
-  printf("   ");
   for (size_t j = 0; j < CPU_SETSIZE; ++j) {
-    if (CPU_ISSET(j, &cpus)) {
-      if (first_cpu > j) {
-        first_cpu = j;
-      } else {
-        printf("%*zu", col_width, j);
-      }
-      if (last_cpu < j) {
-        last_cpu = j;
-      }
+    if (CPU_ISSET(j, &cpus)) cpu_list[nr_cpus++] = j;
+  }
+  // the rows of the matrix, the last cpu has no pair left to start
+  size_t nr_rows = nr_cpus ? nr_cpus - 1 : 0;
+  if (nr_rows > nr_tested_cores) nr_rows = nr_tested_cores;
+
+  pair_samples = calloc(nr_cpus * nr_cpus * NR_SAMPLES, sizeof(*pair_samples));
+  if (payload_bytes) {
+    pair_latency_samples =
+        calloc(nr_cpus * nr_cpus * NR_SAMPLES, sizeof(*pair_latency_samples));
+  }
+  size_t nr_slots = parallel ? nr_cpus / 2 : 1;
+  pair_t *pairs = NULL;
+  if (!pair_samples || (payload_bytes && !pair_latency_samples) ||
+      posix_memalign((void **)&pairs, AVOID_FALSE_SHARING,
+                     (nr_slots ? nr_slots : 1) * sizeof(*pairs))) {
+    fprintf(stderr, "could not allocate the pairs\n");
+    exit(1);
+  }
+  for (size_t k = 0; k < nr_slots; ++k) {
+    memset(&pairs[k], 0, sizeof(pairs[k]));
+    pthread_barrier_init(&pairs[k].ready, NULL, 2);
+    if (nr_array_elts &&
+        posix_memalign((void **)&pairs[k].communication_array, 1ull << 21,
+                       nr_array_elts * sizeof(size_t))) {
+      fprintf(stderr, "posix_memalign failed\n");
+      exit(1);
     }
   }
-  printf("\n");
 
-  for (size_t i = 0, core = 0; i < last_cpu && core < nr_tested_cores; ++i) {
-    if (!CPU_ISSET(i, &cpus)) {
-      continue;
-    }
-    ++core;
-    thread_args_t even;
-    CPU_ZERO(&even.cpus);
-    CPU_SET(i, &even.cpus);
-    even.me = 0;
-    even.buddy = 1;
-    printf("%2zu:", i);
-    for (size_t j = first_cpu + 1; j <= i; ++j) {
-      if (CPU_ISSET(j, &cpus)) {
-        printf("%*s", col_width, "");
-      }
+  if (json_output) {
+    json_host_record("pingpong");
+    json_record("pingpong", "config");
+    json_string("mode", mode);
+    json_uint("nr_relax", nr_relax);
+    json_uint("nr_array_elts", nr_array_elts);
+    if (payload_bytes) {
+      json_uint("payload_bytes", payload_bytes);
+      json_uint("ring_slots", SPSC_SLOTS);
+      json_uint("probe_interval", SPSC_PROBE_INTERVAL);
     }
-    for (size_t j = i + 1; j <= last_cpu; ++j) {
-      if (!CPU_ISSET(j, &cpus)) {
-        continue;
-      }
-
-      thread_args_t odd;
-      CPU_ZERO(&odd.cpus);
-      CPU_SET(j, &odd.cpus);
-      odd.me = 1;
-      odd.buddy = 0;
-      __sync_lock_test_and_set(&nr_pingpongs.x, 0);
-      pthread_t odd_thread;
-      if (pthread_create(&odd_thread, NULL, thread_fn, &odd)) {
-        perror("pthread_create odd");
-        exit(1);
-      }
-      pthread_t even_thread;
-      if (pthread_create(&even_thread, NULL, thread_fn, &even)) {
-        perror("pthread_create even");
-        exit(1);
-      }
-
-      uint64_t last_stamp = now_nsec();
-      double best_sample = 1. / 0.;  // infinity
-      for (size_t sample_no = 0; sample_no < NR_SAMPLES; ++sample_no) {
-        usleep(SAMPLE_US);
-        atomic_t s = __sync_lock_test_and_set(&nr_pingpongs.x, 0);
-        uint64_t time_stamp = now_nsec();
-        double sample = (time_stamp - last_stamp) / (double)s;
-        last_stamp = time_stamp;
-        if (sample < best_sample) {
-          best_sample = sample;
-        }
-      }
-      printf("%*.1f", col_width, best_sample);
-
-      stop_loops = 1;
-      if (pthread_join(odd_thread, NULL)) {
-        perror("pthread_join odd_thread");
-        exit(1);
-      }
-      if (pthread_join(even_thread, NULL)) {
-        perror("pthread_join even_thread");
-        exit(1);
-      }
-      stop_loops = 0;
+    json_uint("nr_samples", NR_SAMPLES);
+    json_uint("sample_ns", SAMPLE_US * 1000ull);
+    json_bool("parallel", parallel);
+    json_bool("exclusive_llc", exclusive_llc);
+    json_end_record();
+  } else if (payload_bytes) {
+    printf(
+        "bandwidth of a single producer single consumer ring of %d %zu byte "
+        "messages\nfrom one core (rows) to another, in GB/s\n\n",
+        SPSC_SLOTS, payload_bytes);
+    print_header();
+  } else {
+    printf(
+        "avg latency to communicate a modified line from one core to "
+        "another\n");
+    printf("times are in ns\n\n");
+    print_header();
+  }
 
-      if (munmap(pingpong_mutex, getpagesize())) {
-        perror("munmap");
-        exit(1);
+  enum table table = payload_bytes ? TABLE_GBPS : TABLE_NS;
+  if (parallel) {
+    measure_tournament(pairs, nr_rows, exclusive_llc);
+    for (size_t i = 0; i < nr_rows; ++i) print_row(i, table);
+  } else {
+    for (size_t i = 0; i < nr_rows; ++i) {
+      for (size_t j = i + 1; j < nr_cpus; ++j) {
+        set_pair(&pairs[0], i, j);
+        measure_pairs(pairs, 1);
       }
-      pingpong_mutex = NULL;
+      print_row(i, table);
     }
+  }
+  if (!json_output) printf("\n");
+
+  if (payload_bytes && !json_output) {
+    printf(
+        "one way latency of a message sent to an empty ring, one in %d, in "
+        "ns\n\n",
+        SPSC_PROBE_INTERVAL);
+    print_header();
+    for (size_t i = 0; i < nr_rows; ++i) print_row(i, TABLE_LATENCY);
     printf("\n");
   }
-  printf("\n");
 
   return 0;
 }
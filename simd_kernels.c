@@ -0,0 +1,227 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "simd_kernels.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifdef __ARM_FEATURE_SVE
+#include <arm_sve.h>
+#endif
+#ifndef HWCAP_SVE
+#define HWCAP_SVE (1 << 22)
+#endif
+#endif
+
+// the fixed width kernels are all generated from the isa's vector type and
+// a handful of operations on it: isa##_vec, isa##_set1, isa##_load,
+// isa##_add, isa##_storeu, and isa##_store2 / isa##_stream2 which store two
+// consecutive vectors.  each loop iteration handles four vectors.
+#define READ_KERNEL(isa, attr)                                              \
+  static attr uint64_t isa##_read(uint64_t *dst, const uint64_t *src0,      \
+                                  const uint64_t *src1, size_t n) {         \
+    const size_t w = sizeof(isa##_vec) / sizeof(uint64_t);                  \
+    isa##_vec s0 = isa##_set1(0), s1 = s0, s2 = s0, s3 = s0;                \
+    uint64_t lanes[sizeof(isa##_vec) / sizeof(uint64_t)], sum = 0;          \
+    size_t i;                                                               \
+    for (i = 0; i < n; i += 4 * w) {                                        \
+      s0 = isa##_add(s0, isa##_load(src0 + i));                             \
+      s1 = isa##_add(s1, isa##_load(src0 + i + w));                         \
+      s2 = isa##_add(s2, isa##_load(src0 + i + 2 * w));                     \
+      s3 = isa##_add(s3, isa##_load(src0 + i + 3 * w));                     \
+    }                                                                       \
+    isa##_storeu(lanes, isa##_add(isa##_add(s0, s1), isa##_add(s2, s3)));   \
+    for (i = 0; i < w; ++i) sum += lanes[i];                                \
+    return sum;                                                             \
+  }
+
+#define WRITE_VALUE(isa, j) isa##_set1(0x5a)
+#define COPY_VALUE(isa, j) isa##_load(src0 + (j))
+#define TRIAD_VALUE(isa, j) \
+  isa##_add(isa##_load(src0 + (j)), isa##_load(src1 + (j)))
+
+#define STORE_KERNEL(isa, attr, name, store2, fence, VALUE)                \
+  static attr uint64_t isa##_##name(uint64_t *dst, const uint64_t *src0,   \
+                                    const uint64_t *src1, size_t n) {      \
+    const size_t w = sizeof(isa##_vec) / sizeof(uint64_t);                 \
+    size_t i;                                                              \
+    for (i = 0; i < n; i += 4 * w) {                                       \
+      store2(dst + i, VALUE(isa, i), VALUE(isa, i + w));                   \
+      store2(dst + i + 2 * w, VALUE(isa, i + 2 * w), VALUE(isa, i + 3 * w)); \
+    }                                                                      \
+    fence;                                                                 \
+    return n;                                                              \
+  }
+
+#define FIXED_WIDTH_KERNELS(isa, attr, nt_fence)                            \
+  READ_KERNEL(isa, attr)                                                    \
+  STORE_KERNEL(isa, attr, write, isa##_store2, (void)0, WRITE_VALUE)        \
+  STORE_KERNEL(isa, attr, write_nt, isa##_stream2, nt_fence, WRITE_VALUE)   \
+  STORE_KERNEL(isa, attr, copy, isa##_store2, (void)0, COPY_VALUE)          \
+  STORE_KERNEL(isa, attr, copy_nt, isa##_stream2, nt_fence, COPY_VALUE)     \
+  STORE_KERNEL(isa, attr, triad, isa##_store2, (void)0, TRIAD_VALUE)        \
+  STORE_KERNEL(isa, attr, triad_nt, isa##_stream2, nt_fence, TRIAD_VALUE)
+
+#define KERNEL_TABLE(isa)                                 \
+  {"read", #isa, 1, isa##_read},                          \
+      {"write", #isa, 1, isa##_write},                    \
+      {"write-nt", #isa, 1, isa##_write_nt},              \
+      {"copy", #isa, 2, isa##_copy},                      \
+      {"copy-nt", #isa, 2, isa##_copy_nt},                \
+      {"triad", #isa, 3, isa##_triad},                    \
+      {"triad-nt", #isa, 3, isa##_triad_nt}
+
+#if defined(__x86_64__)
+typedef __m128i sse2_vec;
+#define sse2_set1(x) _mm_set1_epi64x(x)
+#define sse2_load(p) _mm_load_si128((const __m128i *)(p))
+#define sse2_add(a, b) _mm_add_epi64(a, b)
+#define sse2_storeu(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define sse2_store2(p, a, b)            \
+  (_mm_store_si128((__m128i *)(p), a), \
+   _mm_store_si128((__m128i *)(p) + 1, b))
+#define sse2_stream2(p, a, b)            \
+  (_mm_stream_si128((__m128i *)(p), a), \
+   _mm_stream_si128((__m128i *)(p) + 1, b))
+FIXED_WIDTH_KERNELS(sse2, __attribute__((target("sse2"))), _mm_sfence())
+
+typedef __m256i avx2_vec;
+#define avx2_set1(x) _mm256_set1_epi64x(x)
+#define avx2_load(p) _mm256_load_si256((const __m256i *)(p))
+#define avx2_add(a, b) _mm256_add_epi64(a, b)
+#define avx2_storeu(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define avx2_store2(p, a, b)               \
+  (_mm256_store_si256((__m256i *)(p), a), \
+   _mm256_store_si256((__m256i *)(p) + 1, b))
+#define avx2_stream2(p, a, b)               \
+  (_mm256_stream_si256((__m256i *)(p), a), \
+   _mm256_stream_si256((__m256i *)(p) + 1, b))
+FIXED_WIDTH_KERNELS(avx2, __attribute__((target("avx2"))), _mm_sfence())
+
+typedef __m512i avx512_vec;
+#define avx512_set1(x) _mm512_set1_epi64(x)
+#define avx512_load(p) _mm512_load_si512((const void *)(p))
+#define avx512_add(a, b) _mm512_add_epi64(a, b)
+#define avx512_storeu(p, v) _mm512_storeu_si512((void *)(p), v)
+#define avx512_store2(p, a, b)             \
+  (_mm512_store_si512((__m512i *)(p), a), \
+   _mm512_store_si512((__m512i *)(p) + 1, b))
+#define avx512_stream2(p, a, b)             \
+  (_mm512_stream_si512((__m512i *)(p), a), \
+   _mm512_stream_si512((__m512i *)(p) + 1, b))
+FIXED_WIDTH_KERNELS(avx512, __attribute__((target("avx512f"))), _mm_sfence())
+
+static const struct simd_kernel simd_kernels[] = {
+    KERNEL_TABLE(avx512), KERNEL_TABLE(avx2), KERNEL_TABLE(sse2)};
+
+static bool isa_supported(const char *isa) {
+  __builtin_cpu_init();
+  if (strcmp(isa, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+  if (strcmp(isa, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  return true;
+}
+
+#elif defined(__aarch64__)
+typedef uint64x2_t neon_vec;
+#define neon_set1(x) vdupq_n_u64(x)
+#define neon_load(p) vld1q_u64(p)
+#define neon_add(a, b) vaddq_u64(a, b)
+#define neon_storeu(p, v) vst1q_u64(p, v)
+#define neon_store2(p, a, b) (vst1q_u64(p, a), vst1q_u64((p) + 2, b))
+#define neon_stream2(p, a, b) \
+  asm volatile("stnp %q0, %q1, [%2]" ::"w"(a), "w"(b), "r"(p) : "memory")
+FIXED_WIDTH_KERNELS(neon, , (void)0)
+
+#ifdef __ARM_FEATURE_SVE
+// sve is vector length agnostic so it doesn't fit the fixed width template,
+// each iteration handles one predicated vector.
+static uint64_t sve_read(uint64_t *dst, const uint64_t *src0,
+                         const uint64_t *src1, size_t n) {
+  svuint64_t sum = svdup_n_u64(0);
+  size_t i;
+  for (i = 0; i < n; i += svcntd()) {
+    svbool_t pg = svwhilelt_b64_u64(i, n);
+    sum = svadd_u64_m(pg, sum, svld1_u64(pg, src0 + i));
+  }
+  return svaddv_u64(svptrue_b64(), sum);
+}
+
+#define SVE_STORE_KERNEL(name, store, VALUE)                                 \
+  static uint64_t sve_##name(uint64_t *dst, const uint64_t *src0,            \
+                             const uint64_t *src1, size_t n) {               \
+    size_t i;                                                                \
+    for (i = 0; i < n; i += svcntd()) {                                      \
+      svbool_t pg = svwhilelt_b64_u64(i, n);                                 \
+      store(pg, dst + i, VALUE);                                             \
+    }                                                                        \
+    return n;                                                                \
+  }
+SVE_STORE_KERNEL(write, svst1_u64, svdup_n_u64(0x5a))
+SVE_STORE_KERNEL(write_nt, svstnt1_u64, svdup_n_u64(0x5a))
+SVE_STORE_KERNEL(copy, svst1_u64, svld1_u64(pg, src0 + i))
+SVE_STORE_KERNEL(copy_nt, svstnt1_u64, svld1_u64(pg, src0 + i))
+SVE_STORE_KERNEL(triad, svst1_u64,
+                 svadd_u64_x(pg, svld1_u64(pg, src0 + i),
+                             svld1_u64(pg, src1 + i)))
+SVE_STORE_KERNEL(triad_nt, svstnt1_u64,
+                 svadd_u64_x(pg, svld1_u64(pg, src0 + i),
+                             svld1_u64(pg, src1 + i)))
+#endif
+
+static const struct simd_kernel simd_kernels[] = {
+#ifdef __ARM_FEATURE_SVE
+    KERNEL_TABLE(sve),
+#endif
+    KERNEL_TABLE(neon)};
+
+static bool isa_supported(const char *isa) {
+  if (strcmp(isa, "sve") == 0) return (getauxval(AT_HWCAP) & HWCAP_SVE) != 0;
+  return true;
+}
+
+#else
+static const struct simd_kernel simd_kernels[] = {{NULL, NULL, 0, NULL}};
+
+static bool isa_supported(const char *isa) { return false; }
+#endif
+
+const struct simd_kernel *select_simd_kernel(const char *pattern,
+                                             const char *isa) {
+  size_t i;
+
+  for (i = 0; i < sizeof(simd_kernels) / sizeof(simd_kernels[0]); ++i) {
+    const struct simd_kernel *k = &simd_kernels[i];
+    if (k->pattern == NULL || strcmp(k->pattern, pattern)) continue;
+    if (isa && strcmp(k->isa, isa)) continue;
+    if (isa_supported(k->isa)) return k;
+  }
+  return NULL;
+}
+
+const char *simd_kernel_isas(void) {
+#if defined(__x86_64__)
+  return "avx512 avx2 sse2";
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_SVE)
+  return "sve neon";
+#elif defined(__aarch64__)
+  return "neon";
+#else
+  return "none";
+#endif
+}
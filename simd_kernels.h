@@ -0,0 +1,46 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef SIMD_KERNELS_H_INCLUDED
+#define SIMD_KERNELS_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// streams passed to a kernel must start on this boundary and be a multiple
+// of this many bytes long (four vectors of the widest isa).
+#define SIMD_KERNEL_ALIGN 256
+
+// one pass over n words of each stream.  read sums src0, write fills dst,
+// copy is dst = src0 and triad is dst = src0 + src1.  the result depends on
+// everything read so the loads can't be optimized away.
+typedef uint64_t (*simd_kernel_fn)(uint64_t *dst, const uint64_t *src0,
+                                   const uint64_t *src1, size_t n);
+
+struct simd_kernel {
+  const char *pattern;  // read, write, copy, triad; -nt for streaming stores
+  const char *isa;
+  unsigned nr_streams;  // buffers touched by one pass
+  simd_kernel_fn fn;
+};
+
+// the kernel for pattern using isa, or the widest isa this cpu supports if
+// isa is NULL.  returns NULL if there is no such kernel or the cpu can't run
+// it.
+const struct simd_kernel *select_simd_kernel(const char *pattern,
+                                             const char *isa);
+
+// space separated list of the isas built in, best first.
+const char *simd_kernel_isas(void);
+
+#endif
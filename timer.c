@@ -0,0 +1,92 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "timer.h"
+
+#include <stdbool.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#define TIMER_CALIBRATION_NSEC (10 * 1000 * 1000)
+#define TIMER_CALIBRATION_READS 16
+
+struct timer_calibration timer_calibration;
+
+static bool counter_usable(void) {
+#if defined(__x86_64__)
+  unsigned eax, ebx, ecx, edx;
+
+  // rdtscp, and a tsc which ticks at a constant rate in every p- and c-state
+  if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) ||
+      !(edx & (1u << 27))) {
+    return false;
+  }
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+#elif defined(__aarch64__)
+  // the generic timer always runs at a constant rate
+  return true;
+#else
+  return false;
+#endif
+}
+
+// a counter value and the time in the middle of it, from the read which took
+// the least cycles
+static void read_pair(uint64_t *cycles, uint64_t *nsec) {
+  uint64_t best = UINT64_MAX;
+
+  for (int i = 0; i < TIMER_CALIBRATION_READS; ++i) {
+    uint64_t c0 = timer_cycles();
+    uint64_t n = monotonic_nsec();
+    uint64_t c1 = timer_cycles();
+    if (c1 - c0 < best) {
+      best = c1 - c0;
+      *cycles = c0 + (c1 - c0) / 2;
+      *nsec = n;
+    }
+  }
+}
+
+void timer_init(void) {
+  struct timespec delay = {0, TIMER_CALIBRATION_NSEC};
+  uint64_t c0 = 0, n0 = 0, c1 = 0, n1 = 0;
+
+  if (!counter_usable()) return;
+  read_pair(&c0, &n0);
+  nanosleep(&delay, NULL);
+  read_pair(&c1, &n1);
+  if (c1 <= c0 || n1 <= n0) return;
+  double ns_per_cycle = (double)(n1 - n0) / (c1 - c0);
+  // anything outside 1MHz - 20GHz is not a counter we understand
+  if (ns_per_cycle < 0.05 || ns_per_cycle > 1000.) return;
+  timer_calibration.base_cycles = c1;
+  timer_calibration.base_nsec = n1;
+  timer_calibration.mult = (uint64_t)(ns_per_cycle * 4294967296. + 0.5);
+  timer_calibration.use_counter = 1;
+}
+
+const char *timer_source(void) {
+  if (!timer_calibration.use_counter) return "clock_gettime";
+#if defined(__x86_64__)
+  return "tsc";
+#else
+  return "cntvct";
+#endif
+}
+
+double timer_ghz(void) {
+  if (!timer_calibration.use_counter) return 0.;
+  return 4294967296. / timer_calibration.mult;
+}
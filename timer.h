@@ -18,10 +18,60 @@
 #include <sys/time.h>
 #include <time.h>
 
-static inline uint64_t now_nsec(void) {
+// now_nsec() reads the cpu's counter (the invariant tsc with rdtscp on
+// x86_64, cntvct_el0 on arm64) scaled by a calibration against
+// CLOCK_MONOTONIC, or calls clock_gettime() if there is no usable counter
+// or timer_init() wasn't called yet.
+
+struct timer_calibration {
+  int use_counter;
+  uint64_t base_cycles;
+  uint64_t base_nsec;
+  uint64_t mult;  // ns per cycle << 32
+};
+
+extern struct timer_calibration timer_calibration;
+
+// calibrate the counter, takes about 10ms.  call it once at startup, before
+// starting any threads (or forking workers).
+void timer_init(void);
+
+// "tsc", "cntvct" or "clock_gettime", and the counter's rate (0 without)
+const char *timer_source(void);
+double timer_ghz(void);
+
+static inline uint64_t monotonic_nsec(void) {
   struct timespec ts;
   clock_gettime(CLOCK_MONOTONIC, &ts);
   return ts.tv_sec * ((uint64_t)1000 * 1000 * 1000) + ts.tv_nsec;
 }
 
+static inline uint64_t timer_cycles(void) {
+#if defined(__x86_64__)
+  uint32_t lo, hi;
+  // unlike rdtsc, waits for the earlier instructions to finish
+  __asm__ volatile("rdtscp" : "=a"(lo), "=d"(hi) : : "rcx");
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t v;
+  __asm__ volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(v) : : "memory");
+  return v;
+#else
+  return 0;
+#endif
+}
+
+static inline uint64_t now_nsec(void) {
+#if defined(__x86_64__) || defined(__aarch64__)
+  // the only targets timer_init() calibrates a counter on
+  if (timer_calibration.use_counter) {
+    uint64_t cycles = timer_cycles() - timer_calibration.base_cycles;
+    return timer_calibration.base_nsec +
+           (uint64_t)(((unsigned __int128)cycles * timer_calibration.mult) >>
+                      32);
+  }
+#endif
+  return monotonic_nsec();
+}
+
 #endif
@@ -0,0 +1,428 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "topology.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+#define SYSFS_NODE "/sys/devices/system/node"
+
+static int read_sysfs_line(const char *path, char *buf, size_t len) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL) return -1;
+  if (fgets(buf, len, f) == NULL) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  buf[strcspn(buf, "\n")] = 0;
+  return 0;
+}
+
+size_t get_cpu_caches(int cpu, struct cpu_cache *caches, size_t max_caches) {
+  size_t nr_caches = 0;
+  char path[128];
+  char buf[64];
+
+  for (int index = 0; nr_caches < max_caches; ++index) {
+    struct cpu_cache c;
+    char type[32];
+
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", cpu,
+             index);
+    if (read_sysfs_line(path, buf, sizeof(buf))) break;
+    if (sscanf(buf, "%u", &c.level) != 1) continue;
+
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/type", cpu,
+             index);
+    if (read_sysfs_line(path, type, sizeof(type))) continue;
+    if (strcmp(type, "Data") && strcmp(type, "Unified")) continue;
+
+    snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/size", cpu,
+             index);
+    if (read_sysfs_line(path, buf, sizeof(buf))) continue;
+    if (parse_mem_arg(buf, &c.size) || c.size == 0) continue;
+
+    snprintf(c.name, sizeof(c.name), "L%u%s", c.level,
+             strcmp(type, "Data") ? "" : "d");
+
+    // keep them ordered by level, sysfs usually is already
+    size_t i = nr_caches++;
+    while (i > 0 && caches[i - 1].level > c.level) {
+      caches[i] = caches[i - 1];
+      --i;
+    }
+    caches[i] = c;
+  }
+  return nr_caches;
+}
+
+int parse_cpu_list(const char *str, bool *cpus) {
+  const char *p = str;
+  char *end;
+
+  memset(cpus, 0, MAX_CPUS * sizeof(*cpus));
+  while (*p) {
+    if (!isdigit((unsigned char)*p)) return -1;
+    unsigned long first = strtoul(p, &end, 10);
+    unsigned long last = first;
+    p = end;
+    if (*p == '-') {
+      ++p;
+      if (!isdigit((unsigned char)*p)) return -1;
+      last = strtoul(p, &end, 10);
+      p = end;
+    }
+    if (first > last || last >= MAX_CPUS) return -1;
+    for (unsigned long cpu = first; cpu <= last; ++cpu) cpus[cpu] = true;
+    if (*p == ',') {
+      ++p;
+      if (*p == 0) return -1;
+    } else if (*p) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+size_t get_node_list(const char *name, int *nodes, size_t max_nodes) {
+  char path[128];
+  char buf[256];
+  bool in_list[MAX_CPUS];
+  size_t nr_nodes = 0;
+
+  snprintf(path, sizeof(path), SYSFS_NODE "/%s", name);
+  if (read_sysfs_line(path, buf, sizeof(buf)) ||
+      parse_cpu_list(buf, in_list)) {
+    return 0;
+  }
+  for (int node = 0; node < MAX_CPUS && nr_nodes < max_nodes; ++node) {
+    if (in_list[node]) nodes[nr_nodes++] = node;
+  }
+  return nr_nodes;
+}
+
+// the topology of every online cpu.  groups are identified by their first
+// cpu (core, llc) or their sysfs number (package, node), -1 if unknown.
+enum topo_unit { UNIT_CORE, UNIT_LLC, UNIT_PACKAGE, UNIT_NODE, NR_UNITS };
+static const char *const unit_names[NR_UNITS] = {"core", "llc", "package",
+                                                 "node"};
+
+static struct {
+  bool loaded;
+  bool online[MAX_CPUS];
+  int group[NR_UNITS][MAX_CPUS];
+} topo;
+
+static int first_cpu_of_list(const char *path) {
+  char buf[256];
+  bool cpus[MAX_CPUS];
+
+  if (read_sysfs_line(path, buf, sizeof(buf)) || parse_cpu_list(buf, cpus)) {
+    return -1;
+  }
+  for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+    if (cpus[cpu]) return cpu;
+  }
+  return -1;
+}
+
+static void load_topology(void) {
+  char path[128];
+  char buf[256];
+
+  if (topo.loaded) return;
+  topo.loaded = true;
+
+  for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+    for (int unit = 0; unit < NR_UNITS; ++unit) topo.group[unit][cpu] = -1;
+
+    snprintf(path, sizeof(path),
+             SYSFS_CPU "/cpu%d/topology/thread_siblings_list", cpu);
+    topo.group[UNIT_CORE][cpu] = first_cpu_of_list(path);
+    if (topo.group[UNIT_CORE][cpu] < 0) continue;  // offline or missing
+    topo.online[cpu] = true;
+
+    snprintf(path, sizeof(path),
+             SYSFS_CPU "/cpu%d/topology/physical_package_id", cpu);
+    if (read_sysfs_line(path, buf, sizeof(buf)) == 0) {
+      topo.group[UNIT_PACKAGE][cpu] = atoi(buf);
+    }
+
+    // the last level cache is the highest level listed
+    unsigned best_level = 0;
+    for (int index = 0;; ++index) {
+      unsigned level;
+      snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level",
+               cpu, index);
+      if (read_sysfs_line(path, buf, sizeof(buf))) break;
+      if (sscanf(buf, "%u", &level) != 1 || level < best_level) continue;
+      snprintf(path, sizeof(path),
+               SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+      int first = first_cpu_of_list(path);
+      if (first >= 0) {
+        best_level = level;
+        topo.group[UNIT_LLC][cpu] = first;
+      }
+    }
+    if (topo.group[UNIT_LLC][cpu] < 0) {
+      topo.group[UNIT_LLC][cpu] = topo.group[UNIT_CORE][cpu];
+    }
+  }
+
+  DIR *dir = opendir(SYSFS_NODE);
+  if (dir == NULL) return;
+  struct dirent *de;
+  while ((de = readdir(dir)) != NULL) {
+    int node;
+    bool cpus[MAX_CPUS];
+    if (sscanf(de->d_name, "node%d", &node) != 1) continue;
+    snprintf(path, sizeof(path), SYSFS_NODE "/node%d/cpulist", node);
+    if (read_sysfs_line(path, buf, sizeof(buf)) || parse_cpu_list(buf, cpus)) {
+      continue;
+    }
+    for (int cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      if (cpus[cpu]) topo.group[UNIT_NODE][cpu] = node;
+    }
+  }
+  closedir(dir);
+}
+
+int get_cpu_llc(int cpu) {
+  if (cpu < 0 || cpu >= MAX_CPUS) return -1;
+  load_topology();
+  return topo.group[UNIT_LLC][cpu];
+}
+
+// parse "nameN" into *n, or just "name" (*n = -1)
+static bool parse_unit(const char *str, const char *name, int *n) {
+  size_t len = strlen(name);
+  char *end;
+
+  if (strncmp(str, name, len)) return false;
+  if (str[len] == 0) {
+    *n = -1;
+    return true;
+  }
+  if (!isdigit((unsigned char)str[len])) return false;
+  *n = strtol(str + len, &end, 10);
+  return *end == 0;
+}
+
+// add the cpus of one term to the role, skipping the ones already used
+static int add_placement_term(char *term, const bool *allowed, bool *used,
+                              struct placement_role *role) {
+  bool scope[MAX_CPUS];
+  char *filter = strchr(term, '.');
+  int n, cpu;
+
+  if (filter) *filter++ = 0;
+
+  if (strcmp(term, "all") == 0) {
+    memcpy(scope, allowed, sizeof(scope));
+  } else if (parse_unit(term, "node", &n) && n >= 0) {
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      scope[cpu] = allowed[cpu] && topo.group[UNIT_NODE][cpu] == n;
+    }
+  } else if (parse_unit(term, "package", &n) && n >= 0) {
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      scope[cpu] = allowed[cpu] && topo.group[UNIT_PACKAGE][cpu] == n;
+    }
+  } else if (parse_cpu_list(term, scope)) {
+    fprintf(stderr, "not a cpu list, all, nodeN or packageN: %s\n", term);
+    return -1;
+  } else {
+    // like the other terms, only the cpus we may run on
+    bool any = false;
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      scope[cpu] = scope[cpu] && allowed[cpu];
+      any |= scope[cpu];
+    }
+    if (!any) {
+      fprintf(stderr, "none of the cpus %s are online and allowed\n", term);
+      return -1;
+    }
+  }
+
+  if (filter == NULL) {
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      if (!scope[cpu] || used[cpu]) continue;
+      used[cpu] = true;
+      role->cpus[role->nr_cpus++] = cpu;
+    }
+    return 0;
+  }
+
+  // the plural picks every group, the singular with a number only one
+  int unit;
+  char plural[16];
+  for (unit = 0; unit < NR_UNITS; ++unit) {
+    snprintf(plural, sizeof(plural), "%ss", unit_names[unit]);
+    if (strcmp(filter, plural) == 0) {
+      n = -1;
+      break;
+    }
+    if (parse_unit(filter, unit_names[unit], &n) && n >= 0) break;
+  }
+  if (unit == NR_UNITS) {
+    fprintf(stderr, "not a cores, llcs, packages, nodes filter: %s\n",
+            filter);
+    return -1;
+  }
+
+  const int *group = topo.group[unit];
+  int nr_groups = 0;
+  for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+    if (!scope[cpu] || group[cpu] < 0) continue;
+    // only the first cpu of each group in the scope
+    int other;
+    for (other = 0; other < cpu; ++other) {
+      if (scope[other] && group[other] == group[cpu]) break;
+    }
+    if (other < cpu) continue;
+    if (n >= 0 && nr_groups++ != n) continue;
+    // skip groups which another thread already uses
+    for (other = 0; other < MAX_CPUS; ++other) {
+      if (used[other] && group[other] == group[cpu]) break;
+    }
+    if (other == MAX_CPUS) {
+      used[cpu] = true;
+      role->cpus[role->nr_cpus++] = cpu;
+    }
+  }
+  return 0;
+}
+
+int parse_placement(const char *spec, const char *const *roles,
+                    struct placement *p) {
+  bool allowed[MAX_CPUS];
+  bool used[MAX_CPUS] = {false};
+  cpu_set_t cpus;
+  int cpu;
+
+  load_topology();
+  if (sched_getaffinity(0, sizeof(cpus), &cpus)) {
+    perror("sched_getaffinity");
+    return -1;
+  }
+  for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+    allowed[cpu] = CPU_ISSET(cpu, &cpus) && topo.online[cpu];
+  }
+
+  char *buf = strdup(spec);
+  if (buf == NULL) {
+    perror("strdup");
+    return -1;
+  }
+  p->nr_roles = 0;
+  bool bare = strchr(spec, '=') == NULL;
+  char *saveptr = NULL;
+  for (char *tok = strtok_r(buf, "/", &saveptr); tok;
+       tok = strtok_r(NULL, "/", &saveptr)) {
+    char *set = tok;
+    const char *name = "";
+    if (!bare) {
+      set = strchr(tok, '=');
+      if (set == NULL) {
+        fprintf(stderr, "expected role=set in placement: %s\n", tok);
+        goto err;
+      }
+      *set++ = 0;
+      name = tok;
+      size_t i;
+      for (i = 0; roles[i]; ++i) {
+        if (strcmp(roles[i], name) == 0) break;
+      }
+      if (roles[i] == NULL) {
+        fprintf(stderr, "not a placement role: %s\n", name);
+        goto err;
+      }
+      for (i = 0; i < p->nr_roles; ++i) {
+        if (strcmp(p->role[i].name, name) == 0) break;
+      }
+      if (i < p->nr_roles) {
+        fprintf(stderr, "placement role given twice: %s\n", name);
+        goto err;
+      }
+    }
+    if (p->nr_roles == MAX_PLACEMENT_ROLES) {
+      fprintf(stderr, "too many placement roles\n");
+      goto err;
+    }
+    struct placement_role *role = &p->role[p->nr_roles++];
+    snprintf(role->name, sizeof(role->name), "%s", name);
+    role->nr_cpus = 0;
+    char *saveterm = NULL;
+    for (char *term = strtok_r(set, "+", &saveterm); term;
+         term = strtok_r(NULL, "+", &saveterm)) {
+      if (add_placement_term(term, allowed, used, role)) goto err;
+    }
+    if (role->nr_cpus == 0) {
+      fprintf(stderr, "no cpus left for placement %s=%s\n", name, set);
+      goto err;
+    }
+  }
+  free(buf);
+
+  // the roles which weren't given get what's left
+  for (size_t i = 0; !bare && roles[i]; ++i) {
+    size_t j;
+    for (j = 0; j < p->nr_roles; ++j) {
+      if (strcmp(p->role[j].name, roles[i]) == 0) break;
+    }
+    if (j < p->nr_roles || p->nr_roles == MAX_PLACEMENT_ROLES) continue;
+    struct placement_role *role = &p->role[p->nr_roles++];
+    snprintf(role->name, sizeof(role->name), "%s", roles[i]);
+    role->nr_cpus = 0;
+    for (cpu = 0; cpu < MAX_CPUS; ++cpu) {
+      if (allowed[cpu] && !used[cpu]) role->cpus[role->nr_cpus++] = cpu;
+    }
+  }
+  return 0;
+
+err:
+  free(buf);
+  return -1;
+}
+
+int placement_cpu(const struct placement *p, const char *role, size_t index,
+                  size_t thread_num) {
+  for (size_t i = 0; i < p->nr_roles; ++i) {
+    const struct placement_role *r = &p->role[i];
+    if (r->name[0] == 0) {
+      return thread_num < r->nr_cpus ? r->cpus[thread_num] : -1;
+    }
+    if (strcmp(r->name, role) == 0) {
+      return index < r->nr_cpus ? r->cpus[index] : -1;
+    }
+  }
+  return -1;
+}
+
+void print_placement(const struct placement *p) {
+  for (size_t i = 0; i < p->nr_roles; ++i) {
+    const struct placement_role *r = &p->role[i];
+    printf("placement%s%s =", r->name[0] ? " " : "", r->name);
+    for (size_t j = 0; j < r->nr_cpus; ++j) printf(" %d", r->cpus[j]);
+    printf("\n");
+  }
+}
@@ -0,0 +1,81 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef TOPOLOGY_H_INCLUDED
+#define TOPOLOGY_H_INCLUDED
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MAX_CPUS 1024  // same as CPU_SETSIZE
+#define MAX_CPU_CACHES 8
+#define MAX_PLACEMENT_ROLES 4
+
+struct cpu_cache {
+  unsigned level;
+  char name[8];  // e.g. "L1d", "L2"
+  size_t size;
+};
+
+// read the data and unified caches of a cpu from sysfs, ordered by level.
+// returns the number of caches found, 0 if sysfs has no cache information.
+size_t get_cpu_caches(int cpu, struct cpu_cache *caches, size_t max_caches);
+
+// the first cpu sharing the last level cache of cpu, -1 if unknown.
+int get_cpu_llc(int cpu);
+
+// parse a cpu list such as "0-3,8,10-11" into cpus[MAX_CPUS].
+int parse_cpu_list(const char *str, bool *cpus);
+
+// read a sysfs node list such as "has_cpu" or "has_memory" into nodes[],
+// returns the number of nodes or 0 if there is no such list.
+size_t get_node_list(const char *name, int *nodes, size_t max_nodes);
+
+// a placement assigns the threads of each role (e.g. "chase", "load") to an
+// ordered list of cpus, thread i of a role runs on cpus[i].
+struct placement_role {
+  char name[16];  // "" when the spec applies to every thread
+  size_t nr_cpus;
+  int cpus[MAX_CPUS];
+};
+
+struct placement {
+  size_t nr_roles;
+  struct placement_role role[MAX_PLACEMENT_ROLES];
+};
+
+// parse a placement spec: either a single set for every thread, or
+// role=set/role=set/... using the NULL terminated roles[].  roles are
+// resolved in order, a cpu used by one role (or a core, llc, ... when using
+// a filter below) is not used again, and roles which aren't named get every
+// allowed cpu which is left.
+//
+//   set    := term[+term...]
+//   term   := scope[.filter]
+//   scope  := all | nodeN | packageN | cpu list
+//   filter := cores | llcs | packages | nodes   (first cpu of each)
+//           | coreK | llcK | packageK | nodeK   (first cpu of the K-th)
+//
+// e.g. "chase=node0.core0/load=node1.cores".  prints an error and returns
+// -1 if the spec is invalid.
+int parse_placement(const char *spec, const char *const *roles,
+                    struct placement *p);
+
+// the cpu for thread index of a role (thread_num is the index amongst all
+// threads), or -1 if the placement has no cpu left for it.
+int placement_cpu(const struct placement *p, const char *role, size_t index,
+                  size_t thread_num);
+
+void print_placement(const struct placement *p);
+
+#endif
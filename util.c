@@ -13,7 +13,9 @@
  */
 #include "util.h"
 
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 int parse_mem_arg(const char *str, size_t *result) {
   size_t r;
@@ -43,3 +45,87 @@ int parse_mem_arg(const char *str, size_t *result) {
   *result = r;
   return 0;
 }
+
+int parse_mem_sweep_arg(const char *str, struct mem_sweep *result) {
+  struct mem_sweep r;
+  char buf[64];
+  const char *colon;
+  char *p;
+
+  colon = strchr(str, ':');
+  if (colon == NULL || (size_t)(colon - str) >= sizeof(buf)) return -1;
+  memcpy(buf, str, colon - str);
+  buf[colon - str] = 0;
+  if (parse_mem_arg(buf, &r.low)) return -1;
+  str = colon + 1;
+
+  colon = strchr(str, ':');
+  if (colon == NULL || (size_t)(colon - str) >= sizeof(buf)) return -1;
+  memcpy(buf, str, colon - str);
+  buf[colon - str] = 0;
+  if (parse_mem_arg(buf, &r.high)) return -1;
+  str = colon + 1;
+
+  r.factor = 1.;
+  r.increment = 0;
+  if (*str == 'x') {
+    r.factor = strtod(str + 1, &p);
+    if (p == str + 1 || *p || !(r.factor > 1.)) return -1;
+  } else if (*str == '+') {
+    if (parse_mem_arg(str + 1, &r.increment) || r.increment == 0) return -1;
+  } else {
+    return -1;
+  }
+  if (r.low > r.high) return -1;
+  *result = r;
+  return 0;
+}
+
+size_t mem_sweep_next(const struct mem_sweep *sweep, size_t size) {
+  size_t next;
+
+  if (sweep->increment) {
+    next = size + sweep->increment;
+  } else {
+    next = (size_t)(size * sweep->factor);
+    if (next <= size) next = size + 1;
+  }
+  return next < size ? (size_t)-1 : next;  // don't wrap around
+}
+
+int parse_ci_arg(const char *str, double *target, double *max_secs) {
+  char *p;
+
+  *target = strtod(str, &p) / 100.;
+  if (p == str || !(*target > 0.)) return -1;
+  *max_secs = CI_DEF_MAX_SECS;
+  if (*p == ':') {
+    str = p + 1;
+    *max_secs = strtod(str, &p);
+    if (p == str || !(*max_secs > 0.)) return -1;
+  }
+  return *p ? -1 : 0;
+}
+
+void sample_ci_add(struct sample_ci *ci, double x) {
+  double delta = x - ci->mean;
+
+  ++ci->n;
+  ci->mean += delta / ci->n;
+  ci->m2 += delta * (x - ci->mean);
+}
+
+double sample_ci_half_width(const struct sample_ci *ci) {
+  // two sided 95% quantiles of student's t for 1 - 30 degrees of freedom
+  static const double t95[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201,  2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080,  2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+  };
+  size_t df = ci->n - 1;
+
+  if (ci->n < 2) return INFINITY;
+  // beyond the table 1.96 + 2.5 / df is within 0.002
+  double t = df <= sizeof(t95) / sizeof(t95[0]) ? t95[df - 1] : 1.96 + 2.5 / df;
+  return t * sqrt(ci->m2 / df / ci->n);
+}
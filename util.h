@@ -18,4 +18,33 @@
 
 int parse_mem_arg(const char *str, size_t *result);
 
+// a range of sizes given as "low:high:xF" (multiply by F at each step) or
+// "low:high:+N" (add N at each step), each size suffixed with k, m, or g.
+struct mem_sweep {
+  size_t low;
+  size_t high;
+  double factor;
+  size_t increment;
+};
+
+int parse_mem_sweep_arg(const char *str, struct mem_sweep *result);
+size_t mem_sweep_next(const struct mem_sweep *sweep, size_t size);
+
+// adaptive sampling (-A "pct[:secs]"): sample until the 95% confidence
+// interval of the mean is within pct% of it, after at least CI_MIN_SAMPLES,
+// or for at most secs (default CI_DEF_MAX_SECS).
+#define CI_MIN_SAMPLES 5
+#define CI_DEF_MAX_SECS 60.
+
+struct sample_ci {
+  size_t n;
+  double mean;
+  double m2;  // sum of the squared differences from the mean (welford)
+};
+
+int parse_ci_arg(const char *str, double *target, double *max_secs);
+void sample_ci_add(struct sample_ci *ci, double x);
+// half the width of the interval (student's t), infinite below 2 samples
+double sample_ci_half_width(const struct sample_ci *ci);
+
 #endif
@@ -0,0 +1,177 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#define _GNU_SOURCE
+#include "workers.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CGROUP_ROOT "/sys/fs/cgroup"
+
+// the workers the coordinator kills when it exits (or one of them does)
+static struct worker_list *running_workers;
+
+int parse_workers(const char *str, struct worker_list *list) {
+  char *copy = strdup(str);
+  char *tok, *save = NULL, *end, *at;
+  int rc = 0;
+
+  list->nr = 0;
+  list->nr_threads = 0;
+  for (tok = strtok_r(copy, ",", &save); tok;
+       tok = strtok_r(NULL, ",", &save)) {
+    struct worker *w = &list->worker[list->nr];
+    if (list->nr == MAX_WORKERS) {
+      rc = -1;
+      break;
+    }
+    at = strchr(tok, '@');
+    if (at) *at++ = 0;
+    w->nr_threads = strtoul(tok, &end, 0);
+    if (*end || end == tok || w->nr_threads == 0 || (at && *at == 0)) {
+      rc = -1;
+      break;
+    }
+    w->first_thread = list->nr_threads;
+    w->cgroup = NULL;
+    if (at && asprintf(&w->cgroup, "%s%s%s", at[0] == '/' ? "" : CGROUP_ROOT,
+                       at[0] == '/' ? "" : "/", at) < 0) {
+      rc = -1;
+      break;
+    }
+    w->pid = 0;
+    list->nr_threads += w->nr_threads;
+    ++list->nr;
+  }
+  free(copy);
+  if (list->nr == 0) return -1;
+  return rc;
+}
+
+void print_workers(const struct worker_list *list) {
+  size_t i;
+
+  for (i = 0; i < list->nr; ++i) {
+    const struct worker *w = &list->worker[i];
+    printf("worker %zu: threads %zu-%zu", i, w->first_thread,
+           w->first_thread + w->nr_threads - 1);
+    if (w->cgroup) printf(" in %s", w->cgroup);
+    printf("\n");
+  }
+}
+
+pthread_barrier_t *alloc_shared_barrier(unsigned nr) {
+  pthread_barrierattr_t attr;
+  pthread_barrier_t *barrier =
+      mmap(0, sizeof(*barrier), PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+  if (barrier == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  if (pthread_barrierattr_init(&attr) ||
+      pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) ||
+      pthread_barrier_init(barrier, &attr, nr)) {
+    perror("pthread_barrier_init");
+    exit(1);
+  }
+  pthread_barrierattr_destroy(&attr);
+  return barrier;
+}
+
+static void kill_workers(void) {
+  size_t i;
+
+  for (i = 0; i < running_workers->nr; ++i) {
+    if (running_workers->worker[i].pid > 0) {
+      kill(running_workers->worker[i].pid, SIGKILL);
+    }
+  }
+}
+
+// a worker only exits on an error (e.g. it could not place its threads), so
+// the run is over
+static void worker_exited(int sig) {
+  static const char msg[] = "Error: a worker process exited\n";
+
+  if (write(2, msg, sizeof(msg) - 1) < 0) {
+    // nothing more to do about it
+  }
+  kill_workers();
+  _exit(1);
+}
+
+static void stop_workers(void) {
+  size_t i;
+
+  signal(SIGCHLD, SIG_DFL);
+  kill_workers();
+  for (i = 0; i < running_workers->nr; ++i) {
+    if (running_workers->worker[i].pid > 0) {
+      waitpid(running_workers->worker[i].pid, NULL, 0);
+    }
+  }
+}
+
+static void join_cgroup(const char *cgroup) {
+  char path[4096];
+  FILE *f;
+
+  snprintf(path, sizeof(path), "%s/cgroup.procs", cgroup);
+  f = fopen(path, "w");
+  if (f == NULL || fprintf(f, "%d\n", getpid()) < 0 || fclose(f)) {
+    fprintf(stderr, "Error: could not join cgroup %s: %s\n", cgroup,
+            strerror(errno));
+    exit(1);
+  }
+}
+
+const struct worker *start_workers(struct worker_list *list) {
+  pid_t coordinator = getpid();
+  size_t i;
+
+  running_workers = list;
+  signal(SIGCHLD, worker_exited);
+  // or the workers would print our buffered output again
+  fflush(stdout);
+  fflush(stderr);
+  for (i = 0; i < list->nr; ++i) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      kill_workers();
+      exit(1);
+    }
+    if (pid == 0) {
+      signal(SIGCHLD, SIG_DFL);
+      if (prctl(PR_SET_PDEATHSIG, SIGKILL) || getppid() != coordinator) {
+        _exit(1);
+      }
+      if (list->worker[i].cgroup) join_cgroup(list->worker[i].cgroup);
+      list->worker[i].pid = getpid();
+      return &list->worker[i];
+    }
+    list->worker[i].pid = pid;
+  }
+  atexit(stop_workers);
+  return NULL;
+}
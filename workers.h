@@ -0,0 +1,56 @@
+/* Copyright 2015 Google Inc. All Rights Reserved.
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef WORKERS_H_INCLUDED
+#define WORKERS_H_INCLUDED
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A run split over worker processes.  The coordinator maps the arena and the
+// per thread data shared (ARENA_SHARED), forks one worker per spec which
+// joins its cgroup and starts its share of the threads, and samples every
+// thread as if it were its own.  Each worker has its own page tables and is
+// scheduled and accounted as a process of its cgroup.
+
+#define MAX_WORKERS 64
+
+struct worker {
+  size_t first_thread;  // runs threads first_thread .. + nr_threads - 1
+  size_t nr_threads;
+  char *cgroup;  // cgroup directory to join, NULL to stay in ours
+  pid_t pid;
+};
+
+struct worker_list {
+  size_t nr;
+  size_t nr_threads;  // of all workers
+  struct worker worker[MAX_WORKERS];
+};
+
+// parse "N[@cgroup],N[@cgroup]...", every worker running the next N threads.
+// a relative cgroup is below /sys/fs/cgroup.
+int parse_workers(const char *str, struct worker_list *list);
+void print_workers(const struct worker_list *list);
+
+// a barrier in shared memory for nr threads of any of the processes
+pthread_barrier_t *alloc_shared_barrier(unsigned nr);
+
+// fork every worker.  returns the worker the calling process is, once it
+// joined its cgroup, or NULL in the coordinator.  workers die with the
+// coordinator, and the coordinator exits if a worker does; the workers are
+// killed when the coordinator exits.
+const struct worker *start_workers(struct worker_list *list);
+
+#endif